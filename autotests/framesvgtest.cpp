@@ -5,8 +5,13 @@
 */
 
 #include "framesvgtest.h"
+#include <QBitmap>
 #include <QDirIterator>
 #include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QThread>
+
+#include <atomic>
 
 void copyDirectory(const QString &srcDir, const QString &dstDir)
 {
@@ -126,6 +131,328 @@ void FrameSvgTest::loadQrc()
     delete frameSvg;
 }
 
+void FrameSvgTest::sharedDescriptor()
+{
+    KSvg::FrameSvg frameSvg;
+    frameSvg.setImagePath(QFINDTESTDATA("data/background.svgz"));
+    // hint-stretch-borders has no prefix, so it applies to every prefix
+    QCOMPARE(frameSvg.frameHints(), KSvg::FrameSvg::FrameHints(KSvg::FrameSvg::StretchBorders));
+
+    frameSvg.resize();
+    const QMarginsF borders = frameSvg.borderSizes();
+    QCOMPARE(borders,
+             QMarginsF(frameSvg.elementSize(QStringLiteral("left")).width(),
+                       frameSvg.elementSize(QStringLiteral("top")).height(),
+                       frameSvg.elementSize(QStringLiteral("right")).width(),
+                       frameSvg.elementSize(QStringLiteral("bottom")).height()));
+
+    frameSvg.setEnabledBorders(KSvg::FrameSvg::TopBorder | KSvg::FrameSvg::LeftBorder);
+    QCOMPARE(frameSvg.borderSizes(), QMarginsF(borders.left(), borders.top(), 0, 0));
+
+    // Another frame of the same prefix gets the same description
+    KSvg::FrameSvg other;
+    other.setImagePath(QFINDTESTDATA("data/background.svgz"));
+    QCOMPARE(other.borderSizes(), borders);
+    QCOMPARE(other.fixedMargins(), frameSvg.fixedMargins());
+    QCOMPARE(other.insets(), frameSvg.insets());
+}
+
+void FrameSvgTest::resizeComposesPieces()
+{
+    KSvg::FrameSvg frameSvg;
+    frameSvg.setImagePath(QFINDTESTDATA("data/background.svgz"));
+    const QMarginsF borders = frameSvg.borderSizes();
+
+    frameSvg.resizeFrame(QSize(100, 100));
+    const QImage small = frameSvg.framePixmap().toImage();
+    frameSvg.resizeFrame(QSize(150, 120));
+    const QImage large = frameSvg.framePixmap().toImage();
+    QCOMPARE(large.size(), QSize(150, 120));
+
+    // The corners are the same pieces at every size
+    const QSize topLeft(borders.left(), borders.top());
+    QCOMPARE(large.copy(QRect(QPoint(0, 0), topLeft)), small.copy(QRect(QPoint(0, 0), topLeft)));
+    const QSize bottomRight(borders.right(), borders.bottom());
+    QCOMPARE(large.copy(QRect(QPoint(150 - bottomRight.width(), 120 - bottomRight.height()), bottomRight)),
+             small.copy(QRect(QPoint(100 - bottomRight.width(), 100 - bottomRight.height()), bottomRight)));
+}
+
+// Nine 10x10 pieces, red corners, green sides and a blue center, under a white square
+static void writeGridSvg(const QString &path)
+{
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(R"(<svg xmlns="http://www.w3.org/2000/svg" width="30" height="30">
+  <rect id="topleft" x="0" y="0" width="10" height="10" fill="#ff0000"/>
+  <rect id="top" x="10" y="0" width="10" height="10" fill="#00ff00"/>
+  <rect id="topright" x="20" y="0" width="10" height="10" fill="#ff0000"/>
+  <rect id="left" x="0" y="10" width="10" height="10" fill="#00ff00"/>
+  <rect id="center" x="10" y="10" width="10" height="10" fill="#0000ff"/>
+  <rect id="right" x="20" y="10" width="10" height="10" fill="#00ff00"/>
+  <rect id="bottomleft" x="0" y="20" width="10" height="10" fill="#ff0000"/>
+  <rect id="bottom" x="10" y="20" width="10" height="10" fill="#00ff00"/>
+  <rect id="bottomright" x="20" y="20" width="10" height="10" fill="#ff0000"/>
+  <rect id="unrelated" x="0" y="0" width="30" height="30" fill="#ffffff"/>
+</svg>
+)");
+}
+
+void FrameSvgTest::piecesInOnePass()
+{
+    // The pieces are rendered together and sliced out, without what else overlaps them
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("grid.svg"));
+    writeGridSvg(path);
+
+    KSvg::FrameSvg frameSvg;
+    frameSvg.setImagePath(path);
+    frameSvg.resizeFrame(QSize(50, 40));
+    const QImage image = frameSvg.framePixmap().toImage();
+    QCOMPARE(image.size(), QSize(50, 40));
+    QCOMPARE(image.pixelColor(0, 0), QColor(255, 0, 0));
+    QCOMPARE(image.pixelColor(25, 5), QColor(0, 255, 0));
+    QCOMPARE(image.pixelColor(5, 20), QColor(0, 255, 0));
+    QCOMPARE(image.pixelColor(25, 20), QColor(0, 0, 255));
+    QCOMPARE(image.pixelColor(49, 39), QColor(255, 0, 0));
+}
+
+void FrameSvgTest::overlappingPieces()
+{
+    // Pieces overlapping each other are rendered one by one, slices of them would have bits of the others
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("overlapping.svg"));
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(R"(<svg xmlns="http://www.w3.org/2000/svg" width="30" height="30">
+  <rect id="topleft" x="0" y="0" width="12" height="10" fill="#ff0000"/>
+  <rect id="top" x="10" y="0" width="10" height="10" fill="#00ff00"/>
+  <rect id="topright" x="20" y="0" width="10" height="10" fill="#ff0000"/>
+  <rect id="left" x="0" y="10" width="10" height="10" fill="#00ff00"/>
+  <rect id="center" x="10" y="10" width="10" height="10" fill="#0000ff"/>
+  <rect id="right" x="20" y="10" width="10" height="10" fill="#00ff00"/>
+  <rect id="bottomleft" x="0" y="20" width="10" height="10" fill="#ff0000"/>
+  <rect id="bottom" x="10" y="20" width="10" height="10" fill="#00ff00"/>
+  <rect id="bottomright" x="20" y="20" width="10" height="10" fill="#ff0000"/>
+</svg>
+)");
+    file.close();
+
+    KSvg::FrameSvg frameSvg;
+    frameSvg.setImagePath(path);
+    frameSvg.resizeFrame(QSize(50, 40));
+    const QImage image = frameSvg.frameImage();
+    QCOMPARE(image.pixelColor(11, 5), QColor(255, 0, 0));
+    QCOMPARE(image.pixelColor(25, 5), QColor(0, 255, 0));
+}
+
+void FrameSvgTest::bigFrameInBands()
+{
+    // Big frames are painted in bands on several threads, which must join up seamlessly
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("grid.svg"));
+    writeGridSvg(path);
+
+    KSvg::FrameSvg frameSvg;
+    frameSvg.setImagePath(path);
+    frameSvg.resizeFrame(QSize(1000, 800));
+    const QImage image = frameSvg.framePixmap().toImage();
+    QCOMPARE(image.size(), QSize(1000, 800));
+    for (int y = 10; y < 790; ++y) {
+        QCOMPARE(image.pixelColor(0, y), QColor(0, 255, 0));
+        QCOMPARE(image.pixelColor(500, y), QColor(0, 0, 255));
+        QCOMPARE(image.pixelColor(999, y), QColor(0, 255, 0));
+    }
+    QCOMPARE(image.pixelColor(0, 799), QColor(255, 0, 0));
+    QCOMPARE(image.pixelColor(500, 799), QColor(0, 255, 0));
+}
+
+// A frame with round corners and sides opaque only on their inner half
+static void writeRoundedSvg(const QString &path)
+{
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(R"(<svg xmlns="http://www.w3.org/2000/svg" width="30" height="30">
+  <g id="topleft"><rect x="0" y="0" width="10" height="10" fill="none"/><circle cx="10" cy="10" r="10" fill="#000000"/></g>
+  <g id="top"><rect x="10" y="0" width="10" height="10" fill="none"/><rect x="10" y="5" width="10" height="5" fill="#000000"/></g>
+  <g id="topright"><rect x="20" y="0" width="10" height="10" fill="none"/><circle cx="20" cy="10" r="10" fill="#000000"/></g>
+  <g id="left"><rect x="0" y="10" width="10" height="10" fill="none"/><rect x="5" y="10" width="5" height="10" fill="#000000"/></g>
+  <rect id="center" x="10" y="10" width="10" height="10" fill="#000000"/>
+  <g id="right"><rect x="20" y="10" width="10" height="10" fill="none"/><rect x="20" y="10" width="5" height="10" fill="#000000"/></g>
+  <g id="bottomleft"><rect x="0" y="20" width="10" height="10" fill="none"/><circle cx="10" cy="20" r="10" fill="#000000"/></g>
+  <g id="bottom"><rect x="10" y="20" width="10" height="10" fill="none"/><rect x="10" y="20" width="10" height="5" fill="#000000"/></g>
+  <g id="bottomright"><rect x="20" y="20" width="10" height="10" fill="none"/><circle cx="20" cy="20" r="10" fill="#000000"/></g>
+</svg>
+)");
+}
+
+void FrameSvgTest::maskFromPieces()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("rounded.svg"));
+    writeRoundedSvg(path);
+
+    KSvg::FrameSvg frameSvg;
+    frameSvg.setImagePath(path);
+    for (const QSize &size : {QSize(50, 40), QSize(200, 30), QSize(31, 97)}) {
+        frameSvg.resizeFrame(size);
+        // The same region as the one of the pixels of the whole frame
+        const QRegion mask = frameSvg.mask();
+        QCOMPARE(mask, QRegion(QBitmap(frameSvg.alphaMask().mask())));
+        QVERIFY(!mask.contains(QPoint(0, 0)));
+        QVERIFY(!mask.contains(QPoint(size.width() / 2, 2)));
+        QVERIFY(mask.contains(QPoint(size.width() / 2, 7)));
+        QVERIFY(mask.contains(QPoint(size.width() / 2, size.height() / 2)));
+    }
+
+    frameSvg.setEnabledBorders(KSvg::FrameSvg::TopBorder | KSvg::FrameSvg::LeftBorder);
+    frameSvg.resizeFrame(QSize(60, 60));
+    QCOMPARE(frameSvg.mask(), QRegion(QBitmap(frameSvg.alphaMask().mask())));
+}
+
+void FrameSvgTest::fractionalScaleMask()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("rounded.svg"));
+    writeRoundedSvg(path);
+
+    for (const qreal ratio : {1.25, 1.5}) {
+        KSvg::FrameSvg frameSvg;
+        frameSvg.setImagePath(path);
+        frameSvg.setDevicePixelRatio(ratio);
+        frameSvg.resizeFrame(QSize(50, 40));
+        // No gaps between the pieces, and nothing outside of them
+        const QRegion mask = frameSvg.mask();
+        QVERIFY(!mask.contains(QPoint(0, 0)));
+        QVERIFY(!mask.contains(QPoint(2, 20)));
+        QVERIFY(!mask.contains(QPoint(47, 20)));
+        for (int x = 7; x < 43; ++x) {
+            QVERIFY(mask.contains(QPoint(x, 20)));
+        }
+        for (int y = 7; y < 33; ++y) {
+            QVERIFY(mask.contains(QPoint(25, y)));
+        }
+    }
+}
+
+void FrameSvgTest::persistentMask()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("rounded.svg"));
+    writeRoundedSvg(path);
+
+    KSvg::FrameSvg frameSvg;
+    frameSvg.setImagePath(path);
+    QVERIFY(frameSvg.isUsingRenderingCache());
+    frameSvg.resizeFrame(QSize(70, 45));
+    const QRegion mask = frameSvg.mask();
+    QVERIFY(mask.rectCount() > 1);
+
+    // Read back from the rects stored in the shared cache
+    frameSvg.clearCache();
+    QCOMPARE(frameSvg.mask(), mask);
+}
+
+void FrameSvgTest::framesOnThreads()
+{
+    // FrameSvgs on several threads registering the same frames at once
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("grid.svg"));
+    writeGridSvg(path);
+
+    std::atomic<int> failures = 0;
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back(QThread::create([&]() {
+            // With the rendering cache left on, although the image set it belongs to lives on the
+            // GUI thread. No pixmaps, those are for the GUI thread only
+            KSvg::FrameSvg frameSvg;
+            frameSvg.setImagePath(path);
+            KSvg::FrameSvg other;
+            other.setImagePath(path);
+            for (int size = 30; size < 90; ++size) {
+                frameSvg.resizeFrame(QSize(size, size));
+                other.resizeFrame(QSize(size, size));
+                const QImage image = frameSvg.frameImage();
+                if (image.size() != QSize(size, size) || image.pixelColor(size / 2, size / 2) != QColor(0, 0, 255)
+                    || other.frameImage().cacheKey() != image.cacheKey()) {
+                    ++failures;
+                }
+            }
+        }));
+        threads.back()->start();
+    }
+    for (const auto &thread : threads) {
+        QVERIFY(thread->wait());
+    }
+    QCOMPARE(failures, 0);
+}
+
+void FrameSvgTest::frameImage()
+{
+    // The frame is composed as an image, which is handed out as it is
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("grid.svg"));
+    writeGridSvg(path);
+
+    KSvg::FrameSvg frameSvg;
+    frameSvg.setImagePath(path);
+    frameSvg.resizeFrame(QSize(50, 40));
+    const QImage image = frameSvg.frameImage();
+    QCOMPARE(image.format(), QImage::Format_ARGB32_Premultiplied);
+    QCOMPARE(image.size(), QSize(50, 40));
+    QCOMPARE(frameSvg.frameImage().cacheKey(), image.cacheKey());
+    QCOMPARE(frameSvg.framePixmap().toImage(), image);
+}
+
+void FrameSvgTest::stretchedPieces()
+{
+    // Stretched pieces are rendered at the size they take, rather than scaled up and blurred
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("stretched.svg"));
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(R"(<svg xmlns="http://www.w3.org/2000/svg" width="30" height="30">
+  <rect id="topleft" x="0" y="0" width="10" height="10" fill="#ff0000"/>
+  <g id="top">
+    <rect x="10" y="0" width="5" height="10" fill="#ff0000"/>
+    <rect x="15" y="0" width="5" height="10" fill="#0000ff"/>
+  </g>
+  <rect id="topright" x="20" y="0" width="10" height="10" fill="#ff0000"/>
+  <rect id="left" x="0" y="10" width="10" height="10" fill="#00ff00"/>
+  <g id="center">
+    <rect x="10" y="10" width="5" height="10" fill="#ff0000"/>
+    <rect x="15" y="10" width="5" height="10" fill="#0000ff"/>
+  </g>
+  <rect id="right" x="20" y="10" width="10" height="10" fill="#00ff00"/>
+  <rect id="bottomleft" x="0" y="20" width="10" height="10" fill="#ff0000"/>
+  <rect id="bottom" x="10" y="20" width="10" height="10" fill="#00ff00"/>
+  <rect id="bottomright" x="20" y="20" width="10" height="10" fill="#ff0000"/>
+  <rect id="hint-stretch-borders" x="0" y="0" width="1" height="1" fill="none"/>
+</svg>
+)");
+    file.close();
+
+    KSvg::FrameSvg frameSvg;
+    frameSvg.setImagePath(path);
+    frameSvg.resizeFrame(QSize(200, 100));
+    const QImage image = frameSvg.frameImage();
+    QCOMPARE(image.size(), QSize(200, 100));
+    // Both halves end right in the middle, 18 times as wide as the pieces
+    QCOMPARE(image.pixelColor(97, 50), QColor(255, 0, 0));
+    QCOMPARE(image.pixelColor(102, 50), QColor(0, 0, 255));
+    QCOMPARE(image.pixelColor(97, 5), QColor(255, 0, 0));
+    QCOMPARE(image.pixelColor(102, 5), QColor(0, 0, 255));
+}
+
 QTEST_MAIN(FrameSvgTest)
 
 #include "moc_framesvgtest.cpp"
@@ -25,6 +25,17 @@ private Q_SLOTS:
     void repaintBlocked();
     void resizeMask();
     void loadQrc();
+    void sharedDescriptor();
+    void resizeComposesPieces();
+    void piecesInOnePass();
+    void overlappingPieces();
+    void bigFrameInBands();
+    void maskFromPieces();
+    void fractionalScaleMask();
+    void persistentMask();
+    void framesOnThreads();
+    void frameImage();
+    void stretchedPieces();
 
 private:
     KSvg::FrameSvg *m_frameSvg;
@@ -4,13 +4,19 @@
  *  SPDX-License-Identifier: LGPL-2.0-or-later
  */
 
-#include "imageset.h"
-
 #include <QDirIterator>
 #include <QSignalSpy>
 #include <QStandardPaths>
+#include <QTemporaryDir>
 #include <QTest>
 
+// Cursed way to access the caches
+#define private public
+#include "../src/ksvg/private/imageset_p.h"
+#include "../src/ksvg/private/svg_p.h"
+#include "imageset.h"
+#include "svg.h"
+
 using namespace Qt::Literals;
 
 class ImageSetTest : public QObject
@@ -26,6 +32,7 @@ private Q_SLOTS:
     void testSelectors();
     void testHasImage();
     void testFilePath();
+    void testPreload();
 
 private:
     QDir m_themeDir;
@@ -110,6 +117,31 @@ void ImageSetTest::testFilePath()
     QVERIFY(set.filePath(u"does_not_exist"_s).isEmpty());
 }
 
+void ImageSetTest::testPreload()
+{
+    // A copy no earlier run left in the persistent cache
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("background.svgz"));
+    QVERIFY(QFile::copy(QFINDTESTDATA("data/background.svgz"), path));
+
+    KSvg::ImageSet set("testtheme", "plasma/desktoptheme");
+    KSvg::Svg svg;
+    svg.setImageSet(&set);
+    svg.setImagePath(path);
+    svg.setContainsMultipleImages(true);
+
+    // Looked up in the cache directly, asking the Svg for it would render it
+    const QString key = svg.d->cachePath(u"center"_s, QSize(24, 24));
+    QImage image;
+    QVERIFY(!set.d->findInCache(key, image, svg.d->lastModified));
+
+    set.preload(QVariantList{QVariantMap{{u"imagePath"_s, path}, {u"elementId"_s, u"center"_s}, {u"size"_s, QSizeF(24, 24)}}});
+    QTRY_VERIFY(set.d->findInCache(key, image, svg.d->lastModified));
+    QCOMPARE(image.size(), QSize(24, 24));
+    QCOMPARE(svg.image(QSize(24, 24), u"center"_s), image);
+}
+
 QTEST_MAIN(ImageSetTest)
 
 #include "imagesettest.moc"
@@ -8,12 +8,26 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlComponent>
+#include <QQuickItem>
+#include <QQuickItemGrabResult>
+#include <QQuickWindow>
+#include <QScopeGuard>
+#include <QSemaphore>
+#include <QSignalSpy>
 #include <QStandardPaths>
+#include <QTemporaryDir>
 #include <QTest>
+#include <QThreadPool>
 
+// Cursed way to access the caches
+#define private public
+#include "../src/ksvg/private/imageset_p.h"
+#include "../src/ksvg/private/svg_p.h"
 #include <KSvg/ImageSet>
 #include <KSvg/Svg>
 
+using namespace Qt::Literals;
+
 class ItemTest : public QObject
 {
     Q_OBJECT
@@ -24,9 +38,14 @@ public Q_SLOTS:
 
 private Q_SLOTS:
     void testItem();
+    void testAsynchronous();
+    void testAsynchronousCanceled();
 
 private:
+    std::unique_ptr<QQuickItem> createAsynchronousItem(QQmlEngine &engine, QQuickWindow &window);
+
     QDir m_themeDir;
+    QTemporaryDir m_imageDir;
 };
 
 void copyDirectory(const QString &srcDir, const QString &dstDir)
@@ -45,9 +64,35 @@ void copyDirectory(const QString &srcDir, const QString &dstDir)
     }
 }
 
+// Whether what the item renders asynchronously at that size is there
+static bool findInCache(KSvg::Svg *svg, const QString &elementId, const QSize &size, QImage &image)
+{
+    QString actualElementId;
+    QSize pixelSize;
+    if (!svg->d->resolveElement(elementId, svg->d->devicePixelRatio, size, actualElementId, pixelSize)) {
+        return false;
+    }
+    return svg->d->actualImageSet()->d->findInCache(svg->d->cachePath(actualElementId, pixelSize), image, svg->d->lastModified);
+}
+
+static QImage grabItem(QQuickItem *item)
+{
+    const QSharedPointer<QQuickItemGrabResult> result = item->grabToImage();
+    if (!result) {
+        return QImage();
+    }
+    QSignalSpy ready(result.data(), &QQuickItemGrabResult::ready);
+    if (!ready.wait()) {
+        return QImage();
+    }
+    return result->image().convertToFormat(QImage::Format_ARGB32_Premultiplied);
+}
+
 void ItemTest::initTestCase()
 {
     QStandardPaths::setTestModeEnabled(true);
+    // So that grabbing the items works without a GPU
+    QQuickWindow::setGraphicsApi(QSGRendererInterface::Software);
 
     m_themeDir = QDir(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) % '/' % "plasma");
     m_themeDir.removeRecursively();
@@ -56,6 +101,8 @@ void ItemTest::initTestCase()
 
     m_themeDir.mkpath("desktoptheme/testtheme/widgets");
     QVERIFY(QFile::copy(QFINDTESTDATA("data/background.svgz"), m_themeDir.absolutePath() + "/desktoptheme/testtheme/widgets/background.svgz"));
+
+    QVERIFY(m_imageDir.isValid());
 }
 
 void ItemTest::cleanupTestCase()
@@ -84,9 +131,121 @@ void ItemTest::testItem()
     QCOMPARE(item->property("naturalSize"), QSizeF(148, 148));
     QCOMPARE(item->property("elementRect"), QRectF(0, 0, 148, 148));
 
+    QCOMPARE(item->property("asynchronous"), false);
+    QVERIFY(item->setProperty("asynchronous", true));
+    QCOMPARE(item->property("asynchronous"), true);
+
     delete item;
 }
 
+std::unique_ptr<QQuickItem> ItemTest::createAsynchronousItem(QQmlEngine &engine, QQuickWindow &window)
+{
+    // A copy no earlier run left in the persistent cache
+    static int copies = 0;
+    const QString path = m_imageDir.filePath(QStringLiteral("background%1.svgz").arg(++copies));
+    if (!QFile::copy(QFINDTESTDATA("data/background.svgz"), path)) {
+        return nullptr;
+    }
+
+    QQmlComponent comp(&engine, QFINDTESTDATA("itemtest.qml"));
+    std::unique_ptr<QQuickItem> item(qobject_cast<QQuickItem *>(comp.createWithInitialProperties({{"asynchronous", true}, {"imagePath", path}})));
+    if (item) {
+        item->setParentItem(window.contentItem());
+    }
+    return item;
+}
+
+void ItemTest::testAsynchronous()
+{
+    QQmlEngine engine;
+    QQuickWindow window;
+    window.resize(100, 100);
+    auto item = createAsynchronousItem(engine, window);
+    QVERIFY(item);
+    auto svg = item->property("svg").value<KSvg::Svg *>();
+    QVERIFY(svg);
+
+    window.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&window));
+
+    // Rendered on a pool thread, not by asking the Svg
+    QImage image;
+    QTRY_VERIFY(findInCache(svg, QString(), QSize(100, 100), image));
+    QTRY_COMPARE(grabItem(item.get()), svg->image(QSize(100, 100)).convertToFormat(QImage::Format_ARGB32_Premultiplied));
+
+    // Until the image of the new size is there the previous one is stretched
+    window.resize(150, 120);
+    QTRY_COMPARE(item->size(), QSizeF(150, 120));
+    QTRY_VERIFY(findInCache(svg, QString(), QSize(150, 120), image));
+    QCOMPARE(image.size(), QSize(150, 120));
+    QTRY_COMPARE(grabItem(item.get()), svg->image(QSize(150, 120)).convertToFormat(QImage::Format_ARGB32_Premultiplied));
+}
+
+void ItemTest::testAsynchronousCanceled()
+{
+    // Nothing gets rendered until the only pool thread is released
+    QThreadPool *pool = QThreadPool::globalInstance();
+    const int maxThreadCount = pool->maxThreadCount();
+    pool->setMaxThreadCount(1);
+    QSemaphore started;
+    QSemaphore released;
+    pool->start([&started, &released]() {
+        started.release();
+        released.acquire();
+    });
+    started.acquire();
+    bool blocked = true;
+    auto unblock = qScopeGuard([&]() {
+        if (blocked) {
+            released.release();
+        }
+        pool->waitForDone();
+        pool->setMaxThreadCount(maxThreadCount);
+    });
+
+    QQmlEngine engine;
+    QQuickWindow window;
+    window.resize(100, 100);
+    auto item = createAsynchronousItem(engine, window);
+    QVERIFY(item);
+    auto svg = item->property("svg").value<KSvg::Svg *>();
+    QVERIFY(svg);
+
+    window.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&window));
+
+    // The same image is one shared future, whoever asks for it
+    QFuture<QImage> first = svg->imageAsync(QSize(100, 100), QString());
+    QVERIFY(!first.isFinished());
+
+    // The item doesn't want that size anymore
+    window.resize(120, 120);
+    QTRY_VERIFY(first.isCanceled());
+
+    // Nor that element
+    QFuture<QImage> second = svg->imageAsync(QSize(120, 120), QString());
+    QVERIFY(!second.isFinished());
+    QVERIFY(!second.isCanceled());
+    QVERIFY(item->setProperty("elementId", u"center"_s));
+    QTRY_VERIFY(second.isCanceled());
+
+    // Somebody else giving up on the image the item waits for doesn't leave it without one
+    QFuture<QImage> third = svg->imageAsync(QSize(120, 120), u"center"_s);
+    QVERIFY(!third.isFinished());
+    third.cancel();
+
+    released.release();
+    blocked = false;
+    QImage image;
+    QTRY_VERIFY(findInCache(svg, u"center"_s, QSize(120, 120), image));
+    QCOMPARE(image.size(), QSize(120, 120));
+    QTRY_COMPARE(grabItem(item.get()), svg->image(QSize(120, 120), u"center"_s).convertToFormat(QImage::Format_ARGB32_Premultiplied));
+
+    // None of the canceled ones got to render
+    QVERIFY(!findInCache(svg, QString(), QSize(100, 100), image));
+    QVERIFY(!findInCache(svg, QString(), QSize(120, 120), image));
+}
+
 #include "itemtest.moc"
 
 QTEST_MAIN(ItemTest);
@@ -5,12 +5,21 @@
  */
 
 #include <QDirIterator>
+#include <QPainter>
+#include <QSet>
 #include <QSignalSpy>
+#include <QSvgRenderer>
+#include <QTemporaryDir>
 #include <QTest>
+#include <QThread>
 
 #include <KColorScheme>
 #include <KConfigGroup>
 
+#include "../src/ksvg/private/svgelementsstore_p.h"
+#include "../src/ksvg/private/svgimagecodec_p.h"
+#include "../src/ksvg/private/svgpixelstore_p.h"
+
 // Cursed way to access SvgPrivate
 #define private public
 #include "../src/ksvg/private/svg_p.h"
@@ -30,9 +39,25 @@ public Q_SLOTS:
 private Q_SLOTS:
     void testSize();
     void testElements();
+    void testElementsStore();
+    void testElementsStoreShared();
+    void testElementRects();
+    void testGeometryMatchesRenderer();
     void testColors();
     void testStylesheetOverrideColorChange();
+    void testStylesheetSplice_data();
+    void testStylesheetSplice();
+    void testMonochromeTint();
+    void testSubDocuments();
+    void testThreadRenderers();
+    void testRendererOutlivesSvg();
+    void testImageAsync();
     void theSameImageIsHandedBackForTheSameRequest();
+    void testImagesFromStore();
+    void testPixelStoreEviction();
+    void testImageCodec_data();
+    void testImageCodec();
+    void benchmarkImageDecode();
 
 private:
     KSvg::Svg *m_svg;
@@ -129,6 +154,174 @@ void SvgTest::theSameImageIsHandedBackForTheSameRequest()
     QVERIFY(other.image(size, QString()).cacheKey() != once.cacheKey());
 }
 
+void SvgTest::testImagesFromStore()
+{
+    // Once saved, images come out of the mapped theme cache, which hands back the same image on
+    // its pixels for every lookup rather than a copy, already at the device pixel ratio
+    const QSize size(31, 31);
+    KSvg::Svg svg;
+    svg.setImagePath(QFINDTESTDATA("data/background.svgz"));
+    svg.setDevicePixelRatio(2);
+    QVERIFY(svg.isValid());
+
+    const QImage rendered = svg.image(size, QString());
+    QVERIFY(!rendered.isNull());
+    QTRY_VERIFY(svg.image(size, QString()).cacheKey() != rendered.cacheKey());
+
+    const QImage stored = svg.image(size, QString());
+    QCOMPARE(svg.image(size, QString()).cacheKey(), stored.cacheKey());
+    QCOMPARE(svg.image(size, QString()).constBits(), stored.constBits());
+    QCOMPARE(stored.devicePixelRatio(), 2.0);
+    QCOMPARE(stored.format(), QImage::Format_ARGB32_Premultiplied);
+    QCOMPARE(stored, rendered);
+
+    // Painting on it copies it rather than writing to the cache
+    QImage painted = stored;
+    painted.fill(Qt::red);
+    QCOMPARE(svg.image(size, QString()), rendered);
+
+    // Nor are they copied for ratios a float wouldn't hold exactly
+    svg.setDevicePixelRatio(1.1);
+    const QImage fractional = svg.image(size, QString());
+    QTRY_VERIFY(svg.image(size, QString()).cacheKey() != fractional.cacheKey());
+    const QImage storedFractional = svg.image(size, QString());
+    QCOMPARE(svg.image(size, QString()).constBits(), storedFractional.constBits());
+    QCOMPARE(storedFractional.devicePixelRatio(), 1.1);
+}
+
+void SvgTest::testPixelStoreEviction()
+{
+    // A full store makes room by dropping the least recently used images only
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    KSvg::SvgPixelStore store(dir.filePath(QStringLiteral("pixels.bin")), 1024 * 1024);
+    QVERIFY(store.isValid());
+    // Whole files are allocated up front
+    QVERIFY(QFileInfo(dir.filePath(QStringLiteral("pixels.bin"))).size() > 1024 * 1024);
+
+    // Noise, which stays uncompressed, 16 KiB each
+    auto image = [](int i) {
+        QImage image(64, 64, QImage::Format_ARGB32_Premultiplied);
+        for (int y = 0; y < image.height(); ++y) {
+            quint32 *line = reinterpret_cast<quint32 *>(image.scanLine(y));
+            for (int x = 0; x < image.width(); ++x) {
+                line[x] = 0xff000000 | quint32(x * 31 + y * 17 + i * 101);
+            }
+        }
+        return image;
+    };
+
+    for (int i = 0; i < 60; ++i) {
+        QVERIFY(store.insertImage(QString::number(i), image(i)));
+    }
+    const QImage first = store.findImage(QStringLiteral("0"));
+    QCOMPARE(first, image(0));
+
+    // Past 64 of them there is no room left
+    for (int i = 60; i < 70; ++i) {
+        QVERIFY(store.insertImage(QString::number(i), image(i)));
+    }
+    QCOMPARE(store.findImage(QStringLiteral("0")), image(0));
+    QCOMPARE(store.findImage(QStringLiteral("63")), image(63));
+    QCOMPARE(store.findImage(QStringLiteral("69")), image(69));
+    QVERIFY(store.findImage(QStringLiteral("2")).isNull());
+    QVERIFY(store.findImage(QStringLiteral("1")).isNull());
+    // What was handed out before still points to the pixels it had, in the old file
+    QVERIFY(store.findImage(QStringLiteral("0")).constBits() != first.constBits());
+    QCOMPARE(first, image(0));
+
+    // Inserted again, the new image replaces the old one
+    QVERIFY(store.insertImage(QStringLiteral("69"), image(0)));
+    QCOMPARE(store.findImage(QStringLiteral("69")), image(0));
+
+    store.clear();
+    QVERIFY(store.findImage(QStringLiteral("0")).isNull());
+}
+
+void SvgTest::testImageCodec_data()
+{
+    QTest::addColumn<QImage>("image");
+    QTest::addColumn<bool>("compresses");
+
+    QImage transparent(257, 129, QImage::Format_ARGB32_Premultiplied);
+    transparent.fill(Qt::transparent);
+    QTest::newRow("transparent") << transparent << true;
+
+    KSvg::Svg svg;
+    svg.setImagePath(QFINDTESTDATA("data/background.svgz"));
+    svg.setUsingRenderingCache(false);
+    QTest::newRow("background") << svg.image(QSize(300, 200), QString()) << true;
+
+    // Nothing to gain, but it must still come back the same when asked for enough room
+    QImage noise(61, 47, QImage::Format_ARGB32_Premultiplied);
+    quint32 seed = 1;
+    for (int y = 0; y < noise.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(noise.scanLine(y));
+        for (int x = 0; x < noise.width(); ++x) {
+            seed = seed * 1664525 + 1013904223;
+            const int alpha = seed >> 24;
+            line[x] = qRgba((seed >> 16 & 0xff) * alpha / 255, (seed >> 8 & 0xff) * alpha / 255, (seed & 0xff) * alpha / 255, alpha);
+        }
+    }
+    QTest::newRow("noise") << noise << false;
+
+    // Runs of transparent pixels once the noise has about used up the room, which must not be written past
+    QImage noiseThenTransparent(512, 512, QImage::Format_ARGB32_Premultiplied);
+    noiseThenTransparent.fill(Qt::transparent);
+    for (int y = 0; y < noiseThenTransparent.height() / 2; ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(noiseThenTransparent.scanLine(y));
+        for (int x = 0; x < noiseThenTransparent.width(); ++x) {
+            seed = seed * 1664525 + 1013904223;
+            const int alpha = seed >> 24;
+            line[x] = qRgba((seed >> 16 & 0xff) * alpha / 255, (seed >> 8 & 0xff) * alpha / 255, (seed & 0xff) * alpha / 255, alpha);
+        }
+    }
+    QTest::newRow("noise then transparent") << noiseThenTransparent << true;
+}
+
+void SvgTest::testImageCodec()
+{
+    QFETCH(QImage, image);
+    QFETCH(bool, compresses);
+    QCOMPARE(image.format(), QImage::Format_ARGB32_Premultiplied);
+
+    const qsizetype rawSize = image.sizeInBytes();
+    QCOMPARE(!KSvg::SvgImageCodec::encode(image, rawSize * 3 / 4).isEmpty(), compresses);
+
+    const QByteArray encoded = KSvg::SvgImageCodec::encode(image, rawSize * 2);
+    QVERIFY(!encoded.isEmpty());
+    const auto data = reinterpret_cast<const uchar *>(encoded.constData());
+    QCOMPARE(KSvg::SvgImageCodec::decode(data, encoded.size(), image.size()), image);
+
+    // Any less room than that is turned down, without writing past it
+    QCOMPARE(KSvg::SvgImageCodec::encode(image, encoded.size()), encoded);
+    for (qsizetype maxSize = std::max<qsizetype>(encoded.size() - 64, 0); maxSize < encoded.size(); ++maxSize) {
+        QVERIFY(KSvg::SvgImageCodec::encode(image, maxSize).isEmpty());
+    }
+
+    // Too little data for that many pixels
+    QVERIFY(KSvg::SvgImageCodec::decode(data, encoded.size(), QSize(image.width(), image.height() + 1)).isNull());
+    QVERIFY(KSvg::SvgImageCodec::decode(data, encoded.size() / 2, image.size()).isNull());
+}
+
+void SvgTest::benchmarkImageDecode()
+{
+    // A big frame background, the kind of image which gets compressed in the cache
+    KSvg::Svg svg;
+    svg.setImagePath(QFINDTESTDATA("data/background.svgz"));
+    svg.setUsingRenderingCache(false);
+    const QImage image = svg.image(QSize(512, 512), QString()).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    const QByteArray encoded = KSvg::SvgImageCodec::encode(image, image.sizeInBytes());
+    QVERIFY(!encoded.isEmpty());
+
+    QImage decoded;
+    QBENCHMARK {
+        decoded = KSvg::SvgImageCodec::decode(reinterpret_cast<const uchar *>(encoded.constData()), encoded.size(), image.size());
+    }
+    QCOMPARE(decoded, image);
+}
+
 void SvgTest::testElements()
 {
     QVERIFY(m_svg->hasElement("center"));
@@ -162,6 +355,149 @@ void SvgTest::testElements()
     QCOMPARE(m_svg->elementRect("left").toRect(), QRect(8, 71, 35, 26));
 }
 
+void SvgTest::testElementsStore()
+{
+    // Element rects end up in a binary file every process maps, rather than in a config file each one parses
+    const QString storePath = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) % "/ksvg-elements.bin";
+    QFile store(storePath);
+    QVERIFY(store.open(QIODevice::ReadOnly));
+    quint32 magic = 0;
+    QCOMPARE(store.read(reinterpret_cast<char *>(&magic), sizeof(magic)), qint64(sizeof(magic)));
+    QCOMPARE(magic, 0x4b535645u);
+    QVERIFY(!QFile::exists(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) % "/ksvg-elements"));
+
+    // A second Svg on the same file finds what the first one stored, missing elements included
+    KSvg::Svg other;
+    other.setImagePath(QFINDTESTDATA("data/background.svgz"));
+    QVERIFY(other.isValid());
+    QCOMPARE(other.elementRect("left").toRect(), QRect(8, 71, 35, 26));
+    QVERIFY(!other.hasElement("banana"));
+}
+
+void SvgTest::testElementsStoreShared()
+{
+    // What one store writes, be it a new rect or one written over, is seen by another one on the
+    // same file, as it would be by another process
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("elements.bin"));
+    KSvg::SvgElementsStore writer(path);
+    KSvg::SvgElementsStore reader(path);
+    QVERIFY(writer.isValid());
+    QVERIFY(reader.isValid());
+
+    QRectF rect;
+    QVERIFY(!reader.findRect(1, rect));
+    writer.insertRect(1, 42, QRectF(1, 2, 3, 4));
+    QVERIFY(reader.findRect(1, rect));
+    QCOMPARE(rect, QRectF(1, 2, 3, 4));
+
+    writer.insertRect(1, 42, QRectF(5, 6, 7, 8));
+    QVERIFY(reader.findRect(1, rect));
+    QCOMPARE(rect, QRectF(5, 6, 7, 8));
+    QCOMPARE(reader.rectKeysForFile(42), QList<quint64>{1});
+
+    // Rebuilt by one of them as it filled up, the other one follows
+    for (quint64 id = 2; id < 10000; ++id) {
+        writer.insertRect(id, 42, QRectF(0, 0, id, 1));
+    }
+    QVERIFY(reader.findRect(9999, rect));
+    QCOMPARE(rect, QRectF(0, 0, 9999, 1));
+    QVERIFY(reader.findRect(1, rect));
+    QCOMPARE(rect, QRectF(5, 6, 7, 8));
+
+    // Inserted by both at once, every id still takes a single slot
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (KSvg::SvgElementsStore *store : {&writer, &reader, &writer, &reader}) {
+        threads.emplace_back(QThread::create([store]() {
+            for (quint64 id = 100000; id < 100500; ++id) {
+                store->insertRect(id, 43, QRectF(0, 0, 1, 1));
+                store->insertSizeHint(id, 43, QSizeF(1, 1));
+            }
+        }));
+        threads.back()->start();
+    }
+    for (const auto &thread : threads) {
+        thread->wait();
+    }
+    const QList<quint64> keys = reader.rectKeysForFile(43);
+    QCOMPARE(keys.size(), 500);
+    QCOMPARE(QSet<quint64>(keys.begin(), keys.end()).size(), 500);
+    QCOMPARE(reader.sizeHints(100000), QList<QSizeF>{QSizeF(1, 1)});
+}
+
+void SvgTest::testElementRects()
+{
+    const QStringList ids = {u"center"_s, u"top"_s, u"left"_s, u"doesnotexist"_s, u"bottomright"_s};
+    const QList<QRectF> rects = m_svg->elementRects(ids);
+    QCOMPARE(rects.size(), ids.size());
+    for (qsizetype i = 0; i < ids.size(); ++i) {
+        QCOMPARE(rects[i], m_svg->elementRect(ids[i]));
+    }
+    QVERIFY(rects[0].isValid());
+    QVERIFY(rects[3].isNull());
+
+    QCOMPARE(m_svg->elementRects(u"bottom"_s, {u"right"_s, u"left"_s}), QList<QRectF>({m_svg->elementRect(u"bottomright"_s), m_svg->elementRect(u"bottomleft"_s)}));
+
+    KSvg::Svg empty;
+    QCOMPARE(empty.elementRects(ids), QList<QRectF>(ids.size()));
+}
+
+void SvgTest::testGeometryMatchesRenderer()
+{
+    // Most elements are looked up without a renderer, which has to give the very same answers
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("geometry.svg"));
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(R"(<svg xmlns="http://www.w3.org/2000/svg" width="100" height="80" viewBox="0 0 100 80">
+  <rect id="plain" x="10" y="5" width="20" height="10"/>
+  <g id="group" transform="translate(5,5) scale(0.5)">
+    <rect id="rotated" width="10" height="10" transform="rotate(30 5 5)"/>
+    <circle id="dot" cx="30" cy="30" r="4"/>
+    <path id="curve" d="M10,40 C20,30 30,50 40,40 s10,10 20,0 q5-5 10,0 t10,0 h5 v-5 z"/>
+  </g>
+  <g id="stroked" stroke="#000"><rect id="outlined" x="50" y="50" width="10" height="10"/></g>
+  <polygon id="poly" points="60,10 90,10 75,30"/>
+  <line id="diagonal" x1="80" y1="40" x2="95" y2="70"/>
+  <text id="label" x="0" y="70">x</text>
+</svg>)");
+    file.close();
+
+    KSvg::Svg svg;
+    svg.setImagePath(path);
+    QVERIFY(svg.isValid());
+    QCOMPARE(svg.size(), QSizeF(100, 80));
+
+    QSvgRenderer renderer(path);
+    QVERIFY(renderer.isValid());
+    const QStringList ids{u"plain"_s, u"group"_s, u"rotated"_s, u"dot"_s, u"curve"_s, u"stroked"_s, u"outlined"_s, u"poly"_s, u"diagonal"_s, u"label"_s};
+    for (const QString &id : ids) {
+        const QRectF expected = renderer.transformForElement(id).map(renderer.boundsOnElement(id)).boundingRect();
+        QCOMPARE(svg.elementRect(id), expected);
+        QCOMPARE(svg.hasElement(id), expected.isValid());
+    }
+    QVERIFY(!svg.hasElement(u"missing"_s));
+
+    // Strokes set on the root element widen everything too
+    const QString strokedPath = dir.filePath(QStringLiteral("strokedroot.svg"));
+    QFile strokedFile(strokedPath);
+    QVERIFY(strokedFile.open(QIODevice::WriteOnly));
+    strokedFile.write(R"(<svg xmlns="http://www.w3.org/2000/svg" width="100" height="80" style="stroke:#000;stroke-width:4">
+  <rect id="inherited" x="10" y="5" width="20" height="10"/>
+  <rect id="unstroked" x="40" y="5" width="20" height="10" stroke="none"/>
+</svg>)");
+    strokedFile.close();
+
+    KSvg::Svg stroked;
+    stroked.setImagePath(strokedPath);
+    QSvgRenderer strokedRenderer(strokedPath);
+    for (const QString &id : {u"inherited"_s, u"unstroked"_s}) {
+        QCOMPARE(stroked.elementRect(id), strokedRenderer.transformForElement(id).map(strokedRenderer.boundsOnElement(id)).boundingRect());
+    }
+}
+
 void SvgTest::testColors()
 {
     KColorScheme windowColors(QPalette::Normal, KColorScheme::Window);
@@ -226,6 +562,230 @@ void SvgTest::testStylesheetOverrideColorChange()
     QVERIFY(m_svg->d->stylesheetOverride.contains(QStringLiteral(".ColorScheme-Background{color:#ff0000;}")));
 }
 
+void SvgTest::testStylesheetSplice_data()
+{
+    QTest::addColumn<QByteArray>("styleBlock");
+
+    QTest::newRow("stale contents") << QByteArray(R"(<style id="current-color-scheme" type="text/css">.ColorScheme-Text { color:#ff0000; }</style>)");
+    QTest::newRow("self closing") << QByteArray(R"(<style type="text/css" id="current-color-scheme"/>)");
+    QTest::newRow("character data") << QByteArray(R"(<style id='current-color-scheme'><![CDATA[.ColorScheme-Text { color:#ff0000; }]]></style>)");
+}
+
+void SvgTest::testStylesheetSplice()
+{
+    // The color scheme style block is replaced in the raw bytes, that must survive whatever the document looks like
+    QFETCH(QByteArray, styleBlock);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("splice.svg"));
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(R"(<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="10" height="10">
+  <!-- <style id="current-color-scheme">.ColorScheme-Text { color:#0000ff; }</style> -->
+  )" + styleBlock + R"(
+  <rect id="box" class="ColorScheme-Text" style="fill:currentColor" width="10" height="10"/>
+</svg>)");
+    file.close();
+
+    KSvg::Svg svg;
+    svg.setImagePath(path);
+    svg.setColor(KSvg::Svg::Text, QColor(0, 255, 0));
+    const QImage image = svg.image(QSize(10, 10), u"box"_s);
+    QVERIFY(!image.isNull());
+    QCOMPARE(image.pixelColor(5, 5), QColor(0, 255, 0));
+}
+
+void SvgTest::testMonochromeTint()
+{
+    // Elements in a single ColorScheme-* color are tinted from one coverage, that must not show
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("monochrome.svg"));
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(R"(<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="16" height="16">
+  <style id="current-color-scheme" type="text/css">.ColorScheme-Text { color:#232629; }</style>
+  <circle id="dot" class="ColorScheme-Text" style="fill:currentColor" cx="8" cy="8" r="6.5"/>
+</svg>)");
+    file.close();
+
+    KSvg::Svg svg;
+    svg.setImagePath(path);
+    svg.setUsingRenderingCache(false);
+    svg.setColor(KSvg::Svg::Text, QColor(0, 255, 0));
+    const QImage green = svg.image(QSize(16, 16), u"dot"_s).convertToFormat(QImage::Format_ARGB32);
+    svg.setColor(KSvg::Svg::Text, QColor(255, 0, 255));
+    const QImage magenta = svg.image(QSize(16, 16), u"dot"_s).convertToFormat(QImage::Format_ARGB32);
+    QCOMPARE(green.pixelColor(8, 8), QColor(0, 255, 0));
+    QCOMPARE(magenta.pixelColor(8, 8), QColor(255, 0, 255));
+    QCOMPARE(green.pixelColor(0, 0).alpha(), 0);
+
+    // Same shape, antialiasing included
+    const QImage coverage = svg.coverageImage(QSize(16, 16), u"dot"_s);
+    QVERIFY(!coverage.isNull());
+    for (int y = 0; y < green.height(); ++y) {
+        for (int x = 0; x < green.width(); ++x) {
+            QCOMPARE(green.pixelColor(x, y).alpha(), magenta.pixelColor(x, y).alpha());
+            QCOMPARE(coverage.pixelColor(x, y).alpha(), magenta.pixelColor(x, y).alpha());
+        }
+    }
+
+    // One coverage whatever the colors
+    QCOMPARE(svg.monochromeColor(QSize(16, 16), u"dot"_s), QColor(255, 0, 255));
+    svg.setColor(KSvg::Svg::Text, QColor(0, 0, 255));
+    QCOMPARE(svg.monochromeColor(QSize(16, 16), u"dot"_s), QColor(0, 0, 255));
+    QCOMPARE(svg.coverageImage(QSize(16, 16), u"dot"_s).cacheKey(), coverage.cacheKey());
+
+    // Nor do elements setting their color themselves, whatever their class
+    const QString inlinePath = dir.filePath(QStringLiteral("inline.svg"));
+    QFile inlineFile(inlinePath);
+    QVERIFY(inlineFile.open(QIODevice::WriteOnly));
+    inlineFile.write(R"(<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="16" height="16">
+  <style id="current-color-scheme" type="text/css">.ColorScheme-Text { color:#232629; }</style>
+  <circle id="dot" class="ColorScheme-Text" style="fill:currentColor;color:#ff0000" cx="8" cy="8" r="6.5"/>
+</svg>)");
+    inlineFile.close();
+    KSvg::Svg inlineColor;
+    inlineColor.setImagePath(inlinePath);
+    QVERIFY(inlineColor.coverageImage(QSize(16, 16), u"dot"_s).isNull());
+    QVERIFY(!inlineColor.monochromeColor(QSize(16, 16), u"dot"_s).isValid());
+
+    // Elements in several colors have none
+    KSvg::Svg background;
+    background.setImagePath(QFINDTESTDATA("data/background.svgz"));
+    QVERIFY(background.coverageImage(QSize(48, 48)).isNull());
+    QVERIFY(!background.monochromeColor(QSize(48, 48)).isValid());
+}
+
+void SvgTest::testSubDocuments()
+{
+    // Elements of large files are drawn from a document with only them, which must look the same
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("large.svg"));
+    QByteArray contents = R"(<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" xmlns:xlink="http://www.w3.org/1999/xlink" width="100" height="100">
+  <defs>
+    <linearGradient id="stops"><stop offset="0" stop-color="#ff0000"/><stop offset="1" stop-color="#0000ff"/></linearGradient>
+    <linearGradient id="gradient" xlink:href="#stops" x1="0" y1="0" x2="1" y2="0"/>
+    <clipPath id="clip"><circle cx="70" cy="15" r="10"/></clipPath>
+  </defs>
+  <g transform="translate(10,20)">
+    <g id="unrelated">)";
+    for (int i = 0; i < 2000; ++i) {
+        contents += "<rect x=\"" + QByteArray::number(i % 90) + "\" y=\"0\" width=\"1\" height=\"1\" fill=\"#00ff00\"/>\n";
+    }
+    contents += R"(</g>
+    <rect id="box" x="5" y="5" width="40" height="20" style="fill:url(#gradient)"/>
+    <g clip-path="url(#clip)" fill="url(#gradient)">
+      <rect id="clipped" x="50" y="5" width="40" height="20"/>
+    </g>
+  </g>
+</svg>)";
+    QVERIFY(contents.size() > 64 * 1024);
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(contents);
+    file.close();
+
+    QSvgRenderer whole(path);
+    KSvg::Svg svg;
+    svg.setImagePath(path);
+    svg.setUsingRenderingCache(false);
+    svg.setContainsMultipleImages(true);
+    // The clipped one has its clip path and fill on a group around it
+    for (const QString &id : {u"box"_s, u"clipped"_s}) {
+        QImage expected(QSize(40, 20), QImage::Format_ARGB32_Premultiplied);
+        expected.fill(Qt::transparent);
+        QPainter painter(&expected);
+        whole.render(&painter, id, QRectF(0, 0, 40, 20));
+        painter.end();
+
+        QCOMPARE(svg.image(QSize(40, 20), id).convertToFormat(QImage::Format_ARGB32_Premultiplied), expected);
+    }
+}
+
+void SvgTest::testThreadRenderers()
+{
+    // Svgs living on a worker thread share renderers with each other, but never with the GUI thread
+    const QString path = QFINDTESTDATA("data/background.svgz");
+    KSvg::Svg gui;
+    gui.setImagePath(path);
+    gui.setUsingRenderingCache(false);
+    QVERIFY(!gui.image(QSize(32, 32), QString()).isNull());
+    const KSvg::SharedSvgRenderer *guiRenderer = gui.d->renderer.data();
+    QVERIFY(guiRenderer);
+
+    bool rendered = false;
+    bool shared = false;
+    bool separate = false;
+    std::unique_ptr<QThread> thread(QThread::create([&]() {
+        KSvg::Svg one;
+        one.setImagePath(path);
+        one.setUsingRenderingCache(false);
+        KSvg::Svg other;
+        other.setImagePath(path);
+        other.setUsingRenderingCache(false);
+        rendered = !one.image(QSize(32, 32), QString()).isNull() && !other.image(QSize(32, 32), QString()).isNull();
+        shared = one.d->renderer && one.d->renderer == other.d->renderer;
+        separate = one.d->renderer.data() != guiRenderer;
+    }));
+    thread->start();
+    QVERIFY(thread->wait());
+    QVERIFY(rendered);
+    QVERIFY(shared);
+    QVERIFY(separate);
+}
+
+void SvgTest::testRendererOutlivesSvg()
+{
+    // Renderers nobody holds anymore are kept around as long as they fit in the budget
+    const QString path = QFINDTESTDATA("data/plasma/desktoptheme/testtheme/element.svg");
+    QPointer<KSvg::SharedSvgRenderer> renderer;
+    {
+        KSvg::Svg svg;
+        svg.setImagePath(path);
+        svg.setUsingRenderingCache(false);
+        QVERIFY(!svg.image(QSize(32, 32), QString()).isNull());
+        renderer = svg.d->renderer.data();
+        QVERIFY(renderer);
+    }
+    QVERIFY(renderer);
+
+    KSvg::Svg svg;
+    svg.setImagePath(path);
+    svg.setUsingRenderingCache(false);
+    QVERIFY(!svg.image(QSize(32, 32), QString()).isNull());
+    QCOMPARE(svg.d->renderer.data(), renderer.data());
+}
+
+void SvgTest::testImageAsync()
+{
+    KSvg::Svg svg;
+    svg.setImagePath(QFINDTESTDATA("data/background.svgz"));
+    svg.setUsingRenderingCache(false);
+
+    QFuture<QImage> future = svg.imageAsync(QSize(48, 48));
+    QFuture<QImage> element = svg.imageAsync(QSize(48, 48), u"center"_s);
+    future.waitForFinished();
+    element.waitForFinished();
+    QVERIFY(!future.result().isNull());
+    QVERIFY(!element.result().isNull());
+    QCOMPARE(future.result().convertToFormat(QImage::Format_ARGB32_Premultiplied),
+             svg.image(QSize(48, 48)).convertToFormat(QImage::Format_ARGB32_Premultiplied));
+    QCOMPARE(element.result().convertToFormat(QImage::Format_ARGB32_Premultiplied),
+             svg.image(QSize(48, 48), u"center"_s).convertToFormat(QImage::Format_ARGB32_Premultiplied));
+
+    // Nothing to draw
+    QFuture<QImage> missing = svg.imageAsync(QSize(48, 48), u"doesnotexist"_s);
+    QVERIFY(missing.isFinished());
+    QVERIFY(missing.result().isNull());
+}
+
 QTEST_MAIN(SvgTest)
 
 #include "svgtest.moc"
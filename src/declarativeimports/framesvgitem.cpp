@@ -32,25 +32,14 @@ namespace KSvg
 class FrameNode : public QSGNode
 {
 public:
-    FrameNode(const QString &prefix, FrameSvg *svg)
+    FrameNode(FrameSvg *svg)
         : QSGNode()
-        , leftWidth(0)
-        , rightWidth(0)
-        , topHeight(0)
-        , bottomHeight(0)
     {
-        if (svg->enabledBorders() & FrameSvg::LeftBorder) {
-            leftWidth = svg->elementSize(prefix % QLatin1String("left")).width();
-        }
-        if (svg->enabledBorders() & FrameSvg::RightBorder) {
-            rightWidth = svg->elementSize(prefix % QLatin1String("right")).width();
-        }
-        if (svg->enabledBorders() & FrameSvg::TopBorder) {
-            topHeight = svg->elementSize(prefix % QLatin1String("top")).height();
-        }
-        if (svg->enabledBorders() & FrameSvg::BottomBorder) {
-            bottomHeight = svg->elementSize(prefix % QLatin1String("bottom")).height();
-        }
+        const QMarginsF borders = svg->borderSizes();
+        leftWidth = qRound(borders.left());
+        rightWidth = qRound(borders.right());
+        topHeight = qRound(borders.top());
+        bottomHeight = qRound(borders.bottom());
     }
 
     QRect contentsRect(const QSize &size) const
@@ -548,12 +537,7 @@ void FrameSvgItem::doUpdate()
         setImplicitHeight(m_frameSvg->marginSize(KSvg::FrameSvg::TopMargin) + m_frameSvg->marginSize(KSvg::FrameSvg::BottomMargin));
     }
 
-    QString prefix = m_frameSvg->actualPrefix();
-    bool hasOverlay = (!prefix.startsWith(QLatin1String("mask-")) //
-                       && m_frameSvg->hasElement(prefix % QLatin1String("overlay")));
-    bool hasComposeOverBorder = m_frameSvg->hasElement(prefix % QLatin1String("hint-compose-over-border"))
-        && m_frameSvg->hasElement(QLatin1String("mask-") % prefix % QLatin1String("center"));
-    m_fastPath = !hasOverlay && !hasComposeOverBorder;
+    m_fastPath = !(m_frameSvg->frameHints() & (FrameSvg::Overlay | FrameSvg::ComposeOverBorder));
 
     // Software rendering (at time of writing Qt5.10) doesn't seem to like our
     // tiling/stretching in the 9-tiles.
@@ -593,15 +577,11 @@ QSGNode *FrameSvgItem::updatePaintNode(QSGNode *oldNode, QQuickItem::UpdatePaint
         }
 
         if (!oldNode) {
-            QString prefix = m_frameSvg->actualPrefix();
-            oldNode = new FrameNode(prefix, m_frameSvg);
+            oldNode = new FrameNode(m_frameSvg);
 
-            bool tileCenter = (m_frameSvg->hasElement(QStringLiteral("hint-tile-center")) //
-                               || m_frameSvg->hasElement(prefix % QLatin1String("hint-tile-center")));
-            bool stretchBorders = (m_frameSvg->hasElement(QStringLiteral("hint-stretch-borders")) //
-                                   || m_frameSvg->hasElement(prefix % QLatin1String("hint-stretch-borders")));
-            FrameItemNode::FitMode borderFitMode = stretchBorders ? FrameItemNode::Stretch : FrameItemNode::Tile;
-            FrameItemNode::FitMode centerFitMode = tileCenter ? FrameItemNode::Tile : FrameItemNode::Stretch;
+            const FrameSvg::FrameHints hints = m_frameSvg->frameHints();
+            FrameItemNode::FitMode borderFitMode = hints & FrameSvg::StretchBorders ? FrameItemNode::Stretch : FrameItemNode::Tile;
+            FrameItemNode::FitMode centerFitMode = hints & FrameSvg::TileCenter ? FrameItemNode::Tile : FrameItemNode::Stretch;
 
             new FrameItemNode(this, FrameSvg::NoBorder, centerFitMode, oldNode);
             if (enabledBorders() & (FrameSvg::TopBorder | FrameSvg::LeftBorder)) {
@@ -662,7 +642,7 @@ QSGNode *FrameSvgItem::updatePaintNode(QSGNode *oldNode, QQuickItem::UpdatePaint
         textureNode->setFiltering(filtering);
 
         if ((m_textureChanged || m_sizeChanged) || textureNode->texture()->textureSize() != m_frameSvg->size()) {
-            QImage image = m_frameSvg->framePixmap().toImage();
+            QImage image = m_frameSvg->frameImage();
             textureNode->setTexture(ImageTexturesCache::instance()->loadTexture(window(), image));
             textureNode->setRect(0, 0, width(), height());
 
@@ -51,6 +51,7 @@ QSharedPointer<QSGTexture> ImageTexturesCache::loadTexture(QQuickWindow *window,
             }
             delete texture;
         };
+        // Images out of the theme cache point into its mapped file and are uploaded from there as they are
         texture = QSharedPointer<QSGTexture>(window->createTextureFromImage(image, options), cleanAndDelete);
         (d->cache)[id][window] = texture.toWeakRef();
     }
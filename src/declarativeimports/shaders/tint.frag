@@ -0,0 +1,22 @@
+// SPDX-FileCopyrightText: 2026 KSvg contributors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#version 440
+
+layout(location = 0) in vec2 texCoord;
+
+layout(location = 0) out vec4 fragColor;
+
+layout(std140, binding = 0) uniform buf {
+    mat4 qt_Matrix;
+    float qt_Opacity;
+    // Premultiplied
+    vec4 color;
+};
+
+layout(binding = 1) uniform sampler2D coverage;
+
+void main()
+{
+    fragColor = color * (texture(coverage, texCoord).a * qt_Opacity);
+}
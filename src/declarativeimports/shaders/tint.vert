@@ -0,0 +1,23 @@
+// SPDX-FileCopyrightText: 2026 KSvg contributors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#version 440
+
+layout(location = 0) in vec4 qt_VertexPosition;
+layout(location = 1) in vec2 qt_VertexTexCoord;
+
+layout(location = 0) out vec2 texCoord;
+
+layout(std140, binding = 0) uniform buf {
+    mat4 qt_Matrix;
+    float qt_Opacity;
+    vec4 color;
+};
+
+out gl_PerVertex { vec4 gl_Position; };
+
+void main()
+{
+    texCoord = qt_VertexTexCoord;
+    gl_Position = qt_Matrix * qt_VertexPosition;
+}
@@ -16,6 +16,7 @@
 
 #include "imagetexturescache.h"
 #include "managedtexturenode.h"
+#include "tintedtexturenode.h"
 
 #include <KColorScheme>
 #include <KColorUtils>
@@ -190,6 +191,23 @@ QRectF SvgItem::elementRect() const
     return QRectF(QPointF(0, 0), m_svg->size());
 }
 
+void SvgItem::setAsynchronous(bool asynchronous)
+{
+    if (asynchronous == m_asynchronous) {
+        return;
+    }
+
+    m_asynchronous = asynchronous;
+    Q_EMIT asynchronousChanged();
+
+    scheduleImageUpdate();
+}
+
+bool SvgItem::isAsynchronous() const
+{
+    return m_asynchronous;
+}
+
 QSGNode *SvgItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *updatePaintNodeData)
 {
     Q_UNUSED(updatePaintNodeData);
@@ -204,8 +222,33 @@ QSGNode *SvgItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *updateP
         return nullptr;
     }
 
-    ManagedTextureNode *textureNode = static_cast<ManagedTextureNode *>(oldNode);
+    if (m_tint.isValid()) {
+        // m_image is only the coverage, the node paints it in m_tint
+        TintedTextureNode *tintedNode = dynamic_cast<TintedTextureNode *>(oldNode);
+        if (!tintedNode) {
+            delete oldNode;
+            tintedNode = new TintedTextureNode;
+            m_textureChanged = true;
+        }
+
+        if (m_textureChanged) {
+            if (m_image.isNull()) {
+                delete tintedNode;
+                return nullptr;
+            }
+            tintedNode->setTexture(ImageTexturesCache::instance()->loadTexture(window(), m_image, QQuickWindow::TextureCanUseAtlas));
+            m_textureChanged = false;
+        }
+
+        tintedNode->setRect(QRectF(0, 0, width(), height()));
+        tintedNode->setColor(m_tint);
+        tintedNode->setFiltering(smooth() ? QSGTexture::Linear : QSGTexture::Nearest);
+        return tintedNode;
+    }
+
+    ManagedTextureNode *textureNode = dynamic_cast<ManagedTextureNode *>(oldNode);
     if (!textureNode) {
+        delete oldNode;
         textureNode = new ManagedTextureNode;
         m_textureChanged = true;
     }
@@ -258,12 +301,73 @@ void SvgItem::updatePolish()
 {
     QQuickItem::updatePolish();
 
-    if (m_svg) {
-        // setContainsMultipleImages has to be done there since m_svg can be shared with somebody else
+    if (!m_svg) {
+        return;
+    }
+
+    // setContainsMultipleImages has to be done there since m_svg can be shared with somebody else
+    m_svg->setContainsMultipleImages(!m_elementID.isEmpty());
+    const QSize size(width(), height());
+
+    // Whatever is still rendering is for a size or element we don't want anymore
+    const quint64 serial = ++m_imageSerial;
+    if (!m_pendingImage.isFinished() && (m_pendingSize != size || m_pendingElementID != m_elementID)) {
+        m_pendingImage.cancel();
+    }
+    m_pendingImage = QFuture<QImage>();
+
+    if (!m_asynchronous) {
+        // A monochrome element only ever changes color, which the node does on its own, so
+        // a color set, status or palette change neither renders nor uploads anything
+        const QColor tint = m_svg->monochromeColor(size, m_elementID);
+        if (tint.isValid()) {
+            const QImage coverage = m_svg->coverageImage(size, m_elementID);
+            if (!coverage.isNull()) {
+                m_textureChanged |= coverage.cacheKey() != m_image.cacheKey() || !m_tint.isValid();
+                m_image = coverage;
+                m_tint = tint;
+                return;
+            }
+        }
+
+        m_textureChanged = true;
+        m_tint = QColor();
+        m_image = m_svg->image(size, m_elementID);
+        return;
+    }
+
+    QFuture<QImage> future = m_svg->imageAsync(size, m_elementID);
+    if (future.isFinished() && future.resultCount() > 0) {
+        // It was in the cache
         m_textureChanged = true;
-        m_svg->setContainsMultipleImages(!m_elementID.isEmpty());
-        m_image = m_svg->image(QSize(width(), height()), m_elementID);
+        m_tint = QColor();
+        m_image = future.result();
+        return;
     }
+
+    m_pendingImage = future;
+    m_pendingSize = size;
+    m_pendingElementID = m_elementID;
+    // Until then updatePaintNode() keeps stretching the previous image
+    future
+        .then(this,
+              [this, serial](const QImage &image) {
+                  if (serial != m_imageSerial) {
+                      return;
+                  }
+                  m_pendingImage = QFuture<QImage>();
+                  m_textureChanged = true;
+                  m_tint = QColor();
+                  m_image = image;
+                  update();
+              })
+        .onCanceled(this, [this, serial]() {
+            // Somebody else drawing the same image gave up on it
+            if (serial == m_imageSerial) {
+                m_pendingImage = QFuture<QImage>();
+                polish();
+            }
+        });
 }
 
 void SvgItem::geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry)
@@ -7,6 +7,8 @@
 #ifndef SVGITEM_P
 #define SVGITEM_P
 
+#include <QColor>
+#include <QFuture>
 #include <QImage>
 #include <QQuickItem>
 
@@ -85,6 +87,19 @@ class SvgItem : public QQuickItem
      */
     Q_PROPERTY(KSvg::Svg *svg READ svg WRITE setSvg NOTIFY svgChanged)
 
+    /*!
+     * \brief This property specifies whether the SVG is rendered on a worker
+     * thread.
+     *
+     * When it is, the item keeps showing its previous image, scaled to its
+     * new size, until the new one is ready, rather than blocking the GUI
+     * thread on rendering it. The default is false.
+     *
+     * \qmlproperty bool SvgItem::asynchronous
+     * \since 6.30
+     */
+    Q_PROPERTY(bool asynchronous READ isAsynchronous WRITE setAsynchronous NOTIFY asynchronousChanged)
+
 public:
     explicit SvgItem(QQuickItem *parent = nullptr);
     ~SvgItem() override;
@@ -102,6 +117,9 @@ public:
 
     QRectF elementRect() const;
 
+    void setAsynchronous(bool asynchronous);
+    bool isAsynchronous() const;
+
     QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *updatePaintNodeData) override;
 
     void itemChange(QQuickItem::ItemChange change, const QQuickItem::ItemChangeData &data) override;
@@ -115,6 +133,7 @@ Q_SIGNALS:
     void svgChanged();
     void naturalSizeChanged();
     void elementRectChanged();
+    void asynchronousChanged();
 
 protected Q_SLOTS:
     void updateNeeded();
@@ -129,7 +148,15 @@ private:
     Kirigami::Platform::PlatformTheme *m_kirigamiTheme;
     QString m_elementID;
     QImage m_image;
+    // When valid, m_image is the coverage of a monochrome element to be drawn in that color
+    QColor m_tint;
+    // The rendering in progress when asynchronous
+    QFuture<QImage> m_pendingImage;
+    QSize m_pendingSize;
+    QString m_pendingElementID;
+    quint64 m_imageSerial = 0;
     bool m_textureChanged;
+    bool m_asynchronous = false;
 };
 }
 
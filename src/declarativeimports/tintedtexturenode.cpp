@@ -0,0 +1,157 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "tintedtexturenode.h"
+
+#include <QSGMaterialShader>
+
+#include <cstring>
+
+class TintShader : public QSGMaterialShader
+{
+public:
+    TintShader()
+    {
+        setShaderFileName(VertexStage, QStringLiteral(":/qt/qml/org/kde/ksvg/shaders/tint.vert.qsb"));
+        setShaderFileName(FragmentStage, QStringLiteral(":/qt/qml/org/kde/ksvg/shaders/tint.frag.qsb"));
+    }
+
+    bool updateUniformData(RenderState &state, QSGMaterial *newMaterial, QSGMaterial *oldMaterial) override
+    {
+        // std140: the matrix, the opacity, and the color on the next 16 bytes boundary
+        QByteArray *buffer = state.uniformData();
+        Q_ASSERT(buffer->size() >= 96);
+        bool changed = false;
+
+        if (state.isMatrixDirty()) {
+            const QMatrix4x4 matrix = state.combinedMatrix();
+            std::memcpy(buffer->data(), matrix.constData(), 64);
+            changed = true;
+        }
+        if (state.isOpacityDirty()) {
+            const float opacity = state.opacity();
+            std::memcpy(buffer->data() + 64, &opacity, 4);
+            changed = true;
+        }
+
+        const auto *material = static_cast<TintMaterial *>(newMaterial);
+        const auto *old = static_cast<TintMaterial *>(oldMaterial);
+        if (!old || old->color != material->color) {
+            const QColor &color = material->color;
+            const float alpha = color.alphaF();
+            const float premultiplied[4] = {color.redF() * alpha, color.greenF() * alpha, color.blueF() * alpha, alpha};
+            std::memcpy(buffer->data() + 80, premultiplied, 16);
+            changed = true;
+        }
+
+        return changed;
+    }
+
+    void updateSampledImage(RenderState &state, int binding, QSGTexture **texture, QSGMaterial *newMaterial, QSGMaterial *oldMaterial) override
+    {
+        Q_UNUSED(oldMaterial);
+        if (binding != 1) {
+            return;
+        }
+
+        const auto *material = static_cast<TintMaterial *>(newMaterial);
+        QSGTexture *coverage = material->texture;
+        // Items sharing the texture may not agree on it
+        coverage->setFiltering(material->filtering);
+        coverage->commitTextureOperations(state.rhi(), state.resourceUpdateBatch());
+        *texture = coverage;
+    }
+};
+
+TintMaterial::TintMaterial()
+{
+    setFlag(Blending);
+}
+
+QSGMaterialType *TintMaterial::type() const
+{
+    static QSGMaterialType type;
+    return &type;
+}
+
+QSGMaterialShader *TintMaterial::createShader(QSGRendererInterface::RenderMode renderMode) const
+{
+    Q_UNUSED(renderMode);
+    return new TintShader;
+}
+
+int TintMaterial::compare(const QSGMaterial *other) const
+{
+    // Same texture, which is likely with atlases, and same color batch together
+    const auto *material = static_cast<const TintMaterial *>(other);
+    if (const qint64 difference = texture->comparisonKey() - material->texture->comparisonKey()) {
+        return difference < 0 ? -1 : 1;
+    }
+    if (filtering != material->filtering) {
+        return filtering < material->filtering ? -1 : 1;
+    }
+    if (color != material->color) {
+        return color.rgba() < material->color.rgba() ? -1 : 1;
+    }
+    return 0;
+}
+
+TintedTextureNode::TintedTextureNode()
+    : m_geometry(QSGGeometry::defaultAttributes_TexturedPoint2D(), 4)
+{
+    setGeometry(&m_geometry);
+    setMaterial(&m_material);
+}
+
+void TintedTextureNode::setTexture(QSharedPointer<QSGTexture> texture)
+{
+    m_texture = texture;
+    m_material.texture = texture.data();
+    updateGeometry();
+    markDirty(DirtyMaterial);
+}
+
+QSGTexture *TintedTextureNode::texture() const
+{
+    return m_texture.data();
+}
+
+void TintedTextureNode::setColor(const QColor &color)
+{
+    if (color == m_material.color) {
+        return;
+    }
+    m_material.color = color;
+    markDirty(DirtyMaterial);
+}
+
+void TintedTextureNode::setRect(const QRectF &rect)
+{
+    if (rect == m_rect) {
+        return;
+    }
+    m_rect = rect;
+    updateGeometry();
+}
+
+void TintedTextureNode::setFiltering(QSGTexture::Filtering filtering)
+{
+    if (filtering == m_material.filtering) {
+        return;
+    }
+    m_material.filtering = filtering;
+    markDirty(DirtyMaterial);
+}
+
+void TintedTextureNode::updateGeometry()
+{
+    if (!m_texture) {
+        return;
+    }
+    // Atlassed textures only cover part of the atlas
+    QSGGeometry::updateTexturedRectGeometry(&m_geometry, m_rect, m_texture->normalizedTextureSubRect());
+    markDirty(DirtyGeometry);
+}
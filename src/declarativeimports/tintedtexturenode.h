@@ -0,0 +1,59 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef TINTEDTEXTURENODE_H
+#define TINTEDTEXTURENODE_H
+
+#include <QColor>
+#include <QSGGeometryNode>
+#include <QSGMaterial>
+#include <QSGTexture>
+#include <QSharedPointer>
+
+/*
+ * Draws the alpha channel of a texture in a color.
+ *
+ * The texture only holds the coverage of a monochrome element, the color being a uniform
+ * of the material, so recoloring the element on a hover or selection change neither renders
+ * it again nor uploads anything.
+ */
+class TintMaterial : public QSGMaterial
+{
+public:
+    TintMaterial();
+
+    QSGMaterialType *type() const override;
+    QSGMaterialShader *createShader(QSGRendererInterface::RenderMode renderMode) const override;
+    int compare(const QSGMaterial *other) const override;
+
+    QSGTexture *texture = nullptr;
+    QSGTexture::Filtering filtering = QSGTexture::Linear;
+    QColor color;
+};
+
+class TintedTextureNode : public QSGGeometryNode
+{
+    Q_DISABLE_COPY(TintedTextureNode)
+public:
+    TintedTextureNode();
+
+    void setTexture(QSharedPointer<QSGTexture> texture);
+    QSGTexture *texture() const;
+
+    void setColor(const QColor &color);
+    void setRect(const QRectF &rect);
+    void setFiltering(QSGTexture::Filtering filtering);
+
+private:
+    void updateGeometry();
+
+    QSGGeometry m_geometry;
+    TintMaterial m_material;
+    QSharedPointer<QSGTexture> m_texture;
+    QRectF m_rect;
+};
+
+#endif
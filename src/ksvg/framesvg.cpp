@@ -8,6 +8,9 @@
 #include "framesvg.h"
 #include "private/framesvg_p.h"
 
+#include <algorithm>
+#include <latch>
+#include <mutex>
 #include <string>
 
 #include <QAtomicInt>
@@ -17,6 +20,7 @@
 #include <QRegion>
 #include <QSizeF>
 #include <QStringBuilder>
+#include <QThreadPool>
 #include <QTimer>
 
 #include <QDebug>
@@ -29,15 +33,150 @@
 
 namespace KSvg
 {
-QHash<ImageSetPrivate *, QHash<uint, QWeakPointer<FrameData>>> FrameSvgPrivate::s_sharedFrames;
+Q_GLOBAL_STATIC(FrameRegistry, privateFrameRegistrySelf)
 
 // Any attempt to generate a frame whose width or height is larger than this
 // will be rejected
 static const int MAX_FRAME_SIZE = 100000;
+// Below that painting a frame takes less than handing it to other threads
+static const qsizetype s_minParallelFramePixels = 512 * 512;
+static const int s_minFrameBandHeight = 64;
 
 FrameData::~FrameData()
 {
-    FrameSvgPrivate::s_sharedFrames[imageSet].remove(cacheId);
+    if (FrameRegistry *registry = FrameRegistry::instance()) {
+        registry->remove(registryKey());
+    }
+}
+
+size_t qHash(const FrameRegistry::Key &key, size_t seed)
+{
+    return qHashMulti(seed, key.imageSet, key.thread, key.cacheId);
+}
+
+FrameRegistry *FrameRegistry::instance()
+{
+    if (privateFrameRegistrySelf.isDestroyed()) {
+        return nullptr;
+    }
+    return privateFrameRegistrySelf();
+}
+
+FrameRegistry::Shard &FrameRegistry::shard(const Key &key)
+{
+    // The cache id is a hash already
+    return m_shards[(key.cacheId ^ ::qHash(key.imageSet) ^ ::qHash(key.thread)) % s_shardCount];
+}
+
+QSharedPointer<FrameData> FrameRegistry::find(const Key &key)
+{
+    Shard &shard = this->shard(key);
+    std::lock_guard lock(shard.lock);
+    return shard.frames.value(key).toStrongRef();
+}
+
+QSharedPointer<FrameData> FrameRegistry::insert(const Key &key, const QSharedPointer<FrameData> &frame)
+{
+    Shard &shard = this->shard(key);
+    std::lock_guard lock(shard.lock);
+
+    if (++shard.inserts >= s_insertsPerSweep) {
+        shard.inserts = 0;
+        for (auto it = shard.frames.begin(); it != shard.frames.end();) {
+            it = it->isNull() ? shard.frames.erase(it) : std::next(it);
+        }
+    }
+
+    QWeakPointer<FrameData> &entry = shard.frames[key];
+    if (QSharedPointer<FrameData> registered = entry.toStrongRef()) {
+        return registered;
+    }
+    entry = frame;
+    return frame;
+}
+
+void FrameRegistry::remove(const Key &key)
+{
+    Shard &shard = this->shard(key);
+    std::lock_guard lock(shard.lock);
+    const auto it = shard.frames.constFind(key);
+    // Unless another frame was registered under the same key meanwhile
+    if (it != shard.frames.cend() && it->isNull()) {
+        shard.frames.erase(it);
+    }
+}
+
+void FrameRegistry::removeImageSet(ImageSetPrivate *imageSet)
+{
+    for (Shard &shard : m_shards) {
+        std::lock_guard lock(shard.lock);
+        for (auto it = shard.frames.begin(); it != shard.frames.end();) {
+            it = it.key().imageSet == imageSet ? shard.frames.erase(it) : std::next(it);
+        }
+    }
+}
+
+qsizetype FrameRegistry::size()
+{
+    qsizetype size = 0;
+    for (Shard &shard : m_shards) {
+        std::lock_guard lock(shard.lock);
+        size += shard.frames.size();
+    }
+    return size;
+}
+
+// In the order of FrameData::Piece
+static const std::array<QLatin1String, FrameData::PieceCount> s_pieceNames = {
+    QLatin1String("center"),
+    QLatin1String("top"),
+    QLatin1String("bottom"),
+    QLatin1String("left"),
+    QLatin1String("right"),
+    QLatin1String("topleft"),
+    QLatin1String("topright"),
+    QLatin1String("bottomleft"),
+    QLatin1String("bottomright"),
+    QLatin1String("overlay"),
+};
+
+void FrameData::setPrefix(const QString &newPrefix)
+{
+    prefix = newPrefix;
+    for (int i = 0; i < PieceCount; ++i) {
+        pieces[i] = SvgElementKey::intern(prefix % s_pieceNames[i]);
+    }
+}
+
+FrameData::Piece FrameData::pieceOf(FrameSvg::EnabledBorders borders)
+{
+    if (borders == FrameSvg::NoBorder) {
+        return Center;
+    } else if (borders == FrameSvg::TopBorder) {
+        return Top;
+    } else if (borders == FrameSvg::BottomBorder) {
+        return Bottom;
+    } else if (borders == FrameSvg::LeftBorder) {
+        return Left;
+    } else if (borders == FrameSvg::RightBorder) {
+        return Right;
+    } else if (borders == (FrameSvg::TopBorder | FrameSvg::LeftBorder)) {
+        return TopLeft;
+    } else if (borders == (FrameSvg::TopBorder | FrameSvg::RightBorder)) {
+        return TopRight;
+    } else if (borders == (FrameSvg::BottomBorder | FrameSvg::LeftBorder)) {
+        return BottomLeft;
+    } else if (borders == (FrameSvg::BottomBorder | FrameSvg::RightBorder)) {
+        return BottomRight;
+    }
+    qWarning() << "unrecognized border" << borders;
+    return PieceCount;
+}
+
+SvgElementKey FrameData::piece(FrameSvg::EnabledBorders borders) const
+{
+    const Piece piece = pieceOf(borders);
+    return piece == PieceCount ? SvgElementKey() : pieces[piece];
 }
 
 FrameSvg::FrameSvg(QObject *parent)
@@ -344,6 +483,35 @@ QMarginsF FrameSvg::insets() const
     }
 }
 
+FrameSvg::FrameHints FrameSvg::frameHints() const
+{
+    const FrameDescriptor::Ptr descriptor = d->descriptor(d->prefix);
+    FrameHints hints = NoHint;
+    if (descriptor->tileCenter) {
+        hints |= TileCenter;
+    }
+    if (descriptor->stretchBorders) {
+        hints |= StretchBorders;
+    }
+    if (descriptor->hasOverlay) {
+        hints |= Overlay;
+    }
+    if (descriptor->composeOverBorder) {
+        hints |= ComposeOverBorder;
+    }
+    return hints;
+}
+
+QMarginsF FrameSvg::borderSizes() const
+{
+    const FrameDescriptor::Ptr descriptor = d->descriptor(d->prefix);
+    const auto &sizes = descriptor->pieceSizes;
+    return QMarginsF(d->enabledBorders & LeftBorder ? sizes[FrameData::Left].width() : 0,
+                     d->enabledBorders & TopBorder ? sizes[FrameData::Top].height() : 0,
+                     d->enabledBorders & RightBorder ? sizes[FrameData::Right].width() : 0,
+                     d->enabledBorders & BottomBorder ? sizes[FrameData::Bottom].height() : 0);
+}
+
 QRectF FrameSvg::contentsRect() const
 {
     if (d->frame) {
@@ -357,7 +525,8 @@ QRectF FrameSvg::contentsRect() const
 QPixmap FrameSvg::alphaMask() const
 {
     // FIXME: the distinction between overlay and
-    return d->alphaMask();
+    d->alphaMask();
+    return d->alphaMaskFrame()->backgroundPixmap();
 }
 
 QRegion FrameSvg::mask() const
@@ -372,20 +541,39 @@ QRegion FrameSvg::mask() const
     QRegion *obj = d->frame->cachedMasks.object(id);
 
     if (!obj) {
-        QPixmap alphaMask = d->alphaMask();
-        const qreal dpr = alphaMask.devicePixelRatio();
+        // Other processes draw the same frames, the masks they made are in the shared cache.
+        // Otherwise it's composed out of the pieces, the pixels of the whole frame are only
+        // looked at for the themes where that isn't exact. That includes fractional scales,
+        // where the rects of the pieces don't map to whole logical pixels the way the scaled
+        // down mask image does, and would leave gaps or overlaps between them
+        const QString persistentKey = QLatin1String("mask_") % QString::number(qHash(d->cacheId(d->frame.data(), d->frame->prefix)));
+        QRegion cached;
+        QRegion composed;
+        const bool found = isUsingRenderingCache() && imageSet()->d->findInCache(persistentKey, cached, d->frame->lastModified);
+        if (found) {
+            obj = new QRegion(cached);
+        } else if (devicePixelRatio() == 1.0 && d->composeMask(composed)) {
+            obj = new QRegion(composed);
+        } else {
+            QImage alphaMask = d->alphaMask();
+            const qreal dpr = alphaMask.devicePixelRatio();
+
+            // region should always be in logical pixels, resize image to be in the logical sizes
+            if (alphaMask.devicePixelRatio() != 1.0) {
+                alphaMask = alphaMask.scaled(alphaMask.width() / dpr, alphaMask.height() / dpr);
+            }
 
-        // region should always be in logical pixels, resize pixmap to be in the logical sizes
-        if (alphaMask.devicePixelRatio() != 1.0) {
-            alphaMask = alphaMask.scaled(alphaMask.width() / dpr, alphaMask.height() / dpr);
+            // the alpha mask of an image without alpha Channel will be null
+            // but if our mask has no lpha at all, we want instead consider the entire area as the mask
+            if (alphaMask.hasAlphaChannel()) {
+                obj = new QRegion(QBitmap::fromImage(alphaMask.createAlphaMask()));
+            } else {
+                obj = new QRegion(alphaMask.rect());
+            }
         }
 
-        // mask() of a QPixmap without alpha Channel will be null
-        // but if our mask has no lpha at all, we want instead consider the entire area as the mask
-        if (alphaMask.hasAlphaChannel()) {
-            obj = new QRegion(QBitmap(alphaMask.mask()));
-        } else {
-            obj = new QRegion(alphaMask.rect());
+        if (!found && isUsingRenderingCache()) {
+            imageSet()->d->insertIntoCache(persistentKey, *obj);
         }
 
         result = *obj;
@@ -413,11 +601,11 @@ bool FrameSvg::cacheAllRenderedFrames() const
 void FrameSvg::clearCache()
 {
     if (d->frame) {
-        d->frame->cachedBackground = QPixmap();
+        d->frame->setBackground(QImage());
         d->frame->cachedMasks.clear();
     }
     if (d->maskFrame) {
-        d->maskFrame->cachedBackground = QPixmap();
+        d->maskFrame->setBackground(QImage());
         d->maskFrame->cachedMasks.clear();
     }
 }
@@ -428,6 +616,15 @@ QPixmap FrameSvg::framePixmap()
         d->generateBackground(d->frame);
     }
 
+    return d->frame->backgroundPixmap();
+}
+
+QImage FrameSvg::frameImage()
+{
+    if (d->frame->cachedBackground.isNull()) {
+        d->generateBackground(d->frame);
+    }
+
     return d->frame->cachedBackground;
 }
 
@@ -440,7 +637,7 @@ void FrameSvg::paintFrame(QPainter *painter, const QRectF &target, const QRectF
         }
     }
 
-    painter->drawPixmap(target, d->frame->cachedBackground, source.isValid() ? source : target);
+    painter->drawImage(target, d->frame->cachedBackground, source.isValid() ? source : target);
 }
 
 void FrameSvg::paintFrame(QPainter *painter, const QPointF &pos)
@@ -452,7 +649,7 @@ void FrameSvg::paintFrame(QPainter *painter, const QPointF &pos)
         }
     }
 
-    painter->drawPixmap(pos, d->frame->cachedBackground);
+    painter->drawImage(pos, d->frame->cachedBackground);
 }
 
 int FrameSvg::minimumDrawingHeight()
@@ -474,59 +671,45 @@ int FrameSvg::minimumDrawingWidth()
 // #define DEBUG_FRAMESVG_CACHE
 FrameSvgPrivate::~FrameSvgPrivate() = default;
 
-QPixmap FrameSvgPrivate::alphaMask()
+QImage FrameSvgPrivate::alphaMask()
 {
-    QString maskPrefix;
-
-    if (q->hasElement(QLatin1String("mask-") % prefix % QLatin1String("center"))) {
-        maskPrefix = QStringLiteral("mask-");
+    const QSharedPointer<FrameData> maskSource = alphaMaskFrame();
+    if (maskSource->cachedBackground.isNull()) {
+        generateBackground(maskSource);
     }
+    return maskSource->cachedBackground;
+}
 
-    if (maskPrefix.isNull()) {
-        if (frame->cachedBackground.isNull()) {
-            generateBackground(frame);
-        }
-        return frame->cachedBackground;
+QSharedPointer<FrameData> FrameSvgPrivate::alphaMaskFrame()
+{
+    if (!descriptor(prefix)->hasMask) {
+        return frame;
     }
 
     // We are setting the prefix only temporary to generate
     // the needed mask image
-    const QString maskRequestedPrefix = requestedPrefix.isEmpty() ? QStringLiteral("mask") : maskPrefix % requestedPrefix;
-    maskPrefix = maskPrefix % prefix;
+    const QString maskRequestedPrefix = requestedPrefix.isEmpty() ? QStringLiteral("mask") : QLatin1String("mask-") % requestedPrefix;
+    const QString maskPrefix = QLatin1String("mask-") % prefix;
 
-    if (!maskFrame) {
-        maskFrame = lookupOrCreateMaskFrame(frame, maskPrefix, maskRequestedPrefix);
-        if (!maskFrame->cachedBackground.isNull()) {
-            return maskFrame->cachedBackground;
-        }
-        updateSizes(maskFrame);
-        generateBackground(maskFrame);
-        return maskFrame->cachedBackground;
-    }
-
-    const bool shouldUpdate = (maskFrame->enabledBorders != frame->enabledBorders //
+    const bool shouldUpdate = (!maskFrame //
+                               || maskFrame->enabledBorders != frame->enabledBorders //
                                || maskFrame->frameSize != frameSize(frame.data()) //
                                || maskFrame->imagePath != frame->imagePath);
     if (shouldUpdate) {
         maskFrame = lookupOrCreateMaskFrame(frame, maskPrefix, maskRequestedPrefix);
-        if (!maskFrame->cachedBackground.isNull()) {
-            return maskFrame->cachedBackground;
+        if (maskFrame->cachedBackground.isNull()) {
+            updateSizes(maskFrame);
         }
-        updateSizes(maskFrame);
     }
 
-    if (maskFrame->cachedBackground.isNull()) {
-        generateBackground(maskFrame);
-    }
-
-    return maskFrame->cachedBackground;
+    return maskFrame;
 }
 
 QSharedPointer<FrameData>
 FrameSvgPrivate::lookupOrCreateMaskFrame(const QSharedPointer<FrameData> &frame, const QString &maskPrefix, const QString &maskRequestedPrefix)
 {
-    const size_t key = qHash(cacheId(frame.data(), maskPrefix));
-    QSharedPointer<FrameData> mask = s_sharedFrames[q->imageSet()->d].value(key);
+    const uint key = qHash(cacheId(frame.data(), maskPrefix));
+    QSharedPointer<FrameData> mask = FrameRegistry::instance()->find({q->imageSet()->d, q->thread(), key});
 
     // See if we can find a suitable candidate in the shared frames.
     // If there is one, use it.
@@ -535,7 +718,7 @@ FrameSvgPrivate::lookupOrCreateMaskFrame(const QSharedPointer<FrameData> &frame,
     }
 
     mask.reset(new FrameData(*frame.data()));
-    mask->prefix = maskPrefix;
+    mask->setPrefix(maskPrefix);
     mask->requestedPrefix = maskRequestedPrefix;
     mask->imageSet = q->imageSet()->d;
     mask->imagePath = frame->imagePath;
@@ -543,14 +726,19 @@ FrameSvgPrivate::lookupOrCreateMaskFrame(const QSharedPointer<FrameData> &frame,
     mask->frameSize = frameSize(frame).toSize();
     mask->cacheId = key;
     mask->lastModified = frame->lastModified;
-    s_sharedFrames[q->imageSet()->d].insert(key, mask);
+    mask->thread = q->thread();
 
-    return mask;
+    return FrameRegistry::instance()->insert(mask->registryKey(), mask);
 }
 
 void FrameSvgPrivate::generateBackground(const QSharedPointer<FrameData> &frame)
 {
-    if (!frame->cachedBackground.isNull() || !q->hasElementPrefix(frame->prefix)) {
+    if (!frame->cachedBackground.isNull()) {
+        return;
+    }
+
+    const FrameDescriptor::Ptr descriptor = this->descriptor(frame->prefix);
+    if (!descriptor->hasCenter) {
         return;
     }
 
@@ -559,16 +747,20 @@ void FrameSvgPrivate::generateBackground(const QSharedPointer<FrameData> &frame)
     bool frameCached = !frame->cachedBackground.isNull();
     bool overlayCached = false;
 
-    const bool overlayAvailable = !frame->prefix.startsWith(QLatin1String("mask-")) && q->hasElement(frame->prefix % QLatin1String("overlay"));
-    QPixmap overlay;
+    const SvgElementKey overlayKey = frame->pieces[FrameData::Overlay];
+    const QString &overlayElementId = overlayKey.name();
+    const bool overlayAvailable = descriptor->hasOverlay;
+    QImage overlay;
     if (q->isUsingRenderingCache()) {
-        frameCached = q->imageSet()->d->findInCache(QString::number(id), frame->cachedBackground, frame->lastModified) && !frame->cachedBackground.isNull();
+        QImage background;
+        frameCached = q->imageSet()->d->findInCache(QString::number(id), background, frame->lastModified) && !background.isNull();
         if (frameCached) {
-            frame->cachedBackground.setDevicePixelRatio(q->devicePixelRatio());
+            background.setDevicePixelRatio(q->devicePixelRatio());
+            frame->setBackground(background);
         }
 
         if (overlayAvailable) {
-            const size_t overlayId = qHash(cacheId(frame.data(), frame->prefix % QLatin1String("overlay")));
+            const size_t overlayId = qHash(cacheId(frame.data(), overlayElementId));
             overlayCached = q->imageSet()->d->findInCache(QString::number(overlayId), overlay, frame->lastModified) && !overlay.isNull();
             if (overlayCached) {
                 overlay.setDevicePixelRatio(q->devicePixelRatio());
@@ -584,20 +776,20 @@ void FrameSvgPrivate::generateBackground(const QSharedPointer<FrameData> &frame)
     QSizeF overlaySize;
     QPointF actualOverlayPos = QPointF(0, 0);
     if (overlayAvailable && !overlayCached) {
-        overlaySize = q->elementSize(frame->prefix % QLatin1String("overlay")).toSize();
+        overlaySize = q->Svg::d->elementSize(overlayKey).toSize();
 
-        if (q->hasElement(frame->prefix % QLatin1String("hint-overlay-pos-right"))) {
+        if (descriptor->overlayPosRight) {
             actualOverlayPos.setX(frame->frameSize.width() - overlaySize.width());
-        } else if (q->hasElement(frame->prefix % QLatin1String("hint-overlay-pos-bottom"))) {
+        } else if (descriptor->overlayPosBottom) {
             actualOverlayPos.setY(frame->frameSize.height() - overlaySize.height());
             // Stretched or Tiled?
-        } else if (q->hasElement(frame->prefix % QLatin1String("hint-overlay-stretch"))) {
+        } else if (descriptor->overlayStretch) {
             overlaySize = frameSize(frame).toSize();
         } else {
-            if (q->hasElement(frame->prefix % QLatin1String("hint-overlay-tile-horizontal"))) {
+            if (descriptor->overlayTileHorizontal) {
                 overlaySize.setWidth(frameSize(frame).width());
             }
-            if (q->hasElement(frame->prefix % QLatin1String("hint-overlay-tile-vertical"))) {
+            if (descriptor->overlayTileVertical) {
                 overlaySize.setHeight(frameSize(frame).height());
             }
         }
@@ -606,37 +798,40 @@ void FrameSvgPrivate::generateBackground(const QSharedPointer<FrameData> &frame)
         // alphamask will fallback using the background image itself as mask, which
         // can call generateBackground(), leading to an infinite recursion
         // see BUG:510157
-        if (q->hasElement(QLatin1String("mask-") % prefix % QLatin1String("center"))) {
+        if (descriptor->hasMask) {
             overlay = alphaMask();
         } else {
-            overlay = QPixmap(overlaySize.toSize());
+            overlay = QImage(overlaySize.toSize(), QImage::Format_ARGB32_Premultiplied);
             overlay.fill(Qt::white);
         }
         QPainter overlayPainter(&overlay);
         overlayPainter.setCompositionMode(QPainter::CompositionMode_SourceIn);
         // Tiling?
-        if (q->hasElement(frame->prefix % QLatin1String("hint-overlay-tile-horizontal"))
-            || q->hasElement(frame->prefix % QLatin1String("hint-overlay-tile-vertical"))) {
+        if (descriptor->overlayTileHorizontal || descriptor->overlayTileVertical) {
             QSizeF s = q->size().toSize();
-            q->resize(q->elementSize(frame->prefix % QLatin1String("overlay")));
+            q->resize(q->Svg::d->elementSize(overlayKey));
 
-            overlayPainter.drawTiledPixmap(QRectF(QPointF(0, 0), overlaySize), q->pixmap(frame->prefix % QLatin1String("overlay")));
+            overlayPainter.drawTiledPixmap(QRectF(QPointF(0, 0), overlaySize), q->pixmap(overlayElementId));
             q->resize(s);
         } else {
-            q->paint(&overlayPainter, QRectF(actualOverlayPos, overlaySize), frame->prefix % QLatin1String("overlay"));
+            q->paint(&overlayPainter, QRectF(actualOverlayPos, overlaySize), overlayElementId);
         }
 
         overlayPainter.end();
     }
 
     if (!frameCached) {
-        cacheFrame(frame->prefix, frame->cachedBackground, overlayCached ? overlay : QPixmap());
+        cacheFrame(frame->prefix, frame->cachedBackground, overlayCached ? overlay : QImage());
     }
 
     if (!overlay.isNull()) {
-        QPainter p(&frame->cachedBackground);
+        // Taken out of the frame not to be copied when painted on
+        QImage background = std::move(frame->cachedBackground);
+        QPainter p(&background);
         p.setCompositionMode(QPainter::CompositionMode_SourceOver);
-        p.drawPixmap(actualOverlayPos, overlay, QRectF(actualOverlayPos, overlaySize));
+        p.drawImage(actualOverlayPos, overlay, QRectF(actualOverlayPos, overlaySize));
+        p.end();
+        frame->setBackground(background);
     }
 }
 
@@ -656,35 +851,67 @@ void FrameSvgPrivate::generateFrameBackground(const QSharedPointer<FrameData> &f
         return;
     }
 
+    // Composed out of the pieces, which don't depend on the size but for the stretched ones
+    const QRectF contentRect = contentGeometry(frame, size);
+    const FramePieces::Ptr pieces = stretchedPieces(frame, framePieces(frame.data()), contentRect, size);
+    // Made on this thread, as it may generate the mask frame
+    const QImage mask = frame->composeOverBorder ? alphaMask() : QImage();
+
     // Don't cut away pieces of the frame
-    frame->cachedBackground = QPixmap(QSize(std::ceil(size.width()), std::ceil(size.height())));
-    frame->cachedBackground.fill(Qt::transparent);
-    QPainter p(&frame->cachedBackground);
-    p.setCompositionMode(QPainter::CompositionMode_Source);
-    p.setRenderHint(QPainter::SmoothPixmapTransform);
-
-    QRectF contentRect = contentGeometry(frame, size);
-    paintCenter(p, frame, contentRect, size);
-
-    paintCorner(p, frame, FrameSvg::LeftBorder | FrameSvg::TopBorder, contentRect);
-    paintCorner(p, frame, FrameSvg::RightBorder | FrameSvg::TopBorder, contentRect);
-    paintCorner(p, frame, FrameSvg::LeftBorder | FrameSvg::BottomBorder, contentRect);
-    paintCorner(p, frame, FrameSvg::RightBorder | FrameSvg::BottomBorder, contentRect);
-
-    // Sides
-    const qreal leftHeight = q->elementSize(frame->prefix % QLatin1String("left")).height();
-    paintBorder(p, frame, FrameSvg::LeftBorder, QSizeF(frame->leftWidth, leftHeight) * q->devicePixelRatio(), contentRect);
-    const qreal rightHeight = q->elementSize(frame->prefix % QLatin1String("right")).height();
-    paintBorder(p, frame, FrameSvg::RightBorder, QSizeF(frame->rightWidth, rightHeight) * q->devicePixelRatio(), contentRect);
-
-    const qreal topWidth = q->elementSize(frame->prefix % QLatin1String("top")).width();
-    paintBorder(p, frame, FrameSvg::TopBorder, QSizeF(topWidth, frame->topHeight) * q->devicePixelRatio(), contentRect);
-    const qreal bottomWidth = q->elementSize(frame->prefix % QLatin1String("bottom")).width();
-    paintBorder(p, frame, FrameSvg::BottomBorder, QSizeF(bottomWidth, frame->bottomHeight) * q->devicePixelRatio(), contentRect);
-    p.end();
+    // An image rather than a pixmap, as it's painted on several threads
+    QImage background(QSize(std::ceil(size.width()), std::ceil(size.height())), QImage::Format_ARGB32_Premultiplied);
+    background.fill(Qt::transparent);
+    uchar *const bits = background.bits();
+
+    // Paints the rows from top to top + height, which are the same whatever other rows are painted with them
+    auto paintBand = [&](int top, int height) {
+        if (height <= 0) {
+            return;
+        }
+        QImage band(bits + qsizetype(top) * background.bytesPerLine(), background.width(), height, background.bytesPerLine(), background.format());
+        QPainter p(&band);
+        p.translate(0, -top);
+        p.setCompositionMode(QPainter::CompositionMode_Source);
+        p.setRenderHint(QPainter::SmoothPixmapTransform);
+
+        paintCenter(p, frame, *pieces, mask, contentRect, size);
+
+        paintCorner(p, frame, *pieces, FrameSvg::LeftBorder | FrameSvg::TopBorder, contentRect);
+        paintCorner(p, frame, *pieces, FrameSvg::RightBorder | FrameSvg::TopBorder, contentRect);
+        paintCorner(p, frame, *pieces, FrameSvg::LeftBorder | FrameSvg::BottomBorder, contentRect);
+        paintCorner(p, frame, *pieces, FrameSvg::RightBorder | FrameSvg::BottomBorder, contentRect);
+
+        // Sides
+        paintBorder(p, frame, *pieces, FrameSvg::LeftBorder, contentRect);
+        paintBorder(p, frame, *pieces, FrameSvg::RightBorder, contentRect);
+        paintBorder(p, frame, *pieces, FrameSvg::TopBorder, contentRect);
+        paintBorder(p, frame, *pieces, FrameSvg::BottomBorder, contentRect);
+    };
+
+    // Big frames are painted in bands of rows, one per pool thread
+    QThreadPool *pool = QThreadPool::globalInstance();
+    const int bandCount = qsizetype(background.width()) * background.height() < s_minParallelFramePixels
+        ? 1
+        : std::clamp(background.height() / s_minFrameBandHeight, 1, pool->maxThreadCount());
+    const int bandHeight = (background.height() + bandCount - 1) / bandCount;
+    std::latch painted(bandCount - 1);
+    for (int band = 1; band < bandCount; ++band) {
+        const int top = band * bandHeight;
+        auto paint = [&, top]() {
+            paintBand(top, std::min(bandHeight, background.height() - top));
+            painted.count_down();
+        };
+        // Painting it here rather than waiting for a busy pool
+        if (!pool->tryStart(paint)) {
+            paint();
+        }
+    }
+    paintBand(0, std::min(bandHeight, background.height()));
+    painted.wait();
 
     // Set the devicePixelRatio only at the end, drawing all happened in device pixels
-    frame->cachedBackground.setDevicePixelRatio(q->devicePixelRatio());
+    background.setDevicePixelRatio(q->devicePixelRatio());
+    frame->setBackground(background);
 }
 
 QRectF FrameSvgPrivate::contentGeometry(const QSharedPointer<FrameData> &frame, const QSizeF &size) const
@@ -692,12 +919,12 @@ QRectF FrameSvgPrivate::contentGeometry(const QSharedPointer<FrameData> &frame,
     const QSizeF contentSize(size.width() - frame->leftWidth * q->devicePixelRatio() - frame->rightWidth * q->devicePixelRatio(),
                              size.height() - frame->topHeight * q->devicePixelRatio() - frame->bottomHeight * q->devicePixelRatio());
     QRectF contentRect(QPointF(0, 0), contentSize);
-    if (frame->enabledBorders & FrameSvg::LeftBorder && q->hasElement(frame->prefix % QLatin1String("left"))) {
+    if (frame->enabledBorders & FrameSvg::LeftBorder && q->Svg::d->hasElement(frame->pieces[FrameData::Left])) {
         contentRect.translate(frame->leftWidth * q->devicePixelRatio(), 0);
     }
 
     // Corners
-    if (frame->enabledBorders & FrameSvg::TopBorder && q->hasElement(frame->prefix % QLatin1String("top"))) {
+    if (frame->enabledBorders & FrameSvg::TopBorder && q->Svg::d->hasElement(frame->pieces[FrameData::Top])) {
         contentRect.translate(0, frame->topHeight * q->devicePixelRatio());
     }
     return contentRect;
@@ -738,11 +965,11 @@ void FrameSvgPrivate::updateFrameData(uint lastModified, UpdateType updateType)
         }
 
         // qCDebug(LOG_KSVG) << "looking for" << newKey;
-        auto newFd = FrameSvgPrivate::s_sharedFrames[q->imageSet()->d].value(newKey);
+        auto newFd = FrameRegistry::instance()->find({q->imageSet()->d, q->thread(), newKey});
         if (newFd) {
             // qCDebug(LOG_KSVG) << "FOUND IT!" << newFd->refcount;
             // we've found a match, use that one
-            Q_ASSERT(newKey == newFd.lock()->cacheId);
+            Q_ASSERT(newKey == newFd->cacheId);
             frame = newFd;
             return;
         }
@@ -753,7 +980,7 @@ void FrameSvgPrivate::updateFrameData(uint lastModified, UpdateType updateType)
     }
 
     frame = fd;
-    fd->prefix = prefix;
+    fd->setPrefix(prefix);
     fd->requestedPrefix = requestedPrefix;
     // updateSizes();
     fd->enabledBorders = enabledBorders;
@@ -767,10 +994,19 @@ void FrameSvgPrivate::updateFrameData(uint lastModified, UpdateType updateType)
         newKey = qHash(cacheId(fd.data(), prefix));
     }
 
-    // we know it isn't in s_sharedFrames due to the check above, so insert it now
-    FrameSvgPrivate::s_sharedFrames[q->imageSet()->d].insert(newKey, fd);
     fd->cacheId = newKey;
     fd->imageSet = q->imageSet()->d;
+    fd->thread = q->thread();
+    // A frame made from scratch wasn't looked up above, and may be registered already
+    if (auto registered = FrameRegistry::instance()->insert(fd->registryKey(), fd); registered != fd) {
+        // Sized already
+        frame = registered;
+        if (updateType == UpdateFrameAndMargins) {
+            Q_EMIT q->repaintNeeded();
+        }
+        return;
+    }
+
     if (updateType == UpdateFrameAndMargins) {
         updateAndSignalSizes();
     } else {
@@ -778,92 +1014,204 @@ void FrameSvgPrivate::updateFrameData(uint lastModified, UpdateType updateType)
     }
 }
 
-void FrameSvgPrivate::paintCenter(QPainter &p, const QSharedPointer<FrameData> &frame, const QRectF &contentRect, const QSizeF &fullSize)
+// As QPainter::drawTiledPixmap(), for the images painted on other threads than the GUI one
+static void drawTiled(QPainter &p, const QRectF &target, const QImage &tile)
+{
+    p.setBrushOrigin(target.topLeft());
+    p.fillRect(target, QBrush(tile));
+}
+
+void FrameSvgPrivate::paintCenter(QPainter &p,
+                                  const QSharedPointer<FrameData> &frame,
+                                  const FramePieces &pieces,
+                                  const QImage &mask,
+                                  const QRectF &contentRect,
+                                  const QSizeF &fullSize) const
 {
     // fullSize and contentRect are in device pixels
-    if (!contentRect.isEmpty()) {
-        const QString centerElementId = frame->prefix % QLatin1String("center");
+    const QImage &center = pieces.images[FrameData::Center];
+    if (!contentRect.isEmpty() && !center.isNull()) {
+        const QRectF target = centerRect(frame, contentRect, fullSize);
         if (frame->tileCenter) {
-            QSizeF centerTileSize = q->elementSize(centerElementId);
-            QPixmap center(centerTileSize.toSize());
-            center.fill(Qt::transparent);
-
-            QPainter centerPainter(&center);
-            centerPainter.setCompositionMode(QPainter::CompositionMode_Source);
-            q->paint(&centerPainter, QRectF(QPointF(0, 0), centerTileSize), centerElementId);
-
-            if (frame->composeOverBorder) {
-                p.drawTiledPixmap(QRectF(QPointF(0, 0), fullSize), center);
-            } else {
-                p.drawTiledPixmap(FrameSvgHelpers::sectionRect(FrameSvg::NoBorder, contentRect, fullSize * q->devicePixelRatio()), center);
-            }
+            drawTiled(p, target, center);
         } else {
-            if (frame->composeOverBorder) {
-                q->paint(&p, QRectF(QPointF(0, 0), fullSize), centerElementId);
-            } else {
-                q->paint(&p, FrameSvgHelpers::sectionRect(FrameSvg::NoBorder, contentRect, fullSize * q->devicePixelRatio()), centerElementId);
-            }
+            p.drawImage(target, center, center.rect());
         }
     }
 
     if (frame->composeOverBorder) {
         p.setCompositionMode(QPainter::CompositionMode_DestinationIn);
-        p.drawPixmap(QRectF(QPointF(0, 0), fullSize), alphaMask(), QRectF(QPointF(0, 0), alphaMask().size()));
+        p.drawImage(QRectF(QPointF(0, 0), fullSize), mask, mask.rect());
         p.setCompositionMode(QPainter::CompositionMode_SourceOver);
     }
 }
 
 void FrameSvgPrivate::paintBorder(QPainter &p,
                                   const QSharedPointer<FrameData> &frame,
+                                  const FramePieces &pieces,
                                   const FrameSvg::EnabledBorders borders,
-                                  const QSizeF &size,
                                   const QRectF &contentRect) const
 {
-    // size and contentRect are in device pixels
-    QString side = frame->prefix % FrameSvgHelpers::borderToElementId(borders);
-    if (frame->enabledBorders & borders && q->hasElement(side) && !size.isEmpty()) {
+    // contentRect is in device pixels
+    const QImage &side = pieces.images[FrameData::pieceOf(borders)];
+    if (frame->enabledBorders & borders && !side.isNull()) {
         if (frame->stretchBorders) {
-            q->paint(&p, FrameSvgHelpers::sectionRect(borders, contentRect, frame->frameSize * q->devicePixelRatio()), side);
+            p.drawImage(FrameSvgHelpers::sectionRect(borders, contentRect, frame->frameSize * q->devicePixelRatio()), side, side.rect());
         } else {
-            QSize grownSize(std::ceil(size.width()), std::ceil(size.height()));
-            QPixmap px(grownSize);
-            // QPixmap px(QSize(std::ceil(size.width()), std::ceil(size.height())));
-            px.fill(Qt::transparent);
-
-            QPainter sidePainter(&px);
-            sidePainter.setCompositionMode(QPainter::CompositionMode_Source);
-            // A QRect as we have to exactly fill a QPixmap of integer size, prefer going slightly outside it to not have empty edges in the pixmap to tile
-            q->paint(&sidePainter, QRect(QPoint(0, 0), grownSize), side);
-
-            // We are composing QPixmaps here, so all objects with integer size
+            // We are composing images here, so all objects with integer size
             // Rounding the position and ceiling the size is the way that gives better tiled results
             auto r = FrameSvgHelpers::sectionRect(borders, contentRect, frame->frameSize * q->devicePixelRatio());
             r.setTopLeft(r.topLeft().toPoint());
             r.setSize(QSizeF(std::ceil(r.size().width()), std::ceil(r.size().height())));
 
-            p.drawTiledPixmap(r, px);
+            drawTiled(p, r, side);
         }
     }
 }
 
-void FrameSvgPrivate::paintCorner(QPainter &p, const QSharedPointer<FrameData> &frame, KSvg::FrameSvg::EnabledBorders border, const QRectF &contentRect) const
+void FrameSvgPrivate::paintCorner(QPainter &p,
+                                  const QSharedPointer<FrameData> &frame,
+                                  const FramePieces &pieces,
+                                  KSvg::FrameSvg::EnabledBorders border,
+                                  const QRectF &contentRect) const
 {
     // contentRect is in device pixels
     // Draw the corner only if both borders in both directions are enabled.
     if ((frame->enabledBorders & border) != border) {
         return;
     }
-    const QString corner = frame->prefix % FrameSvgHelpers::borderToElementId(border);
-    if (q->hasElement(corner)) {
+    const QImage &corner = pieces.images[FrameData::pieceOf(border)];
+    if (!corner.isNull()) {
         auto r = FrameSvgHelpers::sectionRect(border, contentRect, frame->frameSize * q->devicePixelRatio());
-        // We are composing QPixmaps here, so all objects with integer size
+        // We are composing images here, so all objects with integer size
         // Rounding the position and ceiling the size is the way that gives better tiled results
         r.setTopLeft(r.topLeft().toPoint());
         r.setSize(QSizeF(std::ceil(r.size().width()), std::ceil(r.size().height())));
-        q->paint(&p, r.toRect(), corner);
+        p.drawImage(r.toRect(), corner, corner.rect());
     }
 }
 
+QRectF FrameSvgPrivate::centerRect(const QSharedPointer<FrameData> &frame, const QRectF &contentRect, const QSizeF &fullSize) const
+{
+    return frame->composeOverBorder ? QRectF(QPointF(0, 0), fullSize)
+                                    : FrameSvgHelpers::sectionRect(FrameSvg::NoBorder, contentRect, fullSize * q->devicePixelRatio());
+}
+
+FramePieces::Ptr FrameSvgPrivate::stretchedPieces(const QSharedPointer<FrameData> &frame,
+                                                  const FramePieces::Ptr &pieces,
+                                                  const QRectF &contentRect,
+                                                  const QSizeF &fullSize)
+{
+    if (frame->tileCenter && !frame->stretchBorders) {
+        return pieces;
+    }
+
+    // Scaling the pieces up would blur them, stretched ones are rendered at the size they are drawn at,
+    // here as rendering isn't safe on the threads painting the bands
+    SvgPrivate *svg = q->Svg::d;
+    auto stretched = std::make_shared<FramePieces>(*pieces);
+    auto render = [&](int piece, const QRectF &target) {
+        const QSize pixelSize(std::ceil(target.width()), std::ceil(target.height()));
+        if (!pieces->images[piece].isNull() && !pixelSize.isEmpty()) {
+            stretched->images[piece] = svg->findImageInCache(frame->pieces[piece].name(), 1, pixelSize);
+        }
+    };
+    if (!frame->tileCenter && !contentRect.isEmpty()) {
+        render(FrameData::Center, centerRect(frame, contentRect, fullSize));
+    }
+    if (frame->stretchBorders) {
+        for (const auto border : {FrameSvg::LeftBorder, FrameSvg::RightBorder, FrameSvg::TopBorder, FrameSvg::BottomBorder}) {
+            if (frame->enabledBorders & border) {
+                render(FrameData::pieceOf(border), FrameSvgHelpers::sectionRect(border, contentRect, frame->frameSize * q->devicePixelRatio()));
+            }
+        }
+    }
+    return stretched;
+}
+
+bool FrameSvgPrivate::composeMask(QRegion &mask)
+{
+    const QSharedPointer<FrameData> maskSource = alphaMaskFrame();
+    const FrameDescriptor::Ptr descriptor = this->descriptor(maskSource->prefix);
+    if (!descriptor->hasCenter || descriptor->hasOverlay || maskSource->composeOverBorder) {
+        return false;
+    }
+
+    // As in generateFrameBackground(), in device pixels
+    const QSizeF size = frameSize(maskSource) * q->devicePixelRatio();
+    const QSizeF fullSize = maskSource->frameSize * q->devicePixelRatio();
+    if (!size.isValid() || size.width() >= MAX_FRAME_SIZE || size.height() >= MAX_FRAME_SIZE) {
+        return false;
+    }
+    const QRectF contentRect = contentGeometry(maskSource, size);
+    // Pieces scaled or tiled between pixels have blended edges, and overlap in frames smaller than their borders
+    if (contentRect != QRectF(contentRect.toRect()) || fullSize != QSizeF(fullSize.toSize()) || contentRect.width() < 0 || contentRect.height() < 0) {
+        return false;
+    }
+
+    const FramePieces::Ptr pieces = framePieces(maskSource.data());
+    QRegion region;
+
+    const QImage &center = pieces->images[FrameData::Center];
+    if (!contentRect.isEmpty() && !center.isNull()) {
+        // Stretched or tiled, only a fully opaque or transparent center stays so
+        const QRegion &opaque = pieces->regions[FrameData::Center];
+        if (opaque == QRegion(center.rect())) {
+            region += contentRect.toRect();
+        } else if (!opaque.isEmpty()) {
+            return false;
+        }
+    }
+
+    for (const FrameSvg::EnabledBorders corner : {FrameSvg::LeftBorder | FrameSvg::TopBorder,
+                                                  FrameSvg::RightBorder | FrameSvg::TopBorder,
+                                                  FrameSvg::LeftBorder | FrameSvg::BottomBorder,
+                                                  FrameSvg::RightBorder | FrameSvg::BottomBorder}) {
+        const FrameData::Piece piece = FrameData::pieceOf(corner);
+        const QImage &image = pieces->images[piece];
+        if ((maskSource->enabledBorders & corner) != corner || image.isNull()) {
+            continue;
+        }
+        // Corners are painted unscaled, unless the frame is smaller than them
+        const QRect target = FrameSvgHelpers::sectionRect(corner, contentRect, fullSize).toRect();
+        if (target.size() != image.size()) {
+            return false;
+        }
+        region += pieces->regions[piece].translated(target.topLeft());
+    }
+
+    for (const FrameSvg::EnabledBorders side : {FrameSvg::LeftBorder, FrameSvg::RightBorder, FrameSvg::TopBorder, FrameSvg::BottomBorder}) {
+        const FrameData::Piece piece = FrameData::pieceOf(side);
+        const QImage &image = pieces->images[piece];
+        if (!(maskSource->enabledBorders & side) || image.isNull()) {
+            continue;
+        }
+        // Sides are stretched or tiled along the frame only, where each of their rows or
+        // columns of the opaque region has to go all the way for it to stay the same
+        const bool horizontal = side == FrameSvg::TopBorder || side == FrameSvg::BottomBorder;
+        const QRect target = FrameSvgHelpers::sectionRect(side, contentRect, fullSize).toRect();
+        if (horizontal ? target.height() != image.height() : target.width() != image.width()) {
+            return false;
+        }
+        for (const QRect &opaque : pieces->regions[piece]) {
+            if (horizontal) {
+                if (opaque.width() != image.width()) {
+                    return false;
+                }
+                region += QRect(target.left(), target.top() + opaque.top(), target.width(), opaque.height());
+            } else {
+                if (opaque.height() != image.height()) {
+                    return false;
+                }
+                region += QRect(target.left() + opaque.left(), target.top(), opaque.width(), target.height());
+            }
+        }
+    }
+
+    mask = region & QRect(0, 0, std::ceil(size.width()), std::ceil(size.height()));
+    return true;
+}
+
 SvgPrivate::CacheId FrameSvgPrivate::cacheId(FrameData *frame, const QString &prefixToSave) const
 {
     std::vector<size_t> parts;
@@ -889,7 +1237,7 @@ SvgPrivate::CacheId FrameSvgPrivate::cacheId(FrameData *frame, const QString &pr
                                q->Svg::d->lastModified};
 }
 
-void FrameSvgPrivate::cacheFrame(const QString &prefixToSave, const QPixmap &background, const QPixmap &overlay)
+void FrameSvgPrivate::cacheFrame(const QString &prefixToSave, const QImage &background, const QImage &overlay)
 {
     if (!q->isUsingRenderingCache()) {
         return;
@@ -908,49 +1256,268 @@ void FrameSvgPrivate::cacheFrame(const QString &prefixToSave, const QPixmap &bac
 
     if (!overlay.isNull()) {
         // insert overlay
-        const size_t overlayId = qHash(cacheId(frame.data(), frame->prefix % QLatin1String("overlay")));
+        const size_t overlayId = qHash(cacheId(frame.data(), frame->pieces[FrameData::Overlay].name()));
         q->imageSet()->d->insertIntoCache(QString::number(overlayId), overlay, QString::number((qint64)q, 16) % prefixToSave % QLatin1String("overlay"));
     }
 }
 
+// Descriptors are small, that's a lot more prefixes than themes have
+static const int s_maxCachedDescriptors = 512;
+
+static std::mutex s_descriptorsLock;
+static QCache<QString, FrameDescriptor::Ptr> s_descriptors(s_maxCachedDescriptors);
+
+void FrameDescriptor::discard()
+{
+    std::lock_guard lock(s_descriptorsLock);
+    s_descriptors.clear();
+}
+
+FrameDescriptor::Ptr FrameSvgPrivate::descriptor(const QString &framePrefix) const
+{
+    SvgPrivate *svg = q->Svg::d;
+    if (!svg->resolvePath()) {
+        return std::make_shared<const FrameDescriptor>();
+    }
+
+    const QString key = svg->path % QLatin1Char('#') % framePrefix;
+    {
+        std::lock_guard lock(s_descriptorsLock);
+        const FrameDescriptor::Ptr *cached = s_descriptors.object(key);
+        if (cached && (*cached)->lastModified == svg->lastModified) {
+            return *cached;
+        }
+    }
+
+    // Everything there is to know about the frame, looked up in one go rather than element by element:
+    // the pieces, in the order of FrameData::Piece, then the hints
+    enum Hint {
+        TopMargin = FrameData::PieceCount,
+        TopInset,
+        LeftMargin,
+        LeftInset,
+        RightMargin,
+        RightInset,
+        BottomMargin,
+        BottomInset,
+        ComposeOverBorder,
+        TileCenter,
+        NoBorderPadding,
+        StretchBorders,
+        OverlayPosRight,
+        OverlayPosBottom,
+        OverlayStretch,
+        OverlayTileHorizontal,
+        OverlayTileVertical,
+    };
+    static const QStringList elements = QStringList(s_pieceNames.begin(), s_pieceNames.end())
+        + QStringList{
+            QStringLiteral("hint-top-margin"),
+            QStringLiteral("hint-top-inset"),
+            QStringLiteral("hint-left-margin"),
+            QStringLiteral("hint-left-inset"),
+            QStringLiteral("hint-right-margin"),
+            QStringLiteral("hint-right-inset"),
+            QStringLiteral("hint-bottom-margin"),
+            QStringLiteral("hint-bottom-inset"),
+            QStringLiteral("hint-compose-over-border"),
+            QStringLiteral("hint-tile-center"),
+            QStringLiteral("hint-no-border-padding"),
+            QStringLiteral("hint-stretch-borders"),
+            QStringLiteral("hint-overlay-pos-right"),
+            QStringLiteral("hint-overlay-pos-bottom"),
+            QStringLiteral("hint-overlay-stretch"),
+            QStringLiteral("hint-overlay-tile-horizontal"),
+            QStringLiteral("hint-overlay-tile-vertical"),
+        };
+
+    // The ones that don't have a prefix are for retrocompatibility
+    enum UnprefixedElement {
+        MaskCenter,
+        UnprefixedTileCenter,
+        UnprefixedNoBorderPadding,
+        UnprefixedStretchBorders,
+    };
+
+    // At the natural size
+    const QSizeF s = q->size();
+    q->resize();
+    const QList<QRectF> rects = q->elementRects(framePrefix, elements);
+    const QList<QRectF> unprefixedRects = q->elementRects({QLatin1String("mask-") % framePrefix % QLatin1String("center"),
+                                                           QStringLiteral("hint-tile-center"),
+                                                           QStringLiteral("hint-no-border-padding"),
+                                                           QStringLiteral("hint-stretch-borders")});
+    q->resize(s);
+
+    auto has = [&rects](int element) {
+        return rects[element].isValid();
+    };
+
+    auto descriptor = std::make_shared<FrameDescriptor>();
+    descriptor->lastModified = svg->lastModified;
+
+    for (int i = 0; i < FrameData::PieceCount; ++i) {
+        const QSizeF size = rects[i].size();
+        descriptor->pieceRects[i] = rects[i];
+        descriptor->pieceSizes[i] = QSizeF(std::round(size.width()), std::round(size.height()));
+    }
+    const qreal topHeight = descriptor->pieceSizes[FrameData::Top].height();
+    const qreal leftWidth = descriptor->pieceSizes[FrameData::Left].width();
+    const qreal rightWidth = descriptor->pieceSizes[FrameData::Right].width();
+    const qreal bottomHeight = descriptor->pieceSizes[FrameData::Bottom].height();
+
+    descriptor->topMargin = has(TopMargin) ? rects[TopMargin].height() : topHeight;
+    descriptor->insetTopMargin = has(TopInset) ? rects[TopInset].height() : -1;
+
+    descriptor->leftMargin = has(LeftMargin) ? rects[LeftMargin].width() : leftWidth;
+    descriptor->insetLeftMargin = has(LeftInset) ? rects[LeftInset].width() : -1;
+
+    descriptor->rightMargin = has(RightMargin) ? rects[RightMargin].width() : rightWidth;
+    descriptor->insetRightMargin = has(RightInset) ? rects[RightInset].width() : -1;
+
+    descriptor->bottomMargin = has(BottomMargin) ? rects[BottomMargin].height() : bottomHeight;
+    descriptor->insetBottomMargin = has(BottomInset) ? rects[BottomInset].height() : -1;
+
+    descriptor->hasCenter = has(FrameData::Center);
+    descriptor->hasOverlay = !framePrefix.startsWith(QLatin1String("mask-")) && has(FrameData::Overlay);
+    descriptor->hasMask = unprefixedRects[MaskCenter].isValid();
+
+    descriptor->composeOverBorder = has(ComposeOverBorder) && descriptor->hasMask;
+    // since it's rectangular, topWidth and bottomWidth must be the same
+    descriptor->tileCenter = unprefixedRects[UnprefixedTileCenter].isValid() || has(TileCenter);
+    descriptor->noBorderPadding = unprefixedRects[UnprefixedNoBorderPadding].isValid() || has(NoBorderPadding);
+    descriptor->stretchBorders = unprefixedRects[UnprefixedStretchBorders].isValid() || has(StretchBorders);
+
+    descriptor->overlayPosRight = has(OverlayPosRight);
+    descriptor->overlayPosBottom = has(OverlayPosBottom);
+    descriptor->overlayStretch = has(OverlayStretch);
+    descriptor->overlayTileHorizontal = has(OverlayTileHorizontal);
+    descriptor->overlayTileVertical = has(OverlayTileVertical);
+
+    std::lock_guard lock(s_descriptorsLock);
+    s_descriptors.insert(key, new FrameDescriptor::Ptr(descriptor));
+    return descriptor;
+}
+
+// A few panels and dialogs worth of pieces at high dpi
+static const qsizetype s_maxCachedPieceBytes = 8 * 1024 * 1024;
+
+static std::mutex s_piecesLock;
+static QCache<size_t, FramePieces::Ptr> s_pieces(s_maxCachedPieceBytes);
+
+void FramePieces::discard()
+{
+    std::lock_guard lock(s_piecesLock);
+    s_pieces.clear();
+}
+
+// As QRegion(QBitmap(QPixmap::fromImage(image).mask())), which keeps the pixels at least half opaque
+static QRegion opaqueRegion(const QImage &image)
+{
+    const QImage argb = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    QRegion region;
+    // Runs of opaque pixels of the rows since bandTop, added as a band once a row differs
+    QList<std::pair<int, int>> band;
+    QList<std::pair<int, int>> runs;
+    int bandTop = 0;
+    auto addBand = [&](int bottom) {
+        for (const auto &[left, right] : std::as_const(band)) {
+            region += QRect(QPoint(left, bandTop), QPoint(right, bottom - 1));
+        }
+    };
+    for (int y = 0; y < argb.height(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(argb.constScanLine(y));
+        runs.clear();
+        for (int x = 0; x < argb.width(); ++x) {
+            if (qAlpha(line[x]) < 128) {
+                continue;
+            }
+            const int left = x;
+            while (x + 1 < argb.width() && qAlpha(line[x + 1]) >= 128) {
+                ++x;
+            }
+            runs.append({left, x});
+        }
+        if (runs != band) {
+            addBand(y);
+            band = runs;
+            bandTop = y;
+        }
+    }
+    addBand(argb.height());
+    return region;
+}
+
+FramePieces::Ptr FrameSvgPrivate::framePieces(FrameData *frame)
+{
+    const FrameDescriptor::Ptr descriptor = this->descriptor(frame->prefix);
+    SvgPrivate *svg = q->Svg::d;
+
+    // The id of the frame, but for its size and borders, and of the actual file, as the image
+    // path is the same one in every image set
+    SvgPrivate::CacheId id = cacheId(frame, frame->prefix);
+    id.width = id.height = -1;
+    id.extraFlags = 0;
+    id.filePath = svg->path;
+    const size_t key = qHash(id, SvgRectsCache::s_seed);
+    {
+        std::lock_guard lock(s_piecesLock);
+        if (const FramePieces::Ptr *cached = s_pieces.object(key)) {
+            return *cached;
+        }
+    }
+
+    // A whole number of pixels, going slightly outside the element rather than leaving empty edges to tile
+    std::array<QSize, FrameData::PieceCount> pixelSizes;
+    QStringList ids;
+    QList<QRectF> rects;
+    QList<int> indexes;
+    for (int i = 0; i < FrameData::PieceCount; ++i) {
+        const QSizeF size = descriptor->pieceSizes[i] * q->devicePixelRatio();
+        pixelSizes[i] = QSize(std::ceil(size.width()), std::ceil(size.height()));
+        // The overlay is drawn on its own
+        if (i != FrameData::Overlay && !pixelSizes[i].isEmpty()) {
+            ids << frame->pieces[i].name();
+            rects << descriptor->pieceRects[i];
+            indexes << i;
+        }
+    }
+
+    // Themes lay the pieces out on a pixel grid, they are all rendered in one go then
+    bool wholePieces = true;
+    for (int i : std::as_const(indexes)) {
+        wholePieces = wholePieces && descriptor->pieceRects[i].size() == descriptor->pieceSizes[i];
+    }
+    const QList<QImage> rendered = wholePieces ? svg->renderElements(ids, rects, q->devicePixelRatio()) : QList<QImage>();
+
+    auto pieces = std::make_shared<FramePieces>();
+    qsizetype cost = 0;
+    for (int j = 0; j < indexes.size(); ++j) {
+        const int i = indexes[j];
+        pieces->images[i] = rendered.isEmpty() ? svg->findImageInCache(ids[j], 1, pixelSizes[i]) : rendered[j];
+        pieces->regions[i] = opaqueRegion(pieces->images[i]);
+        cost += qsizetype(pixelSizes[i].width()) * pixelSizes[i].height() * 4;
+    }
+
+    std::lock_guard lock(s_piecesLock);
+    s_pieces.insert(key, new FramePieces::Ptr(pieces), cost);
+    return pieces;
+}
+
 void FrameSvgPrivate::updateSizes(FrameData *frame) const
 {
     // qCDebug(LOG_KSVG) << "!!!!!!!!!!!!!!!!!!!!!! updating sizes" << prefix;
     Q_ASSERT(frame);
 
-    QSizeF s = q->size();
-    q->resize();
     if (!frame->cachedBackground.isNull()) {
-        frame->cachedBackground = QPixmap();
-    }
-
-    // This function needs to do a lot of string creation, since we have four
-    // sides with matching margins and insets. Rather than creating a new string
-    // every time for these, create a single buffer that can contain a full
-    // element name and pass that around using views, so we save a lot of
-    // allocations.
-    QString nameBuffer;
-    const auto offset = frame->prefix.length();
-    nameBuffer.reserve(offset + 30);
-    nameBuffer.append(frame->prefix);
-
-    // This uses UTF16 literals to avoid having to create QLatin1String and then
-    // converting that to a QString temporary for the replace operation.
-    // Additionally, we use a template parameter to provide us the compile-time
-    // length of the literal so we don't need to calculate that.
-    auto createName = [&nameBuffer, offset]<std::size_t length>(const char16_t (&name)[length]) {
-        nameBuffer.replace(offset, length - 1, reinterpret_cast<const QChar *>(name), length);
-        return QStringView(nameBuffer).mid(0, offset + length - 1);
-    };
+        frame->setBackground(QImage());
+    }
 
-    // This has the same size regardless the border is enabled or not
-    frame->fixedTopHeight = q->elementSize(createName(u"top")).height();
+    const FrameDescriptor::Ptr descriptor = this->descriptor(frame->prefix);
 
-    if (auto topMargin = q->elementRect(createName(u"hint-top-margin")); topMargin.isValid()) {
-        frame->fixedTopMargin = topMargin.height();
-    } else {
-        frame->fixedTopMargin = frame->fixedTopHeight;
-    }
+    // This has the same size regardless the border is enabled or not
+    frame->fixedTopHeight = descriptor->pieceSizes[FrameData::Top].height();
+    frame->fixedTopMargin = descriptor->topMargin;
 
     // The same, but its size depends from the margin being enabled
     if (frame->enabledBorders & FrameSvg::TopBorder) {
@@ -959,20 +1526,10 @@ void FrameSvgPrivate::updateSizes(FrameData *frame) const
     } else {
         frame->topMargin = frame->topHeight = 0;
     }
+    frame->insetTopMargin = descriptor->insetTopMargin;
 
-    if (auto topInset = q->elementRect(createName(u"hint-top-inset")); topInset.isValid()) {
-        frame->insetTopMargin = topInset.height();
-    } else {
-        frame->insetTopMargin = -1;
-    }
-
-    frame->fixedLeftWidth = q->elementSize(createName(u"left")).width();
-
-    if (auto leftMargin = q->elementRect(createName(u"hint-left-margin")); leftMargin.isValid()) {
-        frame->fixedLeftMargin = leftMargin.width();
-    } else {
-        frame->fixedLeftMargin = frame->fixedLeftWidth;
-    }
+    frame->fixedLeftWidth = descriptor->pieceSizes[FrameData::Left].width();
+    frame->fixedLeftMargin = descriptor->leftMargin;
 
     if (frame->enabledBorders & FrameSvg::LeftBorder) {
         frame->leftMargin = frame->fixedLeftMargin;
@@ -980,20 +1537,10 @@ void FrameSvgPrivate::updateSizes(FrameData *frame) const
     } else {
         frame->leftMargin = frame->leftWidth = 0;
     }
+    frame->insetLeftMargin = descriptor->insetLeftMargin;
 
-    if (auto leftInset = q->elementRect(createName(u"hint-left-inset")); leftInset.isValid()) {
-        frame->insetLeftMargin = leftInset.width();
-    } else {
-        frame->insetLeftMargin = -1;
-    }
-
-    frame->fixedRightWidth = q->elementSize(createName(u"right")).width();
-
-    if (auto rightMargin = q->elementRect(createName(u"hint-right-margin")); rightMargin.isValid()) {
-        frame->fixedRightMargin = rightMargin.width();
-    } else {
-        frame->fixedRightMargin = frame->fixedRightWidth;
-    }
+    frame->fixedRightWidth = descriptor->pieceSizes[FrameData::Right].width();
+    frame->fixedRightMargin = descriptor->rightMargin;
 
     if (frame->enabledBorders & FrameSvg::RightBorder) {
         frame->rightMargin = frame->fixedRightMargin;
@@ -1001,20 +1548,10 @@ void FrameSvgPrivate::updateSizes(FrameData *frame) const
     } else {
         frame->rightMargin = frame->rightWidth = 0;
     }
+    frame->insetRightMargin = descriptor->insetRightMargin;
 
-    if (auto rightInset = q->elementRect(createName(u"hint-right-inset")); rightInset.isValid()) {
-        frame->insetRightMargin = rightInset.width();
-    } else {
-        frame->insetRightMargin = -1;
-    }
-
-    frame->fixedBottomHeight = q->elementSize(createName(u"bottom")).height();
-
-    if (auto bottomMargin = q->elementRect(createName(u"hint-bottom-margin")); bottomMargin.isValid()) {
-        frame->fixedBottomMargin = bottomMargin.height();
-    } else {
-        frame->fixedBottomMargin = frame->fixedBottomHeight;
-    }
+    frame->fixedBottomHeight = descriptor->pieceSizes[FrameData::Bottom].height();
+    frame->fixedBottomMargin = descriptor->bottomMargin;
 
     if (frame->enabledBorders & FrameSvg::BottomBorder) {
         frame->bottomMargin = frame->fixedBottomMargin;
@@ -1022,26 +1559,12 @@ void FrameSvgPrivate::updateSizes(FrameData *frame) const
     } else {
         frame->bottomMargin = frame->bottomHeight = 0;
     }
+    frame->insetBottomMargin = descriptor->insetBottomMargin;
 
-    if (auto bottomInset = q->elementRect(createName(u"hint-bottom-inset")); bottomInset.isValid()) {
-        frame->insetBottomMargin = bottomInset.height();
-    } else {
-        frame->insetBottomMargin = -1;
-    }
-
-    static const QString maskPrefix = QStringLiteral("mask-");
-    static const QString hintTileCenter = QStringLiteral("hint-tile-center");
-    static const QString hintNoBorderPadding = QStringLiteral("hint-no-border-padding");
-    static const QString hintStretchBorders = QStringLiteral("hint-stretch-borders");
-
-    frame->composeOverBorder = (q->hasElement(createName(u"hint-compose-over-border")) && q->hasElement(maskPrefix % createName(u"center")));
-
-    // since it's rectangular, topWidth and bottomWidth must be the same
-    // the ones that don't have a frame->prefix is for retrocompatibility
-    frame->tileCenter = (q->hasElement(hintTileCenter) || q->hasElement(createName(u"hint-tile-center")));
-    frame->noBorderPadding = (q->hasElement(hintNoBorderPadding) || q->hasElement(createName(u"hint-no-border-padding")));
-    frame->stretchBorders = (q->hasElement(hintStretchBorders) || q->hasElement(createName(u"hint-stretch-borders")));
-    q->resize(s);
+    frame->composeOverBorder = descriptor->composeOverBorder;
+    frame->tileCenter = descriptor->tileCenter;
+    frame->noBorderPadding = descriptor->noBorderPadding;
+    frame->stretchBorders = descriptor->stretchBorders;
 }
 
 void FrameSvgPrivate::updateNeeded()
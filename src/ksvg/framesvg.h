@@ -8,6 +8,7 @@
 #ifndef KSVG_FRAMESVG_H
 #define KSVG_FRAMESVG_H
 
+#include <QImage>
 #include <QObject>
 #include <QPixmap>
 
@@ -129,6 +130,29 @@ public:
     };
     Q_ENUM(MarginEdge)
 
+    /*!
+     * \enum KSvg::FrameSvg::FrameHint
+     *
+     * \brief This flag enum specifies how the theme wants a frame to be drawn.
+     *
+     * \value NoHint
+     * \value TileCenter The center element is tiled rather than stretched.
+     * \value StretchBorders The border elements are stretched rather than tiled.
+     * \value Overlay An overlay element is drawn over the frame.
+     * \value ComposeOverBorder The center element is drawn under the borders, clipped by the mask.
+     *
+     * \since 6.30
+     */
+    enum FrameHint {
+        NoHint = 0,
+        TileCenter = 1,
+        StretchBorders = 2,
+        Overlay = 4,
+        ComposeOverBorder = 8,
+    };
+    Q_DECLARE_FLAGS(FrameHints, FrameHint)
+    Q_FLAG(FrameHints)
+
     /*!
      * Constructs a new FrameSvg that paints the proper named subelements
      * as borders. It may also be used as a regular KSvg::Svg object
@@ -299,6 +323,28 @@ public:
      */
     QMarginsF insets() const;
 
+    /*!
+     * \brief This method returns the hints of the theme for the frame of the
+     * current prefix.
+     *
+     * Those only depend on the SVG file, so they are looked up once for every
+     * frame with the same prefix.
+     *
+     * \since 6.30
+     */
+    FrameHints frameHints() const;
+
+    /*!
+     * \brief This method returns the sizes of the border elements of the
+     * current prefix, at the natural size of the SVG.
+     *
+     * Disabled borders have a size of \c 0. Unlike margins(), this does not
+     * take the margin hints into account.
+     *
+     * \since 6.30
+     */
+    QMarginsF borderSizes() const;
+
     /*!
      * \brief This method returns the rectangle of the center element, taking
      * the margins into account.
@@ -418,6 +464,18 @@ public:
      */
     Q_INVOKABLE QPixmap framePixmap();
 
+    /*!
+     * \brief This method returns the SVG represented by this object as an image.
+     *
+     * The image is in QImage::Format_ARGB32_Premultiplied. Unlike framePixmap(),
+     * it can be used on any thread and uploaded as a texture without converting it.
+     *
+     * Returns a QImage of the rendered SVG
+     *
+     * \since 6.30
+     */
+    QImage frameImage();
+
     /*!
      * \brief This method paints the loaded SVG with the elements that
      * represents the border.
@@ -506,6 +564,7 @@ private:
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(FrameSvg::EnabledBorders)
+Q_DECLARE_OPERATORS_FOR_FLAGS(FrameSvg::FrameHints)
 
 } // KSvg namespace
 
@@ -7,6 +7,7 @@
 #include "imageset.h"
 #include "private/imageset_p.h"
 #include "private/svg_p.h"
+#include "svg.h"
 
 #include <QDebug>
 #include <QDir>
@@ -19,7 +20,6 @@
 #include <QTimer>
 
 #include <KConfigGroup>
-#include <KImageCache>
 
 #include "debug_p.h"
 
@@ -231,6 +231,51 @@ bool ImageSet::currentImageSetHasImage(const QString &name) const
     return path.contains(d->basePath % d->imageSetName);
 }
 
+void ImageSet::preload(const QList<PreloadRequest> &requests)
+{
+    for (const PreloadRequest &request : requests) {
+        if (request.imagePath.isEmpty() || request.size.isEmpty()) {
+            continue;
+        }
+
+        // Only used to work out the cache keys, the rendering doesn't need it anymore
+        Svg svg;
+        svg.setImageSet(this);
+        svg.setDevicePixelRatio(request.devicePixelRatio);
+        svg.setColorSet(Svg::ColorSet(request.colorSet));
+        svg.setStatus(Svg::Status(request.status));
+        svg.setImagePath(request.imagePath);
+        // As SvgItem does
+        svg.setContainsMultipleImages(!request.elementId.isEmpty());
+        svg.imageAsync(request.size, request.elementId);
+    }
+}
+
+void ImageSet::preload(const QVariantList &requests)
+{
+    QList<PreloadRequest> preloadRequests;
+    preloadRequests.reserve(requests.size());
+    for (const QVariant &request : requests) {
+        const QVariantMap map = request.toMap();
+        PreloadRequest preloadRequest{
+            .imagePath = map.value(QStringLiteral("imagePath")).toString(),
+            .elementId = map.value(QStringLiteral("elementId")).toString(),
+            .size = map.value(QStringLiteral("size")).toSizeF().toSize(),
+        };
+        if (const QVariant ratio = map.value(QStringLiteral("devicePixelRatio")); ratio.isValid()) {
+            preloadRequest.devicePixelRatio = ratio.toReal();
+        }
+        if (const QVariant colorSet = map.value(QStringLiteral("colorSet")); colorSet.isValid()) {
+            preloadRequest.colorSet = colorSet.toInt();
+        }
+        if (const QVariant status = map.value(QStringLiteral("status")); status.isValid()) {
+            preloadRequest.status = status.toInt();
+        }
+        preloadRequests << preloadRequest;
+    }
+    preload(preloadRequests);
+}
+
 #if KSVG_BUILD_DEPRECATED_SINCE(6, 21)
 void ImageSet::setUseGlobalSettings(bool useGlobal)
 {
@@ -254,6 +299,7 @@ bool ImageSet::useGlobalSettings() const
 #if KSVG_BUILD_DEPRECATED_SINCE(6, 21)
 void ImageSet::setCacheLimit(int kbytes)
 {
+    std::lock_guard lock(d->cacheLock);
     d->cacheSize = kbytes;
     delete d->pixmapCache;
     d->pixmapCache = nullptr;
@@ -10,6 +10,8 @@
 
 #include <QGuiApplication>
 #include <QObject>
+#include <QSize>
+#include <QVariantList>
 
 #include <ksvg/ksvg_export.h>
 
@@ -157,6 +159,65 @@ public:
      */
     bool currentImageSetHasImage(const QString &name) const;
 
+    /*!
+     * \struct KSvg::ImageSet::PreloadRequest
+     * \inmodule KSvg
+     *
+     * \brief An image to render ahead of time with preload().
+     *
+     * \since 6.30
+     */
+    struct PreloadRequest {
+        /*!
+         * The image path, as given to Svg::setImagePath()
+         */
+        QString imagePath;
+        /*!
+         * The element to render, or an empty string for the whole SVG
+         */
+        QString elementId;
+        /*!
+         * The size of the image, in device independent pixels
+         */
+        QSize size;
+        qreal devicePixelRatio = 1.0;
+        /*!
+         * A KSvg::Svg::ColorSet
+         */
+        int colorSet = 1;
+        /*!
+         * A KSvg::Svg::Status
+         */
+        int status = 0;
+    };
+
+    /*!
+     * \brief This method renders images of this image set into the cache on
+     * a worker thread.
+     *
+     * Every request is rendered as SvgItem would draw it, and ends up under
+     * the same cache key, so that drawing it later is only a cache lookup.
+     * Use this to warm up the caches with images which are known to be
+     * needed soon, such as the frames of the first window shown.
+     *
+     * \a requests the images to render
+     *
+     * \since 6.30
+     */
+    void preload(const QList<PreloadRequest> &requests);
+
+    /*!
+     * \brief This method renders images of this image set into the cache on
+     * a worker thread.
+     *
+     * Each of the \a requests is a map with the imagePath, elementId, size,
+     * devicePixelRatio, colorSet and status keys of PreloadRequest, of which
+     * only imagePath and size are mandatory.
+     *
+     * \since 6.30
+     */
+    Q_INVOKABLE void preload(const QVariantList &requests);
+
 #if KSVG_ENABLE_DEPRECATED_SINCE(6, 21)
     /*!
      * \brief This method sets whether the theme should follow the global
@@ -8,8 +8,14 @@
 #ifndef KSVG_FRAMESVG_P_H
 #define KSVG_FRAMESVG_P_H
 
+#include <array>
+#include <memory>
+#include <mutex>
+
 #include <QCache>
 #include <QHash>
+#include <QRegion>
+#include <QSharedPointer>
 #include <QStringBuilder>
 
 #include <QDebug>
@@ -19,8 +25,64 @@
 #include "framesvg.h"
 #include "svg_p.h"
 
+class QThread;
+
 namespace KSvg
 {
+class FrameData;
+
+/*
+ * The FrameData alive in any FrameSvg, by image set, thread and cache id, for FrameSvgs
+ * drawing the same frame to share it. Frames aren't thread safe, so as the renderers of Svg
+ * they are shared among the FrameSvgs of a thread. The registry itself is split in shards,
+ * each with its own lock, so that FrameSvgs on several threads don't wait on each other.
+ * Frames remove themselves when they are destroyed, and whatever entry they missed is swept
+ * from its shard every so often, so it doesn't grow along with the sizes a frame went through.
+ */
+class FrameRegistry
+{
+public:
+    struct Key {
+        ImageSetPrivate *imageSet;
+        QThread *thread;
+        uint cacheId;
+
+        bool operator==(const Key &other) const = default;
+    };
+
+    // nullptr once destroyed at exit
+    static FrameRegistry *instance();
+
+    // The frame registered under key, null if it's gone
+    QSharedPointer<FrameData> find(const Key &key);
+    // Registers frame under key, unless there is a frame there already, which is returned then
+    QSharedPointer<FrameData> insert(const Key &key, const QSharedPointer<FrameData> &frame);
+    // Drops the entry of key if its frame is gone
+    void remove(const Key &key);
+    // Drops every entry of imageSet, for when it is destroyed
+    void removeImageSet(ImageSetPrivate *imageSet);
+
+    // The number of entries, including those of frames gone since the last sweep
+    qsizetype size();
+
+private:
+    static const int s_shardCount = 16;
+    // Inserts into a shard between sweeps of its gone frames
+    static const int s_insertsPerSweep = 64;
+
+    struct Shard {
+        std::mutex lock;
+        QHash<Key, QWeakPointer<FrameData>> frames;
+        int inserts = 0;
+    };
+
+    Shard &shard(const Key &key);
+
+    std::array<Shard, s_shardCount> m_shards;
+};
+
+size_t qHash(const FrameRegistry::Key &key, size_t seed = 0);
+
 class FrameData
 {
 public:
@@ -43,11 +105,13 @@ public:
         , composeOverBorder(false)
         , imageSet(nullptr)
     {
+        setPrefix(p);
     }
 
     FrameData(const FrameData &other)
         : imagePath(other.imagePath)
         , prefix(other.prefix)
+        , pieces(other.pieces)
         , enabledBorders(other.enabledBorders)
         , cachedMasks(MAX_CACHED_MASKS)
         , frameSize(other.frameSize)
@@ -69,20 +133,46 @@ public:
 
     ~FrameData();
 
+    enum Piece {
+        Center,
+        Top,
+        Bottom,
+        Left,
+        Right,
+        TopLeft,
+        TopRight,
+        BottomLeft,
+        BottomRight,
+        Overlay,
+        PieceCount,
+    };
+
+    // Sets the prefix along with the keys of the pieces
+    void setPrefix(const QString &newPrefix);
+    // The piece of the frame at borders, as FrameSvgHelpers::borderToElementId(), PieceCount if none
+    static Piece pieceOf(FrameSvg::EnabledBorders borders);
+    // The key of the piece of the frame at borders
+    SvgElementKey piece(FrameSvg::EnabledBorders borders) const;
+
     QString imagePath;
     QString prefix;
+    // The elements of the frame, interned once rather than concatenated on every paint
+    std::array<SvgElementKey, PieceCount> pieces;
     QString requestedPrefix;
     int colorSet = 0;
     QMap<Svg::StyleSheetColor, QColor> colorOverrides;
     FrameSvg::EnabledBorders enabledBorders;
-    QPixmap cachedBackground;
+    // Composed as an image, painted on any thread and used as a texture as it is
+    QImage cachedBackground;
+    // Made out of it for QPainter users on demand
+    QPixmap cachedPixmap;
     QCache<uint, QRegion> cachedMasks;
     static const int MAX_CACHED_MASKS = 10;
     uint lastModified = 0;
 
     // Those sizes are in logical pixels
     QSizeF frameSize;
-    uint cacheId;
+    uint cacheId = 0;
 
     // measures
     qreal topHeight;
@@ -122,6 +212,100 @@ public:
     bool composeOverBorder : 1;
 
     KSvg::ImageSetPrivate *imageSet;
+    // The thread of the FrameSvgs sharing it
+    QThread *thread = nullptr;
+
+    void setBackground(const QImage &background)
+    {
+        cachedBackground = background;
+        cachedPixmap = QPixmap();
+    }
+
+    QPixmap backgroundPixmap()
+    {
+        if (cachedPixmap.isNull() && !cachedBackground.isNull()) {
+            cachedPixmap = QPixmap::fromImage(cachedBackground);
+        }
+        return cachedPixmap;
+    }
+
+    FrameRegistry::Key registryKey() const
+    {
+        return {imageSet, thread, cacheId};
+    }
+};
+
+/*
+ * What the file says about the frame of a prefix: which pieces it has, their natural sizes
+ * and its hints. None of that depends on the size, colors or borders of a frame, so it is
+ * worked out once per path, prefix and modification time, and shared by every FrameSvg and
+ * FrameSvgItem drawing that prefix, rather than each of them looking up the same dozen
+ * elements again.
+ */
+class FrameDescriptor
+{
+public:
+    typedef std::shared_ptr<const FrameDescriptor> Ptr;
+
+    // Drops every descriptor, for when the image set changes
+    static void discard();
+
+    uint lastModified = 0;
+
+    // Rects of the pieces at the natural size, null for missing ones
+    std::array<QRectF, FrameData::PieceCount> pieceRects;
+    // Their sizes, rounded
+    std::array<QSizeF, FrameData::PieceCount> pieceSizes;
+
+    // Margins, equal to the sizes of the borders unless hinted otherwise
+    qreal topMargin = 0;
+    qreal leftMargin = 0;
+    qreal rightMargin = 0;
+    qreal bottomMargin = 0;
+
+    // Insets, -1 if not hinted
+    qreal insetTopMargin = -1;
+    qreal insetLeftMargin = -1;
+    qreal insetRightMargin = -1;
+    qreal insetBottomMargin = -1;
+
+    bool hasCenter = false;
+    // Never for mask- prefixes
+    bool hasOverlay = false;
+    bool hasMask = false;
+
+    bool composeOverBorder = false;
+    bool tileCenter = false;
+    bool noBorderPadding = false;
+    bool stretchBorders = false;
+
+    bool overlayPosRight = false;
+    bool overlayPosBottom = false;
+    bool overlayStretch = false;
+    bool overlayTileHorizontal = false;
+    bool overlayTileVertical = false;
+};
+
+/*
+ * The pieces of a frame rendered at their natural size, in device pixels. Those don't depend
+ * on the size nor on the borders of a frame, so they are rendered once per file, prefix,
+ * device pixel ratio and colors and every size is composed out of them, without rendering
+ * the SVG again.
+ */
+class FramePieces
+{
+public:
+    typedef std::shared_ptr<const FramePieces> Ptr;
+
+    // Drops every piece, for when the image set changes
+    static void discard();
+
+    // Null for missing pieces, the overlay is never among them. Images, as frames are
+    // composed out of them on several threads
+    std::array<QImage, FrameData::PieceCount> images;
+    // The pixels of each image at least half opaque, as in the QBitmap of its mask, for
+    // FrameSvg::mask() to be composed out of them rather than out of the whole frame
+    std::array<QRegion, FrameData::PieceCount> regions;
 };
 
 class FrameSvgPrivate
@@ -138,7 +322,13 @@ public:
 
     ~FrameSvgPrivate();
 
-    QPixmap alphaMask();
+    QImage alphaMask();
+    // The frame whose background is the alphaMask(), the mask frame if there is one
+    QSharedPointer<FrameData> alphaMaskFrame();
+    // The region of the alphaMask() in device pixels, composed out of the regions of the
+    // pieces. False if those don't make it exactly, when sections fall between pixels,
+    // edges aren't opaque all along or an overlay is painted over it
+    bool composeMask(QRegion &mask);
 
     enum UpdateType {
         UpdateFrame,
@@ -148,7 +338,7 @@ public:
     void generateBackground(const QSharedPointer<FrameData> &frame);
     void generateFrameBackground(const QSharedPointer<FrameData> &);
     SvgPrivate::CacheId cacheId(FrameData *frame, const QString &prefixToUse) const;
-    void cacheFrame(const QString &prefixToSave, const QPixmap &background, const QPixmap &overlay);
+    void cacheFrame(const QString &prefixToSave, const QImage &background, const QImage &overlay);
     void updateSizes(FrameData *frame) const;
     void updateSizes(const QSharedPointer<FrameData> &frame) const
     {
@@ -162,15 +352,36 @@ public:
     }
     QSizeF frameSize(FrameData *frame) const;
 
+    // The pieces of frame, rendered once for all its sizes
+    FramePieces::Ptr framePieces(FrameData *frame);
+    // pieces with the stretched center and sides rendered at their size in a frame of fullSize
+    FramePieces::Ptr stretchedPieces(const QSharedPointer<FrameData> &frame,
+                                     const FramePieces::Ptr &pieces,
+                                     const QRectF &contentRect,
+                                     const QSizeF &fullSize);
+
     // paintBorder, paintCorder and paintCenter sizes are in device pixels
     void paintBorder(QPainter &p,
                      const QSharedPointer<FrameData> &frame,
+                     const FramePieces &pieces,
                      KSvg::FrameSvg::EnabledBorders border,
-                     const QSizeF &originalSize,
                      const QRectF &output) const;
-    void paintCorner(QPainter &p, const QSharedPointer<FrameData> &frame, KSvg::FrameSvg::EnabledBorders border, const QRectF &output) const;
-    void paintCenter(QPainter &p, const QSharedPointer<FrameData> &frame, const QRectF &contentRect, const QSizeF &fullSize);
-
+    void paintCorner(QPainter &p,
+                     const QSharedPointer<FrameData> &frame,
+                     const FramePieces &pieces,
+                     KSvg::FrameSvg::EnabledBorders border,
+                     const QRectF &output) const;
+    // mask is the alphaMask() of frames composed over their borders
+    void paintCenter(QPainter &p,
+                     const QSharedPointer<FrameData> &frame,
+                     const FramePieces &pieces,
+                     const QImage &mask,
+                     const QRectF &contentRect,
+                     const QSizeF &fullSize) const;
+    QRectF centerRect(const QSharedPointer<FrameData> &frame, const QRectF &contentRect, const QSizeF &fullSize) const;
+
+    // The descriptor of framePrefix in the current file
+    FrameDescriptor::Ptr descriptor(const QString &framePrefix) const;
     QRectF contentGeometry(const QSharedPointer<FrameData> &frame, const QSizeF &size) const;
     void updateFrameData(uint lastModified, UpdateType updateType = UpdateFrameAndMargins);
     QSharedPointer<FrameData> lookupOrCreateMaskFrame(const QSharedPointer<FrameData> &frame, const QString &maskPrefix, const QString &maskRequestedPrefix);
@@ -193,8 +404,6 @@ public:
     // this can differ from frame->frameSize if we are in a transition
     QSizeF pendingFrameSize;
 
-    static QHash<ImageSetPrivate *, QHash<uint, QWeakPointer<FrameData>>> s_sharedFrames;
-
     bool cacheAll : 1;
     bool repaintBlocked : 1;
 };
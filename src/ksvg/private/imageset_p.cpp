@@ -140,12 +140,15 @@ ImageSetPrivate::ImageSetPrivate(const QString &_basePath, QObject *parent)
 
 ImageSetPrivate::~ImageSetPrivate()
 {
-    FrameSvgPrivate::s_sharedFrames.remove(this);
+    if (FrameRegistry *registry = FrameRegistry::instance()) {
+        registry->removeImageSet(this);
+    }
     delete pixmapCache;
 }
 
 bool ImageSetPrivate::useCache()
 {
+    std::lock_guard lock(cacheLock);
     bool cachesTooOld = false;
 
     if (cacheImageSet && !pixmapCache) {
@@ -158,7 +161,8 @@ bool ImageSetPrivate::useCache()
         themeVersion.clear();
 
         const QString themeMetadataPath = configFileForImageSet(basePath, imageSetName);
-        const QString cacheFileBase = cacheFile + QLatin1String("*.kcache");
+        // Caches of KImageCache, which the pixel store replaced, are removed along with the old ones
+        const QStringList cacheFileBases({cacheFile + QLatin1String("*.kcache"), cacheFile + QLatin1String("*.ksvgpixels")});
 
         QString currentCacheFileName;
         if (!themeMetadataPath.isEmpty()) {
@@ -169,13 +173,15 @@ bool ImageSetPrivate::useCache()
             }
             if (!themeVersion.isEmpty()) {
                 cacheFile += QLatin1String("_v") + themeVersion;
-                currentCacheFileName = cacheFile + QLatin1String(".kcache");
+                currentCacheFileName = cacheFile + QLatin1String(".ksvgpixels");
             }
         }
 
         // now we check for, and remove if necessary, old caches
-        QDir cacheDir(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation));
-        cacheDir.setNameFilters(QStringList({cacheFileBase}));
+        const QString cacheLocation = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+        QDir cacheDir(cacheLocation);
+        cacheDir.setNameFilters(cacheFileBases);
+        const QString cacheFilePath = cacheLocation + QLatin1Char('/') + cacheFile + QLatin1String(".ksvgpixels");
 
         const auto files = cacheDir.entryInfoList();
         for (const QFileInfo &file : files) {
@@ -195,8 +201,6 @@ bool ImageSetPrivate::useCache()
             // the cache should be dropped; we need a way to detect system color change when the
             // application is not running.
             // check for expired cache
-            const QString cacheFilePath =
-                QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QLatin1Char('/') + cacheFile + QLatin1String(".kcache");
             if (!cacheFilePath.isEmpty()) {
                 const QFileInfo cacheFileInfo(cacheFilePath);
                 const QFileInfo metadataFileInfo(themeMetadataPath);
@@ -205,8 +209,8 @@ bool ImageSetPrivate::useCache()
             }
         }
 
-        pixmapCache = new KImageCache(cacheFile, cacheSize * 1024);
-        pixmapCache->setEvictionPolicy(KSharedDataCache::EvictLeastRecentlyUsed);
+        QDir().mkpath(cacheLocation);
+        pixmapCache = new SvgPixelStore(cacheFilePath, qint64(cacheSize) * 1024);
 
         if (cachesTooOld) {
             discardCache(PixmapCache | SvgElementsCache);
@@ -218,7 +222,8 @@ bool ImageSetPrivate::useCache()
 
 void ImageSetPrivate::onAppExitCleanup()
 {
-    pixmapsToCache.clear();
+    std::lock_guard lock(cacheLock);
+    imagesToCache.clear();
     delete pixmapCache;
     pixmapCache = nullptr;
     cacheImageSet = false;
@@ -238,6 +243,7 @@ QString ImageSetPrivate::imagePath(const QString &theme, const QString &type, co
 QString ImageSetPrivate::findInImageSet(const QString &image, const QString &theme, bool cache)
 {
     if (cache) {
+        std::lock_guard lock(cacheLock);
         auto it = discoveries.constFind(image);
         if (it != discoveries.constEnd()) {
             return it.value();
@@ -261,6 +267,7 @@ QString ImageSetPrivate::findInImageSet(const QString &image, const QString &the
     }
 
     if (cache && !search.isEmpty()) {
+        std::lock_guard lock(cacheLock);
         discoveries.insert(image, search);
     }
 
@@ -269,12 +276,17 @@ QString ImageSetPrivate::findInImageSet(const QString &image, const QString &the
 
 void ImageSetPrivate::discardCache(CacheTypes caches)
 {
+    std::lock_guard lock(cacheLock);
     if (caches & PixmapCache) {
-        pixmapsToCache.clear();
-        pixmapSaveTimer->stop();
+        imagesToCache.clear();
+        keysToCache.clear();
+        idsToCache.clear();
+        // Also reached from worker threads when the cache turns out to be too old
+        QMetaObject::invokeMethod(pixmapSaveTimer, &QTimer::stop);
         if (pixmapCache) {
             pixmapCache->clear();
         }
+        FramePieces::discard();
     } else {
         // This deletes the object but keeps the on-disk cache for later use
         delete pixmapCache;
@@ -287,20 +299,22 @@ void ImageSetPrivate::discardCache(CacheTypes caches)
 
     if (caches & SvgElementsCache) {
         discoveries.clear();
+        FrameDescriptor::discard();
     }
 }
 
 void ImageSetPrivate::scheduledCacheUpdate()
 {
+    std::lock_guard lock(cacheLock);
     if (useCache()) {
-        QHashIterator<QString, QPixmap> it(pixmapsToCache);
+        QHashIterator<QString, QImage> it(imagesToCache);
         while (it.hasNext()) {
             it.next();
-            pixmapCache->insertPixmap(idsToCache[it.key()], it.value());
+            pixmapCache->insertImage(idsToCache[it.key()], it.value());
         }
     }
 
-    pixmapsToCache.clear();
+    imagesToCache.clear();
     keysToCache.clear();
     idsToCache.clear();
 }
@@ -526,6 +540,7 @@ const QString ImageSetPrivate::svgStyleSheet(KSvg::Svg *svg)
     const bool useCache = svg->d->colorOverrides.isEmpty();
     QString stylesheet;
     if (useCache) {
+        std::lock_guard lock(cacheLock);
         stylesheet = (status == Svg::Status::Selected)
             ? cachedSelectedSvgStyleSheets.value(colorSet)
             : (status == Svg::Status::Inactive ? cachedInactiveSvgStyleSheets.value(colorSet) : cachedSvgStyleSheets.value(colorSet));
@@ -592,6 +607,7 @@ const QString ImageSetPrivate::svgStyleSheet(KSvg::Svg *svg)
             stylesheet += skel.arg(QString::fromUtf8(metaEnum.valueToKey(colorName)), svg->color(colorName).name());
         }
 
+        std::lock_guard lock(cacheLock);
         if (status == Svg::Status::Selected) {
             cachedSelectedSvgStyleSheets.insert(colorSet, stylesheet);
         } else if (status == Svg::Status::Inactive) {
@@ -604,7 +620,7 @@ const QString ImageSetPrivate::svgStyleSheet(KSvg::Svg *svg)
     return stylesheet;
 }
 
-bool ImageSetPrivate::findInCache(const QString &key, QPixmap &pix, unsigned int lastModified)
+bool ImageSetPrivate::isCacheCurrent(const QString &key, unsigned int lastModified)
 {
     if (!useCache()) {
         return false;
@@ -629,38 +645,84 @@ bool ImageSetPrivate::findInCache(const QString &key, QPixmap &pix, unsigned int
     }
 #endif
 
+    return true;
+}
+
+bool ImageSetPrivate::findInCache(const QString &key, QImage &image, unsigned int lastModified)
+{
+    std::lock_guard lock(cacheLock);
+    if (!isCacheCurrent(key, lastModified)) {
+        return false;
+    }
+
     // qCDebug(LOG_KSVG) << "ImageSetPrivate::findInCache: using cache for" << key;
     const QString id = keysToCache.value(key);
-    const auto it = pixmapsToCache.constFind(id);
-    if (it != pixmapsToCache.constEnd()) {
-        pix = *it;
-        return !pix.isNull();
+    const auto it = imagesToCache.constFind(id);
+    if (it != imagesToCache.constEnd()) {
+        image = *it;
+        return !image.isNull();
+    }
+
+    // Points into the mapped store, painting it or uploading it as a texture copies nothing
+    image = pixmapCache->findImage(key);
+    return !image.isNull();
+}
+
+// A region is stored as the x, y, width and height of each of its rects
+bool ImageSetPrivate::findInCache(const QString &key, QRegion &region, unsigned int lastModified)
+{
+    std::lock_guard lock(cacheLock);
+    QByteArray data;
+    if (!isCacheCurrent(key, lastModified) || !pixmapCache->find(key, data) || data.size() % (4 * sizeof(qint32)) != 0) {
+        return false;
+    }
+
+    // In the banded order of the region, for each of them to be appended
+    const qint32 *values = reinterpret_cast<const qint32 *>(data.constData());
+    region = QRegion();
+    for (qsizetype i = 0; i < data.size(); i += 4 * sizeof(qint32)) {
+        region += QRect(values[0], values[1], values[2], values[3]);
+        values += 4;
     }
+    return true;
+}
 
-    QPixmap temp;
-    if (pixmapCache->findPixmap(key, &temp) && !temp.isNull()) {
-        pix = temp;
-        return true;
+void ImageSetPrivate::insertIntoCache(const QString &key, const QRegion &region)
+{
+    std::lock_guard lock(cacheLock);
+    if (!useCache()) {
+        return;
     }
 
-    return false;
+    QByteArray data(region.rectCount() * 4 * sizeof(qint32), Qt::Uninitialized);
+    qint32 *values = reinterpret_cast<qint32 *>(data.data());
+    for (const QRect &rect : region) {
+        values[0] = rect.x();
+        values[1] = rect.y();
+        values[2] = rect.width();
+        values[3] = rect.height();
+        values += 4;
+    }
+    pixmapCache->insert(key, data);
 }
 
-void ImageSetPrivate::insertIntoCache(const QString &key, const QPixmap &pix)
+void ImageSetPrivate::insertIntoCache(const QString &key, const QImage &image)
 {
+    std::lock_guard lock(cacheLock);
     if (useCache()) {
-        pixmapCache->insertPixmap(key, pix);
+        pixmapCache->insertImage(key, image);
     }
 }
 
-void ImageSetPrivate::insertIntoCache(const QString &key, const QPixmap &pix, const QString &id)
+void ImageSetPrivate::insertIntoCache(const QString &key, const QImage &image, const QString &id)
 {
+    std::lock_guard lock(cacheLock);
     if (useCache()) {
         // Remove old key -> id mapping first
         if (auto key = idsToCache.find(id); key != idsToCache.end()) {
             keysToCache.remove(*key);
         }
-        pixmapsToCache[id] = pix;
+        imagesToCache[id] = image;
         keysToCache[key] = id;
         idsToCache[id] = key;
 
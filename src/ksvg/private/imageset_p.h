@@ -10,13 +10,15 @@
 
 #include "imageset.h"
 #include "svg.h"
+#include "svgpixelstore_p.h"
 #include <QHash>
 
+#include <mutex>
+
 #include <KColorScheme>
-#include <KImageCache>
 #include <KPluginMetaData>
-#include <KSharedDataCache>
 #include <QDebug>
+#include <QRegion>
 #include <QTimer>
 
 #include <KConfigGroup>
@@ -33,7 +35,7 @@ enum CacheType {
 Q_DECLARE_FLAGS(CacheTypes, CacheType)
 Q_DECLARE_OPERATORS_FOR_FLAGS(CacheTypes)
 
-class ImageSetPrivate : public QObject, public QSharedData
+class KSVG_AUTOTEST_EXPORT ImageSetPrivate : public QObject, public QSharedData
 {
     Q_OBJECT
 
@@ -52,7 +54,7 @@ public:
     const QString svgStyleSheet(KSvg::Svg *svg);
 
     /*!
-     * Check if a pixmap already exists in the cache and compare the last modified
+     * Check if an image already exists in the cache and compare the last modified
      * timestamp of the file with the last modified date of the one in the cache to make sure
      * the cache is still valid.
      *
@@ -63,7 +65,7 @@ public:
      * TODO: timestamp shouldn't be user-provided
      *
      * \param key the name to use in the cache for this image
-     * \param pix the pixmap object to populate with the resulting data if found
+     * \param image the image to populate with the resulting data if found
      * \param lastModified the timestamp of the file which will be compared with the last
      *                                           modified time of the entry in the cache
      *
@@ -71,23 +73,23 @@ public:
      *              used, it will now always return false. Use a proper file timestamp instead
      *              so modification can be properly tracked.
      *
-     * Returns true when pixmap was found and loaded from cache, false otherwise
+     * Returns true when the image was found and loaded from cache, false otherwise
      **/
-    bool findInCache(const QString &key, QPixmap &pix, unsigned int lastModified);
+    bool findInCache(const QString &key, QImage &image, unsigned int lastModified);
 
     /*!
-     * Insert specified pixmap into the cache.
-     * If the cache already contains pixmap with the specified key then it is
+     * Insert specified image into the cache.
+     * If the cache already contains an image with the specified key then it is
      * overwritten.
      *
-     * \param key the name to use in the cache for this pixmap
-     * \param pix the pixmap data to store in the cache
+     * \param key the name to use in the cache for this image
+     * \param image the image data to store in the cache
      **/
-    void insertIntoCache(const QString &key, const QPixmap &pix);
+    void insertIntoCache(const QString &key, const QImage &image);
 
     /*!
-     * Insert specified pixmap into the cache.
-     * If the cache already contains pixmap with the specified key then it is
+     * Insert specified image into the cache.
+     * If the cache already contains an image with the specified key then it is
      * overwritten.
      * The actual insert is delayed for optimization reasons and the id
      * parameter is used to discard repeated inserts in the delay time, useful
@@ -95,17 +97,28 @@ public:
      * object: the frames between the start and destination sizes aren't
      * useful in the cache and just cause overhead.
      *
-     * \param key the name to use in the cache for this pixmap
-     * \param pix the pixmap data to store in the cache
+     * \param key the name to use in the cache for this image
+     * \param image the image data to store in the cache
      * \param id a name that identifies the caller class of this function in an unique fashion.
      *           This is needed to limit disk writes of the cache.
      *           If an image with the same id changes quickly,
      *           only the last size where insertIntoCache was called is actually stored on disk
      **/
-    void insertIntoCache(const QString &key, const QPixmap &pix, const QString &id);
+    void insertIntoCache(const QString &key, const QImage &image, const QString &id);
+
+    /*!
+     * As the image variants, for regions such as the masks of frames, which are stored
+     * as the list of their rects and shared between processes the same way
+     **/
+    bool findInCache(const QString &key, QRegion &region, unsigned int lastModified);
+    void insertIntoCache(const QString &key, const QRegion &region);
 
     void colorsChanged();
 
+private:
+    // Whether the cache is in use and newer than lastModified
+    bool isCacheCurrent(const QString &key, unsigned int lastModified);
+
 public Q_SLOTS:
     void scheduledCacheUpdate();
     void onAppExitCleanup();
@@ -140,8 +153,13 @@ public:
     KColorScheme tooltipColorScheme;
     QStringList selectors;
     KConfigGroup cfg;
-    KImageCache *pixmapCache;
-    QHash<QString, QPixmap> pixmapsToCache;
+    // Svgs and FrameSvgs living on worker threads use the caches of image sets living on the
+    // GUI thread: the pixel store, the images waiting to go in it, the stylesheets and the
+    // discovered paths are only ever reached with this held. Recursive as finding something
+    // in the cache may discard it
+    std::recursive_mutex cacheLock;
+    SvgPixelStore *pixmapCache;
+    QHash<QString, QImage> imagesToCache;
     QHash<QString, QString> keysToCache;
     QHash<QString, QString> idsToCache;
     QHash<qint64, QString> cachedSvgStyleSheets;
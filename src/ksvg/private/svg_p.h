@@ -8,21 +8,35 @@
 #define KSVG_SVG_P_H
 
 #include "svg.h"
+#include "svgelementkey_p.h"
+#include "svgelementsstore_p.h"
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <shared_mutex>
 
 #include <KColorScheme>
+#include <KSharedConfig>
 
 #include <QExplicitlySharedDataPointer>
+#include <QFuture>
 #include <QHash>
 #include <QObject>
 #include <QPalette>
 #include <QPointer>
 #include <QSharedData>
+#include <QSet>
 #include <QSvgRenderer>
+#include <QThreadStorage>
+
+class QTimer;
 
 namespace KSvg
 {
+class SvgSource;
+
 class SharedSvgRenderer : public QSvgRenderer, public QSharedData
 {
     Q_OBJECT
@@ -33,18 +47,34 @@ public:
     SharedSvgRenderer(const QString &filename, const QString &styleSheet, QHash<QString, QRectF> &interestingElements, QObject *parent = nullptr);
 
     SharedSvgRenderer(const QByteArray &contents, const QString &styleSheet, QHash<QString, QRectF> &interestingElements, QObject *parent = nullptr);
+    // Only elementId of the file, as cut out by SvgSubDocuments
+    SharedSvgRenderer(const QString &filename,
+                      const QString &elementId,
+                      const QString &styleSheet,
+                      QHash<QString, QRectF> &interestingElements,
+                      QObject *parent = nullptr);
 
     void reload();
 
+    // Rough estimate of the memory taken by the parsed document, in bytes
+    qint64 cost() const;
+
+    // For the least recently used renderers to go first when over budget
+    void touch();
+    quint64 lastUsed() const;
+
 private:
-    bool load(const QByteArray &contents, const QString &styleSheet, QHash<QString, QRectF> &interestingElements);
+    bool load(const SvgSource &source, const QString &styleSheet, QHash<QString, QRectF> &interestingElements);
 
     QString m_filename;
+    QString m_elementId;
     QString m_styleSheet;
     QHash<QString, QRectF> m_interestingElements;
+    qint64 m_cost = 0;
+    std::atomic<quint64> m_lastUsed = 0;
 };
 
-class SvgPrivate
+class KSVG_AUTOTEST_EXPORT SvgPrivate
 {
 public:
     struct CacheId {
@@ -67,41 +97,103 @@ public:
 
     // This function is meant for the rects cache
     CacheId cacheId(QStringView elementId) const;
+    // qHash(cacheId()) of the element whose name hashes to elementNameHash, hashing no strings
+    size_t cacheIdHash(size_t elementNameHash) const;
 
     // This function is meant for the pixmap cache
     QString cachePath(const QString &path, const QSize &size) const;
 
     bool setImagePath(const QString &imagePath);
+    // Sets path along with its hash
+    void setPath(const QString &newPath);
 
     ImageSet *actualImageSet();
 
+    // Works out which element gets drawn for elementId at the size s, and at how many pixels
+    bool resolveElement(const QString &elementId, qreal ratio, const QSizeF &s, QString &actualElementId, QSize &size);
+
+    // Elements are rendered into Format_ARGB32_Premultiplied images, which can be painted on
+    // any thread and uploaded as textures as they are, and only made pixmaps for QPainter users
+    QImage findImageInCache(const QString &elementId, qreal ratio, const QSizeF &s = QSizeF());
     QPixmap findInCache(const QString &elementId, qreal ratio, const QSizeF &s = QSizeF());
+    // As findImageInCache(), rendering on the global thread pool on a cache miss
+    QFuture<QImage> imageAsync(const QString &elementId, qreal ratio, const QSizeF &s);
+
+    // The stylesheet the renderer gets
+    QString currentStyleSheet();
+    // A renderer with another stylesheet, shared the same way as the one of createRenderer(),
+    // of only the subdocument of elementId if it isn't empty
+    SharedSvgRenderer::Ptr cachedRenderer(const QString &styleSheet, const QString &elementId = QString());
+    // Whether elementId is better drawn from its subdocument than by parsing the whole file
+    bool rendersSubDocuments(const QString &elementId) const;
+    // Renders elementIds, whose rects at the natural size are rects, in a single pass over the
+    // subdocument of them all, and slices them out at ratio. Empty if they can't be sliced out
+    // on whole pixels, for them to be rendered one by one
+    QList<QImage> renderElements(const QStringList &elementIds, const QList<QRectF> &rects, qreal ratio);
+
+    // Elements painted in the color of a single ColorScheme-* class are tinted from their
+    // coverage, which is rendered once for all palettes, color sets and statuses
+    bool monochromeColor(const QString &elementId, QString &colorClass, QColor &color);
+    QString coverageCachePath(const QString &id, const QSize &size, qreal ratio) const;
+    QImage coverageImage(const QString &elementId, const QString &colorClass, const QSize &size, qreal ratio);
 
     void createRenderer();
     void eraseRenderer();
+    void cacheInterestingElements(const QHash<QString, QRectF> &interestingElements);
+    // Caches the natural size and size hints from the geometry index rather than a renderer
+    bool loadFromIndex();
 
+    // Works out the path of themed images, false if there is none
+    bool resolvePath();
     QRectF elementRect(QStringView elementId);
+    // As the Svg methods, for elements interned once by the caller
+    QRectF elementRect(SvgElementKey key);
+    QSizeF elementSize(SvgElementKey key);
+    bool hasElement(SvgElementKey key);
+    // The rects of prefix followed by each of ids, hashing and looking up the cache ids in one go
+    QList<QRectF> elementRects(QStringView prefix, const QStringList &ids);
     QRectF findAndCacheElementRect(QStringView elementId);
 
     // Following two are utility functions to snap rendered elements to the pixel grid
     // to and from are always 0 <= val <= 1
-    qreal closestDistance(qreal to, qreal from);
+    static qreal closestDistance(qreal to, qreal from);
 
-    QRectF makeUniform(const QRectF &orig, const QRectF &dst);
+    static QRectF makeUniform(const QRectF &orig, const QRectF &dst);
 
     // Slots
     void imageSetChanged();
     void colorsChanged();
 
+    enum class RendererCache {
+        None,
+        Shared, // s_renderers
+        Thread, // s_threadRenderers of the thread the object lives in
+    };
+
     static std::shared_mutex s_renderersLock;
     static QHash<QString, SharedSvgRenderer::Ptr> s_renderers;
+    // QSvgRenderer is not thread safe, so objects living on other threads than the GUI one
+    // share renderers per thread. They are deleted along with the thread.
+    static QThreadStorage<QHash<QString, SharedSvgRenderer::Ptr>> s_threadRenderers;
+    // Images being rendered by imageAsync(), by cache path and device pixel ratio
+    struct PendingImage {
+        quint64 serial;
+        QFuture<QImage> future;
+    };
+    static std::mutex s_pendingImagesLock;
+    static QHash<QString, PendingImage> s_pendingImages;
+    static quint64 s_pendingImagesSerial;
     static QPointer<ImageSet> s_systemColorsCache;
 
     Svg *q;
     QPointer<ImageSet> theme;
     SharedSvgRenderer::Ptr renderer;
+    RendererCache rendererCache = RendererCache::None;
+    // Whether the renderer was needed since the last check of SvgRendererManager
+    std::atomic<bool> rendererUsed = false;
     QString themePath;
     QString path;
+    size_t pathHash = 0;
     QSizeF size;
     QSizeF naturalSize;
     QChar styleCrc;
@@ -121,11 +213,53 @@ public:
     bool themeFailed : 1;
 };
 
+/*
+ * Keeps the parsed documents of the renderers shared on the GUI thread in check.
+ *
+ * Once every element an Svg draws is in the pixmap cache its renderer is dead weight,
+ * so Svgs which didn't need theirs for an idle timeout let go of it. Renderers nobody
+ * holds anymore stay in s_renderers as long as they fit in a memory budget, the least
+ * recently used going first, and are created again on demand otherwise.
+ *
+ * The budget can be set in KiB with the KSVG_RENDERER_CACHE_SIZE environment variable.
+ */
+class SvgRendererManager : public QObject
+{
+    Q_OBJECT
+public:
+    SvgRendererManager(QObject *parent = nullptr);
+
+    // nullptr once destroyed at exit
+    static SvgRendererManager *instance();
+
+    qint64 budget() const;
+    void setBudget(qint64 bytes);
+
+    std::chrono::milliseconds idleTimeout() const;
+    void setIdleTimeout(std::chrono::milliseconds timeout);
+
+    // An Svg holding a renderer of s_renderers, which it will be made to release once idle
+    void watch(SvgPrivate *svg);
+    void unwatch(SvgPrivate *svg);
+
+    // Evicts the least recently used renderers nobody holds until within budget
+    void trim();
+
+private:
+    void releaseIdle();
+
+    std::atomic<qint64> m_budget;
+    std::mutex m_watchedLock;
+    QSet<SvgPrivate *> m_watched;
+    QTimer *m_idleTimer;
+};
+
 class SvgRectsCache : public QObject
 {
     Q_OBJECT
 public:
     SvgRectsCache(QObject *parent = nullptr);
+    ~SvgRectsCache() override;
 
     static SvgRectsCache *instance();
 
@@ -134,6 +268,8 @@ public:
     // Those 2 methods are the same, the second uses the integer id produced by hashed CacheId
     bool findElementRect(SvgPrivate::CacheId cacheId, QRectF &rect);
     bool findElementRect(size_t id, QStringView filePath, QRectF &rect);
+    // Whether each of ids, hashed as in the second findElementRect(), is in the cache
+    QList<bool> findElementRects(const QList<quint64> &ids, QList<QRectF> &rects);
 
     bool loadImageFromCache(const QString &path, uint lastModified);
     void dropImageFromCache(const QString &path);
@@ -159,18 +295,17 @@ Q_SIGNALS:
     void lastModifiedChanged(const QString &filePath, unsigned int lastModified);
 
 private:
-    QTimer *m_configSyncTimer = nullptr;
+    static quint64 pathHash(QStringView path);
+    KSharedConfigPtr settings();
+
     QString m_iconThemePath;
-    KSharedConfigPtr m_svgElementsCache;
+    KSharedConfigPtr m_settings;
     /*
-     * We are indexing in the hash cache ids by their "digested" size_t out of qHash(CacheId)
-     * because we need to serialize it and unserialize it to a config file,
-     * which is more efficient to do that with the size_t directly rather than a CacheId struct serialization
+     * Rects are indexed by the "digested" size_t out of qHash(CacheId), size hints by
+     * the hash of path and element id and everything else by the hash of the path,
+     * so that the store only ever deals with fixed size records
      */
-    QHash<size_t, QRectF> m_localRectCache;
-    QHash<QString, QSet<unsigned int>> m_invalidElements;
-    QHash<QString, QList<QSizeF>> m_sizeHintsForId;
-    QHash<QString, unsigned int> m_lastModifiedTimes;
+    std::unique_ptr<SvgElementsStore> m_store;
 };
 }
 
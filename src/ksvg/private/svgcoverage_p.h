@@ -0,0 +1,44 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KSVG_SVGCOVERAGE_P_H
+#define KSVG_SVGCOVERAGE_P_H
+
+#include <QColor>
+#include <QImage>
+#include <QString>
+
+namespace KSvg
+{
+/*
+ * Symbolic elements are drawn in the color of a single ColorScheme-* class, so every
+ * palette and color set only changes which color their pixels are. Those are rendered
+ * once in white, kept as an alpha coverage image, and every colored variant is made by
+ * tinting it rather than by parsing and rendering the file again with another
+ * stylesheet.
+ */
+class SvgCoverage
+{
+public:
+    // The stylesheet to render the coverage of elements in the colorClass color with
+    static QString styleSheet(const QString &colorClass);
+
+    // Coverage images by cache path, up to a fixed budget
+    static QImage find(const QString &key);
+    static void insert(const QString &key, const QImage &coverage);
+
+    // The coverage of an image rendered with styleSheet()
+    static QImage fromWhite(const QImage &image);
+
+    // The coverage in color, in Format_ARGB32_Premultiplied
+    static QImage tint(const QImage &coverage, const QColor &color);
+
+    // Premultiplies the opaque color by every coverage value of the scanline
+    static void tintScanline(const uchar *coverage, quint32 *destination, int count, QRgb color);
+};
+}
+
+#endif
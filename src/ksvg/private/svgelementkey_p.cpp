@@ -0,0 +1,41 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "svgelementkey_p.h"
+
+#include <mutex>
+#include <shared_mutex>
+
+#include <QHash>
+
+namespace KSvg
+{
+SvgElementKey SvgElementKey::intern(const QString &name)
+{
+    static std::shared_mutex s_lock;
+    static QHash<QString, const Atom *> s_atoms;
+
+    {
+        std::shared_lock lock(s_lock);
+        if (const Atom *atom = s_atoms.value(name)) {
+            return SvgElementKey(atom);
+        }
+    }
+
+    std::unique_lock lock(s_lock);
+    const Atom *&atom = s_atoms[name];
+    if (!atom) {
+        atom = new Atom{name, ::qHash(name)};
+    }
+    return SvgElementKey(atom);
+}
+
+const QString &SvgElementKey::name() const
+{
+    static const QString s_null;
+    return m_atom ? m_atom->name : s_null;
+}
+}
@@ -0,0 +1,70 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KSVG_SVGELEMENTKEY_P_H
+#define KSVG_SVGELEMENTKEY_P_H
+
+#include <QHashFunctions>
+#include <QString>
+
+namespace KSvg
+{
+/*
+ * An interned element id.
+ *
+ * The id is hashed once when it is interned, and every key for an equal id is the same
+ * atom, so that code asking for the same elements over and over, like FrameSvg for its
+ * pieces on every paint, doesn't build and hash the same strings every time. Element ids
+ * are a small set in practice, so atoms are never released.
+ */
+class SvgElementKey
+{
+public:
+    SvgElementKey() = default;
+
+    // The key of name, the same one for every call with an equal name
+    static SvgElementKey intern(const QString &name);
+
+    bool isNull() const
+    {
+        return !m_atom;
+    }
+
+    // The id, a null string for a null key
+    const QString &name() const;
+
+    // qHash(name()), which is what cache ids of elements are made of
+    size_t nameHash() const
+    {
+        return m_atom ? m_atom->hash : 0;
+    }
+
+    friend bool operator==(SvgElementKey a, SvgElementKey b)
+    {
+        return a.m_atom == b.m_atom;
+    }
+
+    friend size_t qHash(SvgElementKey key, size_t seed = 0)
+    {
+        return ::qHash(quintptr(key.m_atom), seed);
+    }
+
+private:
+    struct Atom {
+        QString name;
+        size_t hash;
+    };
+
+    explicit SvgElementKey(const Atom *atom)
+        : m_atom(atom)
+    {
+    }
+
+    const Atom *m_atom = nullptr;
+};
+}
+
+#endif
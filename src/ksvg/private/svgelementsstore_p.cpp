@@ -0,0 +1,633 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "svgelementsstore_p.h"
+#include "debug_p.h"
+
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <thread>
+
+#include <QLockFile>
+#include <QSaveFile>
+
+namespace KSvg
+{
+const quint32 SvgElementsStore::s_magic = 0x4b535645; // "KSVE"
+const quint32 SvgElementsStore::s_version = 2;
+
+// Enough for a typical theme without having to grow on first start
+static const quint32 s_defaultFileCapacity = 256;
+static const quint32 s_defaultRectCapacity = 8192;
+// 40 MiB of rects, past that we rather start over than keep growing
+static const quint32 s_maxRectCapacity = 1 << 20;
+static const quint32 s_maxFileCapacity = 1 << 16;
+
+enum SlotState : quint32 {
+    EmptySlot = 0,
+    WritingSlot,
+    FileSlot,
+    RectSlot,
+    SizeHintSlot,
+    RemovedSlot,
+};
+
+struct SvgElementsStore::Header {
+    quint32 magic;
+    quint32 version;
+    quint32 fileCapacity;
+    quint32 fileCount;
+    quint32 rectCapacity;
+    quint32 rectCount;
+    // Set once the file has been replaced by a rebuilt one, everybody still mapping it has to reopen
+    quint32 superseded;
+    quint32 reserved;
+};
+
+struct SvgElementsStore::FileEntry {
+    quint64 pathHash;
+    quint32 state;
+    quint32 lastModified;
+    // Width and height as two floats, so that they are always read and written together
+    quint64 naturalSize;
+};
+
+struct SvgElementsStore::RectEntry {
+    quint64 key;
+    quint64 pathHash;
+    float x;
+    float y;
+    float width;
+    float height;
+    quint32 state;
+    // Bumped every time the rect is written, for readers to tell they read it while it changed
+    quint32 generation;
+};
+
+template<typename T>
+static T loadAcquire(T &value)
+{
+    return std::atomic_ref<T>(value).load(std::memory_order_acquire);
+}
+
+template<typename T>
+static void storeRelease(T &value, T newValue)
+{
+    std::atomic_ref<T>(value).store(newValue, std::memory_order_release);
+}
+
+static bool claimSlot(quint32 &state, quint32 expected = EmptySlot)
+{
+    return std::atomic_ref<quint32>(state).compare_exchange_strong(expected, WritingSlot, std::memory_order_acq_rel);
+}
+
+// The state of a slot once nobody is writing it anymore, or WritingSlot if that takes too long.
+// Someone else writing it might well be writing the same key. Don't wait forever though, the
+// writer may be a process which crashed half way through
+static quint32 settledState(quint32 &state)
+{
+    quint32 current = loadAcquire(state);
+    for (int spins = 0; current == WritingSlot && spins < 100; ++spins) {
+        std::this_thread::yield();
+        current = loadAcquire(state);
+    }
+    return current;
+}
+
+static quint64 packSize(const QSizeF &size)
+{
+    return quint64(std::bit_cast<quint32>(float(size.width()))) << 32 | std::bit_cast<quint32>(float(size.height()));
+}
+
+static QSizeF unpackSize(quint64 packed)
+{
+    return QSizeF(std::bit_cast<float>(quint32(packed >> 32)), std::bit_cast<float>(quint32(packed)));
+}
+
+static bool isFull(quint32 count, quint32 capacity)
+{
+    return quint64(count) * 4 >= quint64(capacity) * 3;
+}
+
+SvgElementsStore::SvgElementsStore(const QString &fileName)
+    : m_fileName(fileName)
+{
+    static_assert(sizeof(Header) == 32 && sizeof(FileEntry) == 24 && sizeof(RectEntry) == 40, "The on-disk layout must not depend on the platform");
+
+    // Missing, written by another version or damaged: start over
+    if (!open() && !rebuild(s_defaultFileCapacity, s_defaultRectCapacity, false)) {
+        qCWarning(LOG_KSVG) << "Could not open the element cache" << m_fileName;
+    }
+}
+
+SvgElementsStore::~SvgElementsStore()
+{
+    close();
+}
+
+bool SvgElementsStore::isValid() const
+{
+    return m_data;
+}
+
+SvgElementsStore::Header *SvgElementsStore::header() const
+{
+    return reinterpret_cast<Header *>(m_data);
+}
+
+SvgElementsStore::FileEntry *SvgElementsStore::files() const
+{
+    return reinterpret_cast<FileEntry *>(m_data + sizeof(Header));
+}
+
+SvgElementsStore::RectEntry *SvgElementsStore::rects() const
+{
+    return reinterpret_cast<RectEntry *>(files() + header()->fileCapacity);
+}
+
+bool SvgElementsStore::open()
+{
+    if (!QFile::exists(m_fileName)) {
+        return false;
+    }
+
+    m_file.setFileName(m_fileName);
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size < qint64(sizeof(Header))) {
+        close();
+        return false;
+    }
+
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        close();
+        return false;
+    }
+
+    const Header *h = header();
+    const qint64 expectedSize = sizeof(Header) + qint64(h->fileCapacity) * sizeof(FileEntry) + qint64(h->rectCapacity) * sizeof(RectEntry);
+    if (h->magic != s_magic || h->version != s_version || m_size != expectedSize //
+        || !std::has_single_bit(h->fileCapacity) || !std::has_single_bit(h->rectCapacity)) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void SvgElementsStore::close()
+{
+    if (m_data) {
+        m_file.unmap(m_data);
+        m_data = nullptr;
+    }
+    m_size = 0;
+    m_file.close();
+}
+
+bool SvgElementsStore::lockCurrent(std::shared_lock<std::shared_mutex> &lock)
+{
+    lock = std::shared_lock(m_lock);
+    if (!m_data) {
+        return false;
+    } else if (!loadAcquire(header()->superseded)) {
+        return true;
+    }
+
+    // Another process rebuilt the file, follow it to the new one
+    lock.unlock();
+    {
+        std::unique_lock exclusive(m_lock);
+        if (m_data && loadAcquire(header()->superseded)) {
+            close();
+            if (!open()) {
+                qCWarning(LOG_KSVG) << "Could not reopen the element cache" << m_fileName;
+            }
+        }
+    }
+    lock.lock();
+    return m_data;
+}
+
+bool SvgElementsStore::rebuild(quint32 fileCapacity, quint32 rectCapacity, bool keepEntries)
+{
+    // Only one process at a time gets to replace the file, or entries would get lost in between
+    QLockFile lockFile(m_fileName + QLatin1String(".lock"));
+    if (!lockFile.tryLock(2000)) {
+        qCWarning(LOG_KSVG) << "Could not lock the element cache" << m_fileName << lockFile.error();
+        return false;
+    }
+
+    // Somebody else may have been faster, in which case their file is as good as ours would be
+    if (m_data ? loadAcquire(header()->superseded) : open()) {
+        close();
+        return open();
+    }
+
+    QByteArray buffer(sizeof(Header) + qsizetype(fileCapacity) * sizeof(FileEntry) + qsizetype(rectCapacity) * sizeof(RectEntry), '\0');
+
+    Header *newHeader = reinterpret_cast<Header *>(buffer.data());
+    newHeader->magic = s_magic;
+    newHeader->version = s_version;
+    newHeader->fileCapacity = fileCapacity;
+    newHeader->rectCapacity = rectCapacity;
+
+    FileEntry *newFiles = reinterpret_cast<FileEntry *>(buffer.data() + sizeof(Header));
+    RectEntry *newRects = reinterpret_cast<RectEntry *>(newFiles + fileCapacity);
+
+    if (keepEntries && m_data) {
+        // Nobody else sees the new buffer yet, so plain copies will do
+        const quint32 oldFileCapacity = header()->fileCapacity;
+        for (quint32 i = 0; i < oldFileCapacity; ++i) {
+            FileEntry &entry = files()[i];
+            if (loadAcquire(entry.state) != FileSlot) {
+                continue;
+            }
+            quint32 slot = entry.pathHash & (fileCapacity - 1);
+            while (newFiles[slot].state != EmptySlot && newFiles[slot].pathHash != entry.pathHash) {
+                slot = (slot + 1) & (fileCapacity - 1);
+            }
+            if (newFiles[slot].state == EmptySlot) {
+                newFiles[slot] = entry;
+                ++newHeader->fileCount;
+            }
+        }
+
+        // Removed entries are dropped here, this is the only place their slots are reclaimed
+        const quint32 oldRectCapacity = header()->rectCapacity;
+        for (quint32 i = 0; i < oldRectCapacity; ++i) {
+            RectEntry &entry = rects()[i];
+            const quint32 state = loadAcquire(entry.state);
+            if (state != RectSlot && state != SizeHintSlot) {
+                continue;
+            }
+            quint32 slot = entry.key & (rectCapacity - 1);
+            bool duplicate = false;
+            while (newRects[slot].state != EmptySlot) {
+                const RectEntry &other = newRects[slot];
+                if (other.key == entry.key && other.state == state
+                    && (state == RectSlot || (other.width == entry.width && other.height == entry.height))) {
+                    duplicate = true;
+                    break;
+                }
+                slot = (slot + 1) & (rectCapacity - 1);
+            }
+            if (!duplicate && newHeader->rectCount < rectCapacity - 1) {
+                newRects[slot] = entry;
+                ++newHeader->rectCount;
+            }
+        }
+    }
+
+    // Processes which still have the old file mapped keep working on it until they reopen
+    QSaveFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(buffer) != buffer.size() || !file.commit()) {
+        qCWarning(LOG_KSVG) << "Could not write the element cache" << m_fileName << file.errorString();
+        return false;
+    }
+
+    if (m_data) {
+        storeRelease(header()->superseded, quint32(1));
+        close();
+    }
+    return open();
+}
+
+bool SvgElementsStore::reserve()
+{
+    {
+        std::shared_lock<std::shared_mutex> lock;
+        if (!lockCurrent(lock)) {
+            return false;
+        }
+        Header *h = header();
+        if (!isFull(loadAcquire(h->fileCount), h->fileCapacity) && !isFull(loadAcquire(h->rectCount), h->rectCapacity)) {
+            return true;
+        }
+    }
+
+    std::unique_lock lock(m_lock);
+    if (!m_data) {
+        return false;
+    }
+
+    // Another thread may have grown the tables in the meantime
+    const Header *h = header();
+    quint32 fileCapacity = h->fileCapacity;
+    quint32 rectCapacity = h->rectCapacity;
+    const bool filesFull = isFull(h->fileCount, fileCapacity);
+    const bool rectsFull = isFull(h->rectCount, rectCapacity);
+    if (!filesFull && !rectsFull) {
+        return true;
+    }
+
+    bool keepEntries = true;
+    if ((filesFull && fileCapacity >= s_maxFileCapacity) || (rectsFull && rectCapacity >= s_maxRectCapacity)) {
+        keepEntries = false;
+        fileCapacity = s_defaultFileCapacity;
+        rectCapacity = s_defaultRectCapacity;
+    } else {
+        fileCapacity = filesFull ? fileCapacity * 2 : fileCapacity;
+        rectCapacity = rectsFull ? rectCapacity * 2 : rectCapacity;
+    }
+
+    return rebuild(fileCapacity, rectCapacity, keepEntries);
+}
+
+SvgElementsStore::FileEntry *SvgElementsStore::findFile(quint64 pathHash) const
+{
+    const quint32 mask = header()->fileCapacity - 1;
+    for (quint32 i = pathHash & mask, probes = 0; probes <= mask; i = (i + 1) & mask, ++probes) {
+        FileEntry &entry = files()[i];
+        const quint32 state = loadAcquire(entry.state);
+        if (state == EmptySlot) {
+            return nullptr;
+        } else if (state == FileSlot && entry.pathHash == pathHash) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+SvgElementsStore::FileEntry *SvgElementsStore::findOrInsertFile(quint64 pathHash)
+{
+    const quint32 mask = header()->fileCapacity - 1;
+    for (quint32 i = pathHash & mask, probes = 0; probes <= mask; i = (i + 1) & mask, ++probes) {
+        FileEntry &entry = files()[i];
+        quint32 state = loadAcquire(entry.state);
+        if (state == EmptySlot) {
+            if (claimSlot(entry.state)) {
+                entry.pathHash = pathHash;
+                entry.lastModified = 0;
+                entry.naturalSize = 0;
+                std::atomic_ref<quint32>(header()->fileCount).fetch_add(1, std::memory_order_relaxed);
+                storeRelease(entry.state, quint32(FileSlot));
+                return &entry;
+            }
+            state = settledState(entry.state);
+        }
+        if (state == FileSlot && entry.pathHash == pathHash) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+bool SvgElementsStore::findRect(quint64 id, QRectF &rect)
+{
+    std::shared_lock<std::shared_mutex> lock;
+    if (!lockCurrent(lock)) {
+        return false;
+    }
+
+    return probeRect(id, rect);
+}
+
+QList<bool> SvgElementsStore::findRects(const QList<quint64> &ids, QList<QRectF> &rects)
+{
+    QList<bool> found(ids.size(), false);
+    rects.resize(ids.size());
+
+    std::shared_lock<std::shared_mutex> lock;
+    if (!lockCurrent(lock)) {
+        return found;
+    }
+
+    for (qsizetype i = 0; i < ids.size(); ++i) {
+        found[i] = probeRect(ids[i], rects[i]);
+    }
+    return found;
+}
+
+bool SvgElementsStore::probeRect(quint64 id, QRectF &rect) const
+{
+    const quint32 mask = header()->rectCapacity - 1;
+    for (quint32 i = id & mask, probes = 0; probes <= mask; i = (i + 1) & mask, ++probes) {
+        RectEntry &entry = rects()[i];
+        const quint32 state = loadAcquire(entry.state);
+        if (state == EmptySlot) {
+            return false;
+        } else if (state == RectSlot && entry.key == id) {
+            // It may be rewritten by another process meanwhile, which is as good as not finding it
+            const quint32 generation = loadAcquire(entry.generation);
+            const QRectF found(entry.x, entry.y, entry.width, entry.height);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (loadAcquire(entry.state) != RectSlot || loadAcquire(entry.generation) != generation) {
+                return false;
+            }
+            rect = found;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SvgElementsStore::insertRect(quint64 id, quint64 pathHash, const QRectF &rect)
+{
+    if (!reserve()) {
+        return;
+    }
+
+    std::shared_lock<std::shared_mutex> lock;
+    if (!lockCurrent(lock)) {
+        return;
+    }
+
+    const quint32 mask = header()->rectCapacity - 1;
+    for (quint32 i = id & mask, probes = 0; probes <= mask; i = (i + 1) & mask, ++probes) {
+        RectEntry &entry = rects()[i];
+        const quint32 state = settledState(entry.state);
+        if (state == WritingSlot) {
+            // Rather missing it than ending up with it twice
+            return;
+        } else if (state == EmptySlot || (state == RectSlot && entry.key == id)) {
+            if (!claimSlot(entry.state, state)) {
+                // Someone else got there first, see what they did with it
+                i = (i - 1) & mask;
+                --probes;
+                continue;
+            }
+            if (state == EmptySlot) {
+                std::atomic_ref<quint32>(header()->rectCount).fetch_add(1, std::memory_order_relaxed);
+            }
+        } else {
+            continue;
+        }
+        // Readers skip it until it is published again, and those which were half way through
+        // reading it see the generation change
+        entry.key = id;
+        entry.pathHash = pathHash;
+        entry.x = rect.x();
+        entry.y = rect.y();
+        entry.width = rect.width();
+        entry.height = rect.height();
+        std::atomic_ref<quint32>(entry.generation).fetch_add(1, std::memory_order_release);
+        storeRelease(entry.state, quint32(RectSlot));
+        return;
+    }
+}
+
+QList<QSizeF> SvgElementsStore::sizeHints(quint64 hintKey)
+{
+    QList<QSizeF> sizes;
+    std::shared_lock<std::shared_mutex> lock;
+    if (!lockCurrent(lock)) {
+        return sizes;
+    }
+
+    const quint32 mask = header()->rectCapacity - 1;
+    for (quint32 i = hintKey & mask, probes = 0; probes <= mask; i = (i + 1) & mask, ++probes) {
+        RectEntry &entry = rects()[i];
+        const quint32 state = loadAcquire(entry.state);
+        if (state == EmptySlot) {
+            break;
+        } else if (state == SizeHintSlot && entry.key == hintKey) {
+            sizes << QSizeF(entry.width, entry.height);
+        }
+    }
+    return sizes;
+}
+
+void SvgElementsStore::insertSizeHint(quint64 hintKey, quint64 pathHash, const QSizeF &size)
+{
+    if (!reserve()) {
+        return;
+    }
+
+    std::shared_lock<std::shared_mutex> lock;
+    if (!lockCurrent(lock)) {
+        return;
+    }
+
+    const quint32 mask = header()->rectCapacity - 1;
+    for (quint32 i = hintKey & mask, probes = 0; probes <= mask; i = (i + 1) & mask, ++probes) {
+        RectEntry &entry = rects()[i];
+        const quint32 state = settledState(entry.state);
+        if (state == WritingSlot) {
+            return;
+        } else if (state == SizeHintSlot && entry.key == hintKey && entry.width == float(size.width()) && entry.height == float(size.height())) {
+            return;
+        } else if (state == EmptySlot) {
+            if (!claimSlot(entry.state)) {
+                // Someone else got there first, maybe with the same size
+                i = (i - 1) & mask;
+                --probes;
+                continue;
+            }
+            std::atomic_ref<quint32>(header()->rectCount).fetch_add(1, std::memory_order_relaxed);
+            entry.key = hintKey;
+            entry.pathHash = pathHash;
+            entry.x = 0;
+            entry.y = 0;
+            entry.width = size.width();
+            entry.height = size.height();
+            storeRelease(entry.state, quint32(SizeHintSlot));
+            return;
+        }
+    }
+}
+
+uint SvgElementsStore::lastModified(quint64 pathHash)
+{
+    std::shared_lock<std::shared_mutex> lock;
+    if (!lockCurrent(lock)) {
+        return 0;
+    }
+    FileEntry *entry = findFile(pathHash);
+    return entry ? loadAcquire(entry->lastModified) : 0;
+}
+
+void SvgElementsStore::setLastModified(quint64 pathHash, uint lastModified)
+{
+    if (!reserve()) {
+        return;
+    }
+
+    std::shared_lock<std::shared_mutex> lock;
+    if (!lockCurrent(lock)) {
+        return;
+    }
+    if (FileEntry *entry = findOrInsertFile(pathHash)) {
+        storeRelease(entry->lastModified, quint32(lastModified));
+    }
+}
+
+QSizeF SvgElementsStore::naturalSize(quint64 pathHash)
+{
+    std::shared_lock<std::shared_mutex> lock;
+    if (!lockCurrent(lock)) {
+        return QSizeF();
+    }
+    FileEntry *entry = findFile(pathHash);
+    if (!entry) {
+        return QSizeF();
+    }
+    const QSizeF size = unpackSize(loadAcquire(entry->naturalSize));
+    return size.isEmpty() ? QSizeF() : size;
+}
+
+void SvgElementsStore::setNaturalSize(quint64 pathHash, const QSizeF &size)
+{
+    if (!reserve()) {
+        return;
+    }
+
+    std::shared_lock<std::shared_mutex> lock;
+    if (!lockCurrent(lock)) {
+        return;
+    }
+    if (FileEntry *entry = findOrInsertFile(pathHash)) {
+        storeRelease(entry->naturalSize, packSize(size));
+    }
+}
+
+void SvgElementsStore::dropFile(quint64 pathHash)
+{
+    std::shared_lock<std::shared_mutex> lock;
+    if (!lockCurrent(lock)) {
+        return;
+    }
+
+    if (FileEntry *entry = findFile(pathHash)) {
+        storeRelease(entry->lastModified, quint32(0));
+        storeRelease(entry->naturalSize, quint64(0));
+    }
+
+    // Removed slots keep their place in the probe chains until the next rebuild
+    const quint32 capacity = header()->rectCapacity;
+    for (quint32 i = 0; i < capacity; ++i) {
+        RectEntry &entry = rects()[i];
+        const quint32 state = loadAcquire(entry.state);
+        if ((state == RectSlot || state == SizeHintSlot) && entry.pathHash == pathHash) {
+            quint32 expected = state;
+            std::atomic_ref<quint32>(entry.state).compare_exchange_strong(expected, RemovedSlot, std::memory_order_acq_rel);
+        }
+    }
+}
+
+QList<quint64> SvgElementsStore::rectKeysForFile(quint64 pathHash)
+{
+    QList<quint64> keys;
+    std::shared_lock<std::shared_mutex> lock;
+    if (!lockCurrent(lock)) {
+        return keys;
+    }
+
+    const quint32 capacity = header()->rectCapacity;
+    for (quint32 i = 0; i < capacity; ++i) {
+        RectEntry &entry = rects()[i];
+        if (loadAcquire(entry.state) == RectSlot && entry.pathHash == pathHash) {
+            keys << entry.key;
+        }
+    }
+    return keys;
+}
+}
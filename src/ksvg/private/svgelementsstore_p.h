@@ -0,0 +1,102 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KSVG_SVGELEMENTSSTORE_P_H
+#define KSVG_SVGELEMENTSSTORE_P_H
+
+#include <shared_mutex>
+
+#include <QFile>
+#include <QList>
+#include <QRectF>
+#include <QSizeF>
+#include <QString>
+
+#include <ksvg/ksvg_export.h>
+
+namespace KSvg
+{
+/*
+ * Persistent store of element geometry, shared by every process using KSvg.
+ *
+ * This replaces the old ksvg-elements KConfig file, which had to be parsed as text
+ * in full before the first rect could be looked up. The store is a single file which
+ * is memory mapped and probed in place:
+ *
+ *   Header
+ *   FileEntry[fileCapacity]   one per SVG file: last modified time and natural size
+ *   RectEntry[rectCapacity]   element rects and size hints
+ *
+ * Both tables use open addressing with linear probing and are only ever appended to;
+ * slots are claimed with an atomic compare and swap so that several processes can
+ * write to the same mapping, and an element looked up by one process is immediately
+ * visible to all the others. When a table fills up the file is rebuilt with twice the
+ * capacity under a lock file and atomically replaced; the old header is then flagged
+ * as superseded so that every other process reopens the new file on its next access.
+ */
+class KSVG_AUTOTEST_EXPORT SvgElementsStore
+{
+public:
+    explicit SvgElementsStore(const QString &fileName);
+    ~SvgElementsStore();
+
+    bool isValid() const;
+
+    bool findRect(quint64 id, QRectF &rect);
+    // As findRect() for each of ids, in one go
+    QList<bool> findRects(const QList<quint64> &ids, QList<QRectF> &rects);
+    void insertRect(quint64 id, quint64 pathHash, const QRectF &rect);
+
+    QList<QSizeF> sizeHints(quint64 hintKey);
+    void insertSizeHint(quint64 hintKey, quint64 pathHash, const QSizeF &size);
+
+    uint lastModified(quint64 pathHash);
+    void setLastModified(quint64 pathHash, uint lastModified);
+
+    QSizeF naturalSize(quint64 pathHash);
+    void setNaturalSize(quint64 pathHash, const QSizeF &size);
+
+    // Forgets everything known about a file
+    void dropFile(quint64 pathHash);
+
+    QList<quint64> rectKeysForFile(quint64 pathHash);
+
+    static const quint32 s_magic;
+    static const quint32 s_version;
+
+private:
+    Q_DISABLE_COPY(SvgElementsStore)
+
+    struct Header;
+    struct FileEntry;
+    struct RectEntry;
+
+    bool open();
+    void close();
+    bool lockCurrent(std::shared_lock<std::shared_mutex> &lock);
+    // Replaces the file and leaves the store opened on the new one
+    bool rebuild(quint32 fileCapacity, quint32 rectCapacity, bool keepEntries);
+    bool reserve();
+
+    Header *header() const;
+    FileEntry *files() const;
+    RectEntry *rects() const;
+
+    // With the lock held
+    bool probeRect(quint64 id, QRectF &rect) const;
+
+    FileEntry *findFile(quint64 pathHash) const;
+    FileEntry *findOrInsertFile(quint64 pathHash);
+
+    QString m_fileName;
+    QFile m_file;
+    uchar *m_data = nullptr;
+    qint64 m_size = 0;
+    std::shared_mutex m_lock;
+};
+}
+
+#endif
@@ -0,0 +1,185 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "svgimagecodec_p.h"
+
+namespace KSvg
+{
+enum Op : uchar {
+    IndexOp = 0x00, // 00iiiiii: the color at i in the table
+    DiffOp = 0x40, // 01rrggbb: red, green and blue off by -2..1, same alpha
+    LumaOp = 0x80, // 10gggggg rrrrbbbb: green off by -32..31, red and blue by -8..7 more than green
+    RunOp = 0xc0, // 11nnnnnn: the previous pixel n + 1 more times, up to 62
+    RgbOp = 0xfe, // red, green and blue bytes follow, same alpha
+    RgbaOp = 0xff, // red, green, blue and alpha bytes follow
+};
+
+static const int s_maxRun = 62;
+
+static inline int colorSlot(quint32 pixel)
+{
+    return (qRed(pixel) * 3 + qGreen(pixel) * 5 + qBlue(pixel) * 7 + qAlpha(pixel) * 11) % 64;
+}
+
+// The difference between two channels, wrapped around as the decoder adds it
+static inline int channelDiff(int channel, int previous)
+{
+    return qint8(channel - previous);
+}
+
+QByteArray SvgImageCodec::encode(const QImage &image, qsizetype maxSize)
+{
+    Q_ASSERT(image.format() == QImage::Format_ARGB32_Premultiplied);
+
+    // A pixel is at most a pending run and a literal, 6 bytes, so checking after every pixel
+    // written out is enough to stay in bounds
+    QByteArray encoded(maxSize + 6, Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar *>(encoded.data());
+    const uchar *limit = out + maxSize;
+    uchar *const begin = out;
+
+    quint32 table[64] = {};
+    quint32 previous = 0;
+    int run = 0;
+
+    for (int y = 0; y < image.height(); ++y) {
+        const quint32 *line = reinterpret_cast<const quint32 *>(image.constScanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            const quint32 pixel = line[x];
+            if (pixel == previous) {
+                if (++run == s_maxRun) {
+                    *out++ = RunOp | (run - 1);
+                    run = 0;
+                    if (out > limit) {
+                        return QByteArray();
+                    }
+                }
+                continue;
+            }
+
+            if (run) {
+                *out++ = RunOp | (run - 1);
+                run = 0;
+            }
+
+            const int slot = colorSlot(pixel);
+            if (table[slot] == pixel) {
+                *out++ = IndexOp | slot;
+            } else {
+                table[slot] = pixel;
+                if (qAlpha(pixel) == qAlpha(previous)) {
+                    const int dr = channelDiff(qRed(pixel), qRed(previous));
+                    const int dg = channelDiff(qGreen(pixel), qGreen(previous));
+                    const int db = channelDiff(qBlue(pixel), qBlue(previous));
+                    const int drg = dr - dg;
+                    const int dbg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        *out++ = DiffOp | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+                    } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                        *out++ = LumaOp | (dg + 32);
+                        *out++ = (drg + 8) << 4 | (dbg + 8);
+                    } else {
+                        *out++ = RgbOp;
+                        *out++ = qRed(pixel);
+                        *out++ = qGreen(pixel);
+                        *out++ = qBlue(pixel);
+                    }
+                } else {
+                    *out++ = RgbaOp;
+                    *out++ = qRed(pixel);
+                    *out++ = qGreen(pixel);
+                    *out++ = qBlue(pixel);
+                    *out++ = qAlpha(pixel);
+                }
+            }
+
+            previous = pixel;
+            if (out > limit) {
+                return QByteArray();
+            }
+        }
+    }
+
+    if (run) {
+        *out++ = RunOp | (run - 1);
+    }
+    if (out > limit) {
+        return QByteArray();
+    }
+
+    encoded.truncate(out - begin);
+    return encoded;
+}
+
+QImage SvgImageCodec::decode(const uchar *data, qsizetype dataSize, const QSize &size)
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    if (image.isNull()) {
+        return QImage();
+    }
+
+    const uchar *in = data;
+    const uchar *const end = data + dataSize;
+    quint32 table[64] = {};
+    quint32 pixel = 0;
+    int run = 0;
+
+    for (int y = 0; y < image.height(); ++y) {
+        quint32 *line = reinterpret_cast<quint32 *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            if (run > 0) {
+                --run;
+                line[x] = pixel;
+                continue;
+            } else if (in == end) {
+                return QImage();
+            }
+
+            const uchar op = *in++;
+            if (op == RgbOp) {
+                if (end - in < 3) {
+                    return QImage();
+                }
+                pixel = qRgba(in[0], in[1], in[2], qAlpha(pixel));
+                in += 3;
+            } else if (op == RgbaOp) {
+                if (end - in < 4) {
+                    return QImage();
+                }
+                pixel = qRgba(in[0], in[1], in[2], in[3]);
+                in += 4;
+            } else if ((op & 0xc0) == IndexOp) {
+                pixel = table[op];
+            } else if ((op & 0xc0) == DiffOp) {
+                pixel = qRgba((qRed(pixel) + (op >> 4 & 3) - 2) & 0xff,
+                              (qGreen(pixel) + (op >> 2 & 3) - 2) & 0xff,
+                              (qBlue(pixel) + (op & 3) - 2) & 0xff,
+                              qAlpha(pixel));
+            } else if ((op & 0xc0) == LumaOp) {
+                if (in == end) {
+                    return QImage();
+                }
+                const int dg = (op & 0x3f) - 32;
+                const uchar rb = *in++;
+                pixel = qRgba((qRed(pixel) + dg + (rb >> 4) - 8) & 0xff, //
+                              (qGreen(pixel) + dg) & 0xff,
+                              (qBlue(pixel) + dg + (rb & 0xf) - 8) & 0xff,
+                              qAlpha(pixel));
+            } else {
+                // The previous pixel again, and as many more times
+                run = op & 0x3f;
+                line[x] = pixel;
+                continue;
+            }
+
+            table[colorSlot(pixel)] = pixel;
+            line[x] = pixel;
+        }
+    }
+
+    return image;
+}
+}
@@ -0,0 +1,39 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KSVG_SVGIMAGECODEC_P_H
+#define KSVG_SVGIMAGECODEC_P_H
+
+#include <QByteArray>
+#include <QImage>
+
+#include <ksvg/ksvg_export.h>
+
+namespace KSvg
+{
+/*
+ * Fast lossless compression of rendered images, for big ones to take less of the pixel
+ * cache budget.
+ *
+ * This is the QOI scheme on premultiplied pixels: every pixel is either a repetition of
+ * the previous one, a hit in a small table of recently seen colors, a small difference
+ * from the previous one or a literal. Theme art is mostly fully transparent pixels,
+ * which are all zero once premultiplied, and flat colors with antialiased edges, so
+ * nearly everything ends up as runs and table hits. The previous pixel starts out
+ * transparent rather than opaque black for the same reason.
+ */
+class KSVG_AUTOTEST_EXPORT SvgImageCodec
+{
+public:
+    // The encoded Format_ARGB32_Premultiplied image, empty if it would take more than maxSize bytes
+    static QByteArray encode(const QImage &image, qsizetype maxSize);
+
+    // A Format_ARGB32_Premultiplied image of size, null if data doesn't hold that many pixels
+    static QImage decode(const uchar *data, qsizetype dataSize, const QSize &size);
+};
+}
+
+#endif
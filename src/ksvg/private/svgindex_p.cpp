@@ -0,0 +1,724 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "svgindex_p.h"
+#include "svgsource_p.h"
+
+#include <cmath>
+#include <mutex>
+
+#include <QCache>
+#include <QList>
+#include <QPainterPath>
+#include <QPolygonF>
+#include <QRegularExpression>
+#include <QTransform>
+#include <QXmlStreamReader>
+#include <QtMath>
+
+namespace KSvg
+{
+// Indexes are only needed until the rects are in SvgRectsCache, so few are kept around
+static const int s_maxCachedIndexes = 32;
+
+static bool isSeparator(QChar c)
+{
+    return c.isSpace() || c == u',';
+}
+
+static void skipSeparators(QStringView &text)
+{
+    while (!text.isEmpty() && isSeparator(text.front())) {
+        text = text.sliced(1);
+    }
+}
+
+// Reads the next number of a list, which SVG allows to be packed as in "1-2.5.5"
+static bool nextNumber(QStringView &text, qreal &value)
+{
+    skipSeparators(text);
+
+    qsizetype i = 0;
+    auto isDigitAt = [&text](qsizetype pos) {
+        return pos < text.size() && text[pos].isDigit();
+    };
+    auto isSignAt = [&text](qsizetype pos) {
+        return pos < text.size() && (text[pos] == u'+' || text[pos] == u'-');
+    };
+
+    if (isSignAt(i)) {
+        ++i;
+    }
+    bool digits = false;
+    while (isDigitAt(i)) {
+        ++i;
+        digits = true;
+    }
+    if (i < text.size() && text[i] == u'.') {
+        ++i;
+        while (isDigitAt(i)) {
+            ++i;
+            digits = true;
+        }
+    }
+    if (!digits) {
+        return false;
+    }
+    if (i < text.size() && (text[i] == u'e' || text[i] == u'E')) {
+        qsizetype exponent = i + 1;
+        if (isSignAt(exponent)) {
+            ++exponent;
+        }
+        if (isDigitAt(exponent)) {
+            while (isDigitAt(exponent)) {
+                ++exponent;
+            }
+            i = exponent;
+        }
+    }
+
+    bool ok = false;
+    value = text.first(i).toDouble(&ok);
+    text = text.sliced(i);
+    return ok;
+}
+
+static bool parseNumberList(QStringView text, QList<qreal> &numbers)
+{
+    qreal value;
+    while (nextNumber(text, value)) {
+        numbers << value;
+    }
+    skipSeparators(text);
+    return text.isEmpty();
+}
+
+// Only user units, anything else needs the conversions of QSvgRenderer
+static bool parseLength(QStringView text, qreal &length)
+{
+    text = text.trimmed();
+    if (text.endsWith(u"px")) {
+        text.chop(2);
+    }
+    bool ok = false;
+    length = text.toDouble(&ok);
+    return ok;
+}
+
+static bool lengthAttribute(const QXmlStreamAttributes &attributes, QLatin1String name, qreal &length)
+{
+    length = 0;
+    return !attributes.hasAttribute(name) || parseLength(attributes.value(name), length);
+}
+
+static bool parseTransform(QStringView text, QTransform &transform)
+{
+    while (true) {
+        skipSeparators(text);
+        if (text.isEmpty()) {
+            return true;
+        }
+
+        const qsizetype open = text.indexOf(u'(');
+        const qsizetype close = text.indexOf(u')');
+        if (open < 0 || close < open) {
+            return false;
+        }
+        const QStringView name = text.first(open).trimmed();
+        QList<qreal> args;
+        if (!parseNumberList(text.sliced(open + 1, close - open - 1), args)) {
+            return false;
+        }
+        text = text.sliced(close + 1);
+
+        // Same calls as QSvgRenderer, so that the matrices come out identical
+        if (name == u"matrix" && args.size() == 6) {
+            transform = QTransform(args[0], args[1], args[2], args[3], args[4], args[5]) * transform;
+        } else if (name == u"translate" && (args.size() == 1 || args.size() == 2)) {
+            transform.translate(args[0], args.value(1));
+        } else if (name == u"scale" && (args.size() == 1 || args.size() == 2)) {
+            transform.scale(args[0], args.value(1, args[0]));
+        } else if (name == u"rotate" && args.size() == 3) {
+            transform.translate(args[1], args[2]);
+            transform.rotate(args[0]);
+            transform.translate(-args[1], -args[2]);
+        } else if (name == u"rotate" && args.size() == 1) {
+            transform.rotate(args[0]);
+        } else if (name == u"skewX" && args.size() == 1) {
+            transform.shear(std::tan(qDegreesToRadians(args[0])), 0);
+        } else if (name == u"skewY" && args.size() == 1) {
+            transform.shear(0, std::tan(qDegreesToRadians(args[0])));
+        } else {
+            return false;
+        }
+    }
+}
+
+// Lines and Bézier curves only, arcs are left to QSvgRenderer
+static bool parsePath(QStringView data, QPainterPath &path)
+{
+    QPointF current;
+    QPointF subpathStart;
+    QPointF lastControl;
+    char16_t command = 0;
+    char16_t previous = 0;
+
+    while (true) {
+        skipSeparators(data);
+        if (data.isEmpty()) {
+            return true;
+        }
+
+        if (data.front().isLetter()) {
+            command = data.front().unicode();
+            data = data.sliced(1);
+        } else if (command == 0 || command == u'Z' || command == u'z') {
+            return false;
+        }
+
+        const bool relative = QChar::isLower(command);
+        const QPointF origin = relative ? current : QPointF();
+        auto point = [&data, &origin](QPointF &p) {
+            qreal x, y;
+            if (!nextNumber(data, x) || !nextNumber(data, y)) {
+                return false;
+            }
+            p = origin + QPointF(x, y);
+            return true;
+        };
+
+        QPointF control1;
+        QPointF control2;
+        QPointF end;
+        qreal value;
+        const char16_t type = QChar::toUpper(command);
+        switch (type) {
+        case u'M':
+            if (!point(end)) {
+                return false;
+            }
+            path.moveTo(end);
+            subpathStart = end;
+            // Any more coordinates are implicit line commands
+            command = relative ? u'l' : u'L';
+            break;
+        case u'L':
+            if (!point(end)) {
+                return false;
+            }
+            path.lineTo(end);
+            break;
+        case u'H':
+            if (!nextNumber(data, value)) {
+                return false;
+            }
+            end = QPointF(relative ? current.x() + value : value, current.y());
+            path.lineTo(end);
+            break;
+        case u'V':
+            if (!nextNumber(data, value)) {
+                return false;
+            }
+            end = QPointF(current.x(), relative ? current.y() + value : value);
+            path.lineTo(end);
+            break;
+        case u'C':
+            if (!point(control1) || !point(control2) || !point(end)) {
+                return false;
+            }
+            path.cubicTo(control1, control2, end);
+            lastControl = control2;
+            break;
+        case u'S':
+            control1 = (previous == u'C' || previous == u'S') ? 2 * current - lastControl : current;
+            if (!point(control2) || !point(end)) {
+                return false;
+            }
+            path.cubicTo(control1, control2, end);
+            lastControl = control2;
+            break;
+        case u'Q':
+            if (!point(control1) || !point(end)) {
+                return false;
+            }
+            path.quadTo(control1, end);
+            lastControl = control1;
+            break;
+        case u'T':
+            control1 = (previous == u'Q' || previous == u'T') ? 2 * current - lastControl : current;
+            if (!point(end)) {
+                return false;
+            }
+            path.quadTo(control1, end);
+            lastControl = control1;
+            break;
+        case u'Z':
+            path.closeSubpath();
+            end = subpathStart;
+            break;
+        default:
+            return false;
+        }
+
+        current = end;
+        previous = type;
+    }
+}
+
+// The outline of a shape QSvgRenderer computes its bounds from, before stroking
+static bool shapeOutline(QStringView name, const QXmlStreamAttributes &attributes, QPainterPath &outline)
+{
+    if (name == u"rect") {
+        qreal x, y, width, height;
+        if (!lengthAttribute(attributes, QLatin1String("x"), x) || !lengthAttribute(attributes, QLatin1String("y"), y)
+            || !lengthAttribute(attributes, QLatin1String("width"), width) || !lengthAttribute(attributes, QLatin1String("height"), height) //
+            || width <= 0 || height <= 0) {
+            return false;
+        }
+        outline.addRect(x, y, width, height);
+    } else if (name == u"circle") {
+        qreal cx, cy, r;
+        if (!lengthAttribute(attributes, QLatin1String("cx"), cx) || !lengthAttribute(attributes, QLatin1String("cy"), cy)
+            || !lengthAttribute(attributes, QLatin1String("r"), r) || r <= 0) {
+            return false;
+        }
+        // Ellipses are bound by their rect, not by the curve
+        outline.addRect(cx - r, cy - r, 2 * r, 2 * r);
+    } else if (name == u"ellipse") {
+        qreal cx, cy, rx, ry;
+        if (!lengthAttribute(attributes, QLatin1String("cx"), cx) || !lengthAttribute(attributes, QLatin1String("cy"), cy)
+            || !lengthAttribute(attributes, QLatin1String("rx"), rx) || !lengthAttribute(attributes, QLatin1String("ry"), ry) //
+            || rx <= 0 || ry <= 0) {
+            return false;
+        }
+        outline.addRect(cx - rx, cy - ry, 2 * rx, 2 * ry);
+    } else if (name == u"line") {
+        qreal x1, y1, x2, y2;
+        if (!lengthAttribute(attributes, QLatin1String("x1"), x1) || !lengthAttribute(attributes, QLatin1String("y1"), y1)
+            || !lengthAttribute(attributes, QLatin1String("x2"), x2) || !lengthAttribute(attributes, QLatin1String("y2"), y2)) {
+            return false;
+        }
+        outline.moveTo(x1, y1);
+        outline.lineTo(x2, y2);
+    } else if (name == u"polygon" || name == u"polyline") {
+        QList<qreal> points;
+        if (!parseNumberList(attributes.value(QLatin1String("points")), points) || points.size() < 2 || points.size() % 2) {
+            return false;
+        }
+        QPolygonF polygon;
+        for (qsizetype i = 0; i < points.size(); i += 2) {
+            polygon << QPointF(points[i], points[i + 1]);
+        }
+        outline.addPolygon(polygon);
+    } else if (name == u"path") {
+        return parsePath(attributes.value(QLatin1String("d")), outline);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool isShape(QStringView name)
+{
+    return name == u"rect" || name == u"circle" || name == u"ellipse" || name == u"line" //
+        || name == u"polygon" || name == u"polyline" || name == u"path";
+}
+
+// Presentation attributes, overridden by the style attribute
+static QStringView property(const QXmlStreamAttributes &attributes, QStringView name)
+{
+    const QStringView style = attributes.value(QLatin1String("style"));
+    for (QStringView declaration : style.tokenize(u';')) {
+        const qsizetype colon = declaration.indexOf(u':');
+        if (colon > 0 && declaration.first(colon).trimmed() == name) {
+            return declaration.sliced(colon + 1).trimmed();
+        }
+    }
+    return attributes.value(name).trimmed();
+}
+
+// Whether an element sets its color itself, which may or may not win over its ColorScheme-* class
+// depending on whether it's an attribute or a style property
+static bool hasInlineColor(const QXmlStreamAttributes &attributes)
+{
+    const QStringView color = property(attributes, u"color");
+    return !color.isEmpty() && color != u"inherit";
+}
+
+// The ColorScheme-* class of an element, which gives currentColor its value, without the prefix
+static QString colorSchemeClass(const QXmlStreamAttributes &attributes)
+{
+    static const QLatin1String prefix("ColorScheme-");
+    for (QStringView name : attributes.value(QLatin1String("class")).tokenize(u' ', Qt::SkipEmptyParts)) {
+        if (name.startsWith(prefix) && name.size() > prefix.size()) {
+            return name.sliced(prefix.size()).toString();
+        }
+    }
+    return QString();
+}
+
+// Elements whose contents are only ever drawn through references from elsewhere
+static bool isDefinition(QStringView name)
+{
+    return name == u"defs" || name == u"clipPath" || name == u"mask" || name == u"pattern" || name == u"symbol" || name == u"marker"
+        || name == u"linearGradient" || name == u"radialGradient" || name == u"filter";
+}
+
+static QSize documentSize(const QXmlStreamAttributes &attributes)
+{
+    QList<qreal> viewBox;
+    if (attributes.hasAttribute(QLatin1String("viewBox"))
+        && (!parseNumberList(attributes.value(QLatin1String("viewBox")), viewBox) || viewBox.size() != 4)) {
+        return QSize();
+    }
+
+    const bool hasWidth = attributes.hasAttribute(QLatin1String("width"));
+    const bool hasHeight = attributes.hasAttribute(QLatin1String("height"));
+    if (hasWidth && hasHeight) {
+        qreal width, height;
+        if (!parseLength(attributes.value(QLatin1String("width")), width) || !parseLength(attributes.value(QLatin1String("height")), height)) {
+            return QSize();
+        }
+        return QSizeF(width, height).toSize();
+    } else if (!hasWidth && !hasHeight && viewBox.size() == 4) {
+        return QSizeF(viewBox[2], viewBox[3]).toSize();
+    }
+    return QSize();
+}
+
+SvgIndex::SvgIndex(const QByteArray &contents)
+{
+    parse(contents);
+}
+
+void SvgIndex::parse(const QByteArray &contents)
+{
+    struct Frame {
+        QString id;
+        QTransform transform;
+        // The transforms of the element and all its ancestors
+        QTransform ctm;
+        QRectF bounds;
+        bool stroked = false;
+        bool known = true;
+        // Nothing inside can be worked out, like the contents of <text> or <defs>
+        bool opaque = false;
+        // Not drawn at all, so it doesn't affect the bounds of its parent
+        bool inert = false;
+        // Inherited fill, stroke and ColorScheme-* class, which is what currentColor means
+        QString fill;
+        QString strokePaint;
+        QString colorClass;
+        // Only drawn through references, so what it is painted with doesn't count
+        bool definition = false;
+        // The one ColorScheme-* class all the shapes inside are painted with, if any
+        QString paintClass;
+        bool monochrome = true;
+    };
+
+    static const QLatin1String svgNamespace("http://www.w3.org/2000/svg");
+
+    QXmlStreamReader reader(contents);
+    QList<Frame> stack;
+    bool styleHasStroke = false;
+    bool styleHasPaint = false;
+    // Without it the ColorScheme-* classes don't get the colors of the stylesheets
+    bool colorSchemeStyle = false;
+
+    // Adds what a shape or child is painted with to what frame is painted with
+    auto mergePaint = [](Frame &frame, const QString &paintClass, bool monochrome) {
+        if (!monochrome) {
+            frame.monochrome = false;
+        } else if (!paintClass.isEmpty()) {
+            if (frame.paintClass.isEmpty()) {
+                frame.paintClass = paintClass;
+            } else if (frame.paintClass != paintClass) {
+                frame.monochrome = false;
+            }
+        }
+    };
+
+    auto record = [this](const QString &id, const Element &element) {
+        auto it = m_elements.find(id);
+        if (it == m_elements.end()) {
+            m_elements.insert(id, element);
+        } else {
+            // Which one wins is up to QSvgRenderer
+            it->known = false;
+            it->colorClass.clear();
+        }
+    };
+
+    while (!reader.atEnd()) {
+        const QXmlStreamReader::TokenType token = reader.readNext();
+        if (token == QXmlStreamReader::StartElement) {
+            const QXmlStreamAttributes attributes = reader.attributes();
+            QString id = attributes.value(QLatin1String("id")).toString();
+            if (id.isEmpty()) {
+                id = attributes.value(QLatin1String("xml:id")).toString();
+            }
+
+            if (stack.isEmpty()) {
+                if (reader.name() != u"svg") {
+                    return;
+                }
+                m_defaultSize = documentSize(attributes);
+                const QStringView stroke = property(attributes, u"stroke");
+                stack.append(Frame{.id = id,
+                                   .stroked = !stroke.isEmpty() && stroke != u"inherit" && stroke != u"none",
+                                   .known = false,
+                                   .fill = property(attributes, u"fill").toString(),
+                                   .strokePaint = stroke.toString(),
+                                   .colorClass = hasInlineColor(attributes) ? QString() : colorSchemeClass(attributes)});
+                continue;
+            }
+
+            const Frame &parent = stack.last();
+            Frame frame;
+            frame.id = id;
+            frame.ctm = parent.ctm;
+            frame.stroked = parent.stroked;
+            frame.known = !parent.opaque;
+            frame.opaque = parent.opaque;
+            frame.fill = parent.fill;
+            frame.strokePaint = parent.strokePaint;
+            frame.colorClass = parent.colorClass;
+            frame.definition = parent.definition;
+
+            const QStringView name = reader.name();
+            const bool svgElement = reader.namespaceUri().isEmpty() || reader.namespaceUri() == svgNamespace;
+
+            if (svgElement && name == u"style") {
+                // Rules from the document could stroke anything, which changes the bounds
+                const QString css = reader.readElementText(QXmlStreamReader::IncludeChildElements);
+                styleHasStroke |= css.contains(QLatin1String("stroke"));
+                // And paint anything in other colors than the ColorScheme-* ones
+                styleHasPaint |= css.contains(QLatin1String("fill")) || css.contains(QLatin1String("stroke")) || css.contains(QLatin1String("url("));
+                colorSchemeStyle |= id == QLatin1String("current-color-scheme");
+                if (!id.isEmpty()) {
+                    record(id, Element{});
+                }
+                continue;
+            }
+
+            if (!parseTransform(attributes.value(QLatin1String("transform")), frame.transform)) {
+                frame.known = false;
+                frame.opaque = true;
+            }
+            frame.ctm = frame.transform * parent.ctm;
+
+            const QStringView stroke = property(attributes, u"stroke");
+            if (!stroke.isEmpty() && stroke != u"inherit") {
+                frame.stroked = stroke != u"none";
+            }
+            if (property(attributes, u"display") == u"none") {
+                frame.known = false;
+            }
+
+            const QStringView fill = property(attributes, u"fill");
+            if (!fill.isEmpty() && fill != u"inherit") {
+                frame.fill = fill.toString();
+            }
+            if (!stroke.isEmpty() && stroke != u"inherit") {
+                frame.strokePaint = stroke.toString();
+            }
+            if (hasInlineColor(attributes)) {
+                // currentColor isn't up to the color scheme anymore
+                frame.colorClass.clear();
+            } else if (const QString colorClass = colorSchemeClass(attributes); !colorClass.isEmpty()) {
+                frame.colorClass = colorClass;
+            }
+            if (const QStringView filter = property(attributes, u"filter"); !filter.isEmpty() && filter != u"none") {
+                // Shadows and the like have colors of their own
+                frame.monochrome = false;
+            }
+            frame.definition |= isDefinition(name);
+
+            if (!svgElement || name == u"title" || name == u"desc" || name == u"metadata") {
+                frame.known = false;
+                frame.opaque = true;
+                frame.inert = true;
+                frame.definition = true;
+            } else if (name == u"g") {
+                // The bounds are the union of the shapes inside
+            } else if (isShape(name)) {
+                QPainterPath outline;
+                if (!shapeOutline(name, attributes, outline) || frame.stroked) {
+                    frame.known = false;
+                }
+
+                // The coverage doesn't depend on the color, as long as it is the only one.
+                // No fill at all is black, no stroke at all is none.
+                auto addPaint = [&frame, &mergePaint](const QString &paint) {
+                    if (paint == u"none") {
+                        return;
+                    } else if (paint == u"currentColor" && !frame.colorClass.isEmpty()) {
+                        mergePaint(frame, frame.colorClass, true);
+                    } else {
+                        frame.monochrome = false;
+                    }
+                };
+                addPaint(frame.fill);
+                if (!frame.strokePaint.isEmpty()) {
+                    addPaint(frame.strokePaint);
+                }
+
+                // Groups are bound by each of their shapes mapped on its own, not by the union of their children
+                QTransform transform = frame.transform;
+                frame.bounds = transform.map(outline).boundingRect();
+                for (qsizetype i = stack.size() - 1; i > 0; --i) {
+                    transform = transform * stack[i].transform;
+                    if (!stack[i].id.isEmpty()) {
+                        stack[i].bounds |= transform.map(outline).boundingRect();
+                    }
+                }
+            } else {
+                frame.known = false;
+                frame.opaque = true;
+                // Text, images, <use>: there is no telling which colors they come in
+                frame.monochrome = frame.definition;
+            }
+
+            stack.append(frame);
+        } else if (token == QXmlStreamReader::EndElement) {
+            if (stack.isEmpty()) {
+                return;
+            }
+            const Frame frame = stack.takeLast();
+            const QString colorClass = frame.monochrome ? frame.paintClass : QString();
+            if (!frame.id.isEmpty()) {
+                const QTransform parentTransform = stack.isEmpty() ? QTransform() : stack.last().ctm;
+                record(frame.id, Element{frame.bounds, parentTransform.map(QPolygonF(frame.bounds)).boundingRect(), frame.known, colorClass});
+            }
+            if (stack.isEmpty()) {
+                m_documentColorClass = colorClass;
+            } else if (!frame.known && !frame.inert) {
+                stack.last().known = false;
+            }
+            if (!stack.isEmpty() && !frame.definition) {
+                mergePaint(stack.last(), frame.paintClass, frame.monochrome);
+            }
+        }
+    }
+
+    if (reader.hasError() || !stack.isEmpty()) {
+        m_elements.clear();
+        return;
+    }
+
+    if (styleHasStroke) {
+        for (Element &element : m_elements) {
+            element.known = false;
+        }
+    }
+    if (styleHasPaint || !colorSchemeStyle) {
+        for (Element &element : m_elements) {
+            element.colorClass.clear();
+        }
+        m_documentColorClass.clear();
+    }
+
+    m_valid = true;
+}
+
+SvgIndex::Ptr SvgIndex::forFile(const QString &path, uint lastModified)
+{
+    struct CachedIndex {
+        Ptr index;
+        uint lastModified;
+    };
+    static std::mutex s_lock;
+    static QCache<QString, CachedIndex> s_indexes(s_maxCachedIndexes);
+
+    {
+        std::lock_guard lock(s_lock);
+        const CachedIndex *cached = s_indexes.object(path);
+        if (cached && cached->lastModified == lastModified) {
+            return cached->index;
+        }
+    }
+
+    const QByteArray contents = SvgSource::fileContents(path);
+    if (contents.isNull()) {
+        return nullptr;
+    }
+    auto index = std::make_shared<const SvgIndex>(contents);
+
+    std::lock_guard lock(s_lock);
+    s_indexes.insert(path, new CachedIndex{index, lastModified});
+    return index;
+}
+
+bool SvgIndex::isValid() const
+{
+    return m_valid;
+}
+
+QSize SvgIndex::defaultSize() const
+{
+    return m_defaultSize;
+}
+
+SvgIndex::Lookup SvgIndex::elementRect(const QString &id, QRectF &rect) const
+{
+    if (!m_valid) {
+        return Unknown;
+    }
+
+    const auto it = m_elements.constFind(id);
+    if (it == m_elements.constEnd()) {
+        rect = QRectF();
+        return Missing;
+    } else if (!it->known) {
+        return Unknown;
+    }
+
+    rect = it->rect;
+    return Found;
+}
+
+QString SvgIndex::monochromeClass(const QString &id) const
+{
+    if (!m_valid) {
+        return QString();
+    } else if (id.isEmpty()) {
+        return m_documentColorClass;
+    }
+
+    const auto it = m_elements.constFind(id);
+    return it == m_elements.constEnd() ? QString() : it->colorClass;
+}
+
+static bool isSizeHinted(const QString &id)
+{
+    static const QRegularExpression sizeHintExpr(QStringLiteral("^\\d+-\\d+-"));
+    return sizeHintExpr.match(id).hasMatch();
+}
+
+bool SvgIndex::sizeHintsKnown() const
+{
+    if (!m_valid) {
+        return false;
+    }
+    for (auto it = m_elements.constBegin(); it != m_elements.constEnd(); ++it) {
+        if (!it->known && isSizeHinted(it.key())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QHash<QString, QRectF> SvgIndex::sizeHintedElements() const
+{
+    QHash<QString, QRectF> elements;
+    for (auto it = m_elements.constBegin(); it != m_elements.constEnd(); ++it) {
+        if (it->bounds.isValid() && isSizeHinted(it.key())) {
+            elements.insert(it.key(), it->bounds);
+        }
+    }
+    return elements;
+}
+}
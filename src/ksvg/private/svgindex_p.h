@@ -0,0 +1,82 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KSVG_SVGINDEX_P_H
+#define KSVG_SVGINDEX_P_H
+
+#include <memory>
+
+#include <QHash>
+#include <QRectF>
+#include <QSize>
+#include <QString>
+
+namespace KSvg
+{
+/*
+ * Geometry of the elements of an SVG file, worked out with a single streaming pass
+ * over the document instead of building a QSvgRenderer.
+ *
+ * Most lookups only want to know whether an element exists and where it is, like the
+ * many hint-* probes of FrameSvg. The index answers those for the plain shapes and groups
+ * themes are made of, with the same results QSvgRenderer would give. Anything it can't
+ * work out exactly (strokes, text, <use>, ...) is reported as Unknown, and the caller
+ * has to fall back to a renderer.
+ */
+class SvgIndex
+{
+public:
+    typedef std::shared_ptr<const SvgIndex> Ptr;
+
+    enum Lookup {
+        Missing,
+        Found,
+        Unknown,
+    };
+
+    explicit SvgIndex(const QByteArray &contents);
+
+    // Shared per file, rebuilt when the file changes
+    static Ptr forFile(const QString &path, uint lastModified);
+
+    bool isValid() const;
+
+    // As QSvgRenderer::defaultSize(), invalid if it can't be known without a renderer
+    QSize defaultSize() const;
+
+    // As transformForElement(id).map(boundsOnElement(id)).boundingRect()
+    Lookup elementRect(const QString &id, QRectF &rect) const;
+
+    // The elements with a size hint in their id, with their boundsOnElement(), only
+    // meaningful if all of them could be worked out
+    bool sizeHintsKnown() const;
+    QHash<QString, QRectF> sizeHintedElements() const;
+
+    /*
+     * The ColorScheme-* class, without the prefix, of the only color the element, or the
+     * whole document for an empty id, is painted with. Empty if it has other colors, or
+     * anything the index can't tell the colors of.
+     */
+    QString monochromeClass(const QString &id) const;
+
+private:
+    struct Element {
+        QRectF bounds; // in the coordinates of the parent, as boundsOnElement()
+        QRectF rect; // in document coordinates
+        bool known = false;
+        QString colorClass;
+    };
+
+    void parse(const QByteArray &contents);
+
+    QHash<QString, Element> m_elements;
+    QSize m_defaultSize;
+    QString m_documentColorClass;
+    bool m_valid = false;
+};
+}
+
+#endif
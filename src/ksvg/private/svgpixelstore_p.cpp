@@ -0,0 +1,560 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "svgpixelstore_p.h"
+#include "debug_p.h"
+#include "svgimagecodec_p.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <mutex>
+
+#include <QFile>
+#include <QHash>
+#include <QLockFile>
+#include <QSaveFile>
+
+#if defined(Q_OS_LINUX) || defined(Q_OS_FREEBSD)
+#include <fcntl.h>
+#endif
+
+namespace KSvg
+{
+const quint32 SvgPixelStore::s_magic = 0x4b535650; // "KSVP"
+const quint32 SvgPixelStore::s_version = 4;
+
+static const size_t s_seed = 0x9e3779b9;
+// Roughly the size of an icon, for the table to fill up along with the data
+static const qint64 s_bytesPerEntry = 4096;
+static const quint32 s_minEntryCapacity = 1024;
+// Every image starts on a cache line
+static const quint64 s_alignment = 64;
+// Frame backgrounds and the like, icons stay uncompressed to be used right out of the mapping
+static const qsizetype s_minCompressedBytes = 64 * 1024;
+// How much of a full store moves over to the new file, the most recently used images first
+static const int s_keptFraction = 2;
+
+enum SlotState : quint32 {
+    EmptySlot = 0,
+    WritingSlot,
+    ImageSlot,
+    CompressedImageSlot,
+    DataSlot,
+    RemovedSlot,
+};
+
+struct SvgPixelStore::Header {
+    quint32 magic;
+    quint32 version;
+    quint32 entryCapacity;
+    quint32 entryCount;
+    // Set once the file has been replaced by a new one, everybody still mapping it has to reopen
+    quint32 superseded;
+    // Ticks on every lookup and insert, for the entries to tell which ones were used last
+    quint32 useClock;
+    quint64 dataCapacity;
+    quint64 dataUsed;
+    qint64 lastModified;
+    quint64 padding[2];
+};
+
+struct SvgPixelStore::Entry {
+    quint64 key;
+    // Of the bytes, from the start of the data
+    quint64 offset;
+    quint64 size;
+    quint32 state;
+    // QImage::Format_Invalid for anything which isn't an image
+    quint32 format;
+    quint32 width;
+    quint32 height;
+    quint32 bytesPerLine;
+    // The useClock when it was last looked up or inserted
+    quint32 lastUsed;
+    // Set on the images as they are made, changing it afterwards would copy them. A double as
+    // in QImage, for setting the same ratio again not to change it, which would copy them too
+    double devicePixelRatio;
+};
+
+struct SvgPixelStore::Mapping {
+    ~Mapping()
+    {
+        if (data) {
+            file.unmap(data);
+        }
+    }
+
+    QFile file;
+    uchar *data = nullptr;
+    qint64 size = 0;
+};
+
+template<typename T>
+static T loadAcquire(T &value)
+{
+    return std::atomic_ref<T>(value).load(std::memory_order_acquire);
+}
+
+template<typename T>
+static void storeRelease(T &value, T newValue)
+{
+    std::atomic_ref<T>(value).store(newValue, std::memory_order_release);
+}
+
+static bool claimSlot(quint32 &state)
+{
+    quint32 expected = EmptySlot;
+    return std::atomic_ref<quint32>(state).compare_exchange_strong(expected, WritingSlot, std::memory_order_acq_rel);
+}
+
+static quint64 alignedSize(quint64 size)
+{
+    return (size + s_alignment - 1) & ~(s_alignment - 1);
+}
+
+// Writing to a page of a sparse file the disk has no room for raises SIGBUS in every process mapping
+// it, so all of it is allocated up front
+static bool preallocate(QSaveFile &file, qint64 size)
+{
+    if (!file.flush()) {
+        return false;
+    }
+#if defined(Q_OS_LINUX) || defined(Q_OS_FREEBSD)
+    return posix_fallocate(file.handle(), 0, size) == 0;
+#else
+    static const QByteArray zeros(1024 * 1024, '\0');
+    for (qint64 pos = file.pos(); pos < size; pos += zeros.size()) {
+        if (file.write(zeros.constData(), std::min<qint64>(zeros.size(), size - pos)) < 0) {
+            return false;
+        }
+    }
+    return file.flush();
+#endif
+}
+
+static bool isFull(quint32 count, quint32 capacity)
+{
+    return quint64(count) * 4 >= quint64(capacity) * 3;
+}
+
+static bool isLive(quint32 state)
+{
+    return state == ImageSlot || state == CompressedImageSlot || state == DataSlot;
+}
+
+static bool isStoredFormat(quint32 format)
+{
+    return format == QImage::Format_ARGB32_Premultiplied || format == QImage::Format_Alpha8;
+}
+
+SvgPixelStore::SvgPixelStore(const QString &fileName, qint64 dataCapacity)
+    : m_fileName(fileName)
+    , m_dataCapacity(dataCapacity)
+{
+    static_assert(sizeof(Header) == 64 && sizeof(Entry) == 56, "The on-disk layout must not depend on the platform");
+
+    bool ok = false;
+    const int compression = qEnvironmentVariableIntValue("KSVG_CACHE_COMPRESSION", &ok);
+    m_compress = !ok || compression != 0;
+
+    // Missing, written by another version or damaged: start over
+    if (!open() && !rebuild(false)) {
+        qCWarning(LOG_KSVG) << "Could not open the pixel cache" << m_fileName;
+    }
+}
+
+SvgPixelStore::~SvgPixelStore()
+{
+    close();
+}
+
+bool SvgPixelStore::isValid() const
+{
+    return bool(m_mapping);
+}
+
+SvgPixelStore::Header *SvgPixelStore::header() const
+{
+    return reinterpret_cast<Header *>(m_mapping->data);
+}
+
+SvgPixelStore::Entry *SvgPixelStore::entries() const
+{
+    return reinterpret_cast<Entry *>(m_mapping->data + sizeof(Header));
+}
+
+uchar *SvgPixelStore::data() const
+{
+    // sizeof(Entry) times a power of two of at least s_minEntryCapacity is a whole number of cache lines
+    return reinterpret_cast<uchar *>(entries() + header()->entryCapacity);
+}
+
+bool SvgPixelStore::open()
+{
+    if (!QFile::exists(m_fileName)) {
+        return false;
+    }
+
+    auto mapping = std::make_shared<Mapping>();
+    mapping->file.setFileName(m_fileName);
+    if (!mapping->file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+
+    mapping->size = mapping->file.size();
+    if (mapping->size < qint64(sizeof(Header))) {
+        return false;
+    }
+
+    mapping->data = mapping->file.map(0, mapping->size);
+    if (!mapping->data) {
+        return false;
+    }
+
+    const Header *h = reinterpret_cast<const Header *>(mapping->data);
+    const qint64 expectedSize = sizeof(Header) + qint64(h->entryCapacity) * sizeof(Entry) + qint64(h->dataCapacity);
+    if (h->magic != s_magic || h->version != s_version || mapping->size != expectedSize //
+        || h->entryCapacity < s_minEntryCapacity || !std::has_single_bit(h->entryCapacity)) {
+        return false;
+    }
+
+    m_mapping = std::move(mapping);
+    return true;
+}
+
+void SvgPixelStore::close()
+{
+    // Unmapped once the last image pointing into it is gone
+    std::lock_guard imagesLock(m_imagesLock);
+    m_images.clear();
+    m_mapping.reset();
+}
+
+bool SvgPixelStore::lockCurrent(std::shared_lock<std::shared_mutex> &lock)
+{
+    lock = std::shared_lock(m_lock);
+    if (!m_mapping) {
+        return false;
+    } else if (!loadAcquire(header()->superseded)) {
+        return true;
+    }
+
+    // Another process replaced the file, follow it to the new one
+    lock.unlock();
+    {
+        std::unique_lock exclusive(m_lock);
+        if (m_mapping && loadAcquire(header()->superseded)) {
+            close();
+            if (!open()) {
+                qCWarning(LOG_KSVG) << "Could not reopen the pixel cache" << m_fileName;
+            }
+        }
+    }
+    lock.lock();
+    return bool(m_mapping);
+}
+
+bool SvgPixelStore::rebuild(bool keepEntries)
+{
+    // Only one process at a time gets to replace the file, or they would start over twice
+    QLockFile lockFile(m_fileName + QLatin1String(".lock"));
+    if (!lockFile.tryLock(2000)) {
+        qCWarning(LOG_KSVG) << "Could not lock the pixel cache" << m_fileName << lockFile.error();
+        return false;
+    }
+
+    // Somebody else may have been faster, in which case their file is as good as ours would be
+    if (m_mapping ? loadAcquire(header()->superseded) : open()) {
+        close();
+        return open();
+    }
+
+    const quint32 entryCapacity = std::bit_ceil(quint32(std::clamp<qint64>(m_dataCapacity / s_bytesPerEntry, s_minEntryCapacity, 1 << 24)));
+    QByteArray buffer(sizeof(Header) + qsizetype(entryCapacity) * sizeof(Entry), '\0');
+
+    Header *newHeader = reinterpret_cast<Header *>(buffer.data());
+    newHeader->magic = s_magic;
+    newHeader->version = s_version;
+    newHeader->entryCapacity = entryCapacity;
+    newHeader->dataCapacity = m_dataCapacity;
+    newHeader->lastModified = QDateTime::currentSecsSinceEpoch();
+    Entry *newEntries = reinterpret_cast<Entry *>(buffer.data() + sizeof(Header));
+
+    // Rather than throwing every image of every process away, the most recently used ones
+    // move over to the new file, up to a part of it for the others to make room. Their
+    // pixels are never written over: images handed out of the old file keep it mapped
+    QList<const Entry *> kept;
+    if (keepEntries && m_mapping) {
+        Header *h = header();
+        const quint32 useClock = loadAcquire(h->useClock);
+        QList<std::pair<quint32, const Entry *>> live;
+        for (quint32 i = 0; i < h->entryCapacity; ++i) {
+            Entry &entry = entries()[i];
+            if (isLive(loadAcquire(entry.state)) && entry.offset <= h->dataCapacity && entry.size <= h->dataCapacity - entry.offset) {
+                // Counted back from the clock, which may have wrapped around
+                live.emplaceBack(useClock - loadAcquire(entry.lastUsed), &entry);
+            }
+        }
+        std::sort(live.begin(), live.end(), [](const auto &a, const auto &b) {
+            return a.first < b.first;
+        });
+
+        const quint32 mask = entryCapacity - 1;
+        for (const auto &[age, entry] : std::as_const(live)) {
+            const quint64 size = alignedSize(entry->size);
+            if (newHeader->dataUsed + size > m_dataCapacity / s_keptFraction || isFull(newHeader->entryCount * s_keptFraction, entryCapacity)) {
+                break;
+            }
+            quint32 slot = entry->key & mask;
+            while (newEntries[slot].state != EmptySlot && newEntries[slot].key != entry->key) {
+                slot = (slot + 1) & mask;
+            }
+            // An image being inserted again, the more recent one wins
+            if (newEntries[slot].state != EmptySlot) {
+                continue;
+            }
+            newEntries[slot] = *entry;
+            newEntries[slot].offset = newHeader->dataUsed;
+            // In the same order, counting back from a clock starting over
+            newEntries[slot].lastUsed = quint32(0) - newHeader->entryCount;
+            newEntries[slot].state = loadAcquire(entry->state);
+            newHeader->dataUsed += size;
+            ++newHeader->entryCount;
+            kept << entry;
+        }
+    }
+
+    QSaveFile file(m_fileName);
+    bool written = file.open(QIODevice::WriteOnly) && file.write(buffer) == buffer.size();
+    for (const Entry *entry : std::as_const(kept)) {
+        const QByteArray padding(alignedSize(entry->size) - entry->size, '\0');
+        written = written && file.write(reinterpret_cast<const char *>(data() + entry->offset), entry->size) == qint64(entry->size)
+            && file.write(padding) == padding.size();
+    }
+    if (!written || !preallocate(file, buffer.size() + m_dataCapacity) || !file.commit()) {
+        // Without it the store isn't used at all rather than risking to crash every process mapping it
+        qCWarning(LOG_KSVG) << "Could not write the pixel cache" << m_fileName << file.errorString();
+        return false;
+    }
+
+    if (m_mapping) {
+        storeRelease(header()->superseded, quint32(1));
+        close();
+    }
+    return open();
+}
+
+void SvgPixelStore::clear()
+{
+    std::unique_lock lock(m_lock);
+    rebuild(false);
+}
+
+const SvgPixelStore::Entry *SvgPixelStore::findEntry(quint64 key, quint32 &state) const
+{
+    Header *h = header();
+    const quint32 mask = h->entryCapacity - 1;
+    for (quint32 i = key & mask, probes = 0; probes <= mask; i = (i + 1) & mask, ++probes) {
+        Entry &entry = entries()[i];
+        state = loadAcquire(entry.state);
+        if (state == EmptySlot) {
+            return nullptr;
+        } else if (isLive(state) && entry.key == key) {
+            // Don't trust a damaged file to point within the mapping
+            if (entry.offset > h->dataCapacity || entry.size > h->dataCapacity - entry.offset) {
+                return nullptr;
+            }
+            const quint32 now = std::atomic_ref<quint32>(h->useClock).fetch_add(1, std::memory_order_relaxed) + 1;
+            std::atomic_ref<quint32>(entry.lastUsed).store(now, std::memory_order_relaxed);
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+SvgPixelStore::Entry *SvgPixelStore::reserveEntry(quint64 key, quint64 size, Entry *&previous)
+{
+    Header *h = header();
+    if (isFull(loadAcquire(h->entryCount), h->entryCapacity)) {
+        return nullptr;
+    }
+
+    // A slot first, so that running out of them doesn't lose any bytes
+    previous = nullptr;
+    Entry *claimed = nullptr;
+    const quint32 mask = h->entryCapacity - 1;
+    for (quint32 i = key & mask, probes = 0; probes <= mask && !claimed; i = (i + 1) & mask, ++probes) {
+        Entry &entry = entries()[i];
+        const quint32 state = loadAcquire(entry.state);
+        if (isLive(state) && entry.key == key) {
+            previous = &entry;
+        } else if (state == EmptySlot) {
+            if (claimSlot(entry.state)) {
+                std::atomic_ref<quint32>(h->entryCount).fetch_add(1, std::memory_order_relaxed);
+                claimed = &entry;
+            } else {
+                // Someone else got it first, see what they put there
+                i = (i - 1) & mask;
+                --probes;
+            }
+        }
+    }
+    if (!claimed) {
+        return nullptr;
+    }
+
+    const quint64 aligned = alignedSize(size);
+    std::atomic_ref<quint64> dataUsed(h->dataUsed);
+    quint64 offset = dataUsed.load(std::memory_order_acquire);
+    do {
+        if (offset + aligned > h->dataCapacity) {
+            // Left for the next rebuild to drop
+            claimed->key = key;
+            storeRelease(claimed->state, quint32(RemovedSlot));
+            return nullptr;
+        }
+    } while (!dataUsed.compare_exchange_weak(offset, offset + aligned, std::memory_order_acq_rel));
+
+    claimed->key = key;
+    claimed->offset = offset;
+    claimed->size = size;
+    return claimed;
+}
+
+bool SvgPixelStore::insertBytes(quint64 key, quint32 state, const QImage &layout, const void *bytes, quint64 size)
+{
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        const Mapping *full = nullptr;
+        {
+            std::shared_lock<std::shared_mutex> lock;
+            if (!lockCurrent(lock)) {
+                return false;
+            }
+            // Making room for a single huge image would throw away too much else
+            if (size > header()->dataCapacity / 4) {
+                return false;
+            }
+
+            Entry *previous = nullptr;
+            if (Entry *entry = reserveEntry(key, size, previous)) {
+                std::memcpy(data() + entry->offset, bytes, size);
+                entry->format = layout.format();
+                entry->width = layout.width();
+                entry->height = layout.height();
+                entry->bytesPerLine = layout.bytesPerLine();
+                entry->devicePixelRatio = layout.devicePixelRatio();
+                entry->lastUsed = std::atomic_ref<quint32>(header()->useClock).fetch_add(1, std::memory_order_relaxed) + 1;
+                storeRelease(header()->lastModified, QDateTime::currentSecsSinceEpoch());
+                storeRelease(entry->state, state);
+                // Retired only now, lookups find either one until then. Its pixels may still be in
+                // use, so the new ones went next to them rather than over them
+                if (previous) {
+                    quint32 previousState = loadAcquire(previous->state);
+                    if (isLive(previousState) && previous->key == key) {
+                        std::atomic_ref<quint32>(previous->state).compare_exchange_strong(previousState, RemovedSlot, std::memory_order_acq_rel);
+                    }
+                }
+                return true;
+            }
+            full = m_mapping.get();
+        }
+
+        // Another thread may have made room in the meantime
+        std::unique_lock lock(m_lock);
+        if (m_mapping.get() == full && !rebuild(true)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+QImage SvgPixelStore::findImage(const QString &key)
+{
+    std::shared_lock<std::shared_mutex> lock;
+    if (!lockCurrent(lock)) {
+        return QImage();
+    }
+
+    const quint64 hash = qHash(key, s_seed);
+    quint32 state = EmptySlot;
+    const Entry *entry = findEntry(hash, state);
+    if (!entry || !isStoredFormat(entry->format)) {
+        return QImage();
+    } else if (state == CompressedImageSlot) {
+        // Decoded anew on every lookup, whoever draws something that big keeps it around, as frames do
+        QImage image = SvgImageCodec::decode(data() + entry->offset, entry->size, QSize(entry->width, entry->height));
+        image.setDevicePixelRatio(entry->devicePixelRatio);
+        return image;
+    } else if (state != ImageSlot || quint64(entry->bytesPerLine) * entry->height > entry->size) {
+        return QImage();
+    }
+
+    // The same image as long as the entry is there, so that textures keyed on its cacheKey() are shared
+    const uchar *pixels = data() + entry->offset;
+    std::lock_guard imagesLock(m_imagesLock);
+    QImage &image = m_images[hash];
+    if (image.constBits() != pixels) {
+        // The image holds on to the mapping, which outlives the store if it has to
+        QImageCleanupFunction release = [](void *mapping) {
+            delete static_cast<std::shared_ptr<Mapping> *>(mapping);
+        };
+        // Read-only, so that painting on it detaches rather than writes to the file
+        image = QImage(pixels, entry->width, entry->height, entry->bytesPerLine, QImage::Format(entry->format), release, new std::shared_ptr<Mapping>(m_mapping));
+        image.setDevicePixelRatio(entry->devicePixelRatio);
+    }
+    return image;
+}
+
+bool SvgPixelStore::insertImage(const QString &key, const QImage &image)
+{
+    if (image.isNull()) {
+        return false;
+    }
+
+    const QImage pixels = isStoredFormat(image.format()) ? image : image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    const quint64 hash = qHash(key, s_seed);
+    if (m_compress && pixels.format() == QImage::Format_ARGB32_Premultiplied && pixels.sizeInBytes() >= s_minCompressedBytes) {
+        // Only worth decoding on every lookup if it saves a good part of the budget
+        const QByteArray encoded = SvgImageCodec::encode(pixels, pixels.sizeInBytes() * 3 / 4);
+        if (!encoded.isEmpty()) {
+            return insertBytes(hash, CompressedImageSlot, pixels, encoded.constData(), encoded.size());
+        }
+    }
+    return insertBytes(hash, ImageSlot, pixels, pixels.constBits(), pixels.sizeInBytes());
+}
+
+bool SvgPixelStore::find(const QString &key, QByteArray &bytes)
+{
+    std::shared_lock<std::shared_mutex> lock;
+    if (!lockCurrent(lock)) {
+        return false;
+    }
+
+    quint32 state = EmptySlot;
+    const Entry *entry = findEntry(qHash(key, s_seed), state);
+    if (!entry || state != DataSlot) {
+        return false;
+    }
+    bytes = QByteArray(reinterpret_cast<const char *>(data() + entry->offset), entry->size);
+    return true;
+}
+
+bool SvgPixelStore::insert(const QString &key, const QByteArray &bytes)
+{
+    return insertBytes(qHash(key, s_seed), DataSlot, QImage(), bytes.constData(), bytes.size());
+}
+
+QDateTime SvgPixelStore::lastModifiedTime()
+{
+    std::shared_lock<std::shared_mutex> lock;
+    if (!lockCurrent(lock)) {
+        return QDateTime();
+    }
+    return QDateTime::fromSecsSinceEpoch(loadAcquire(header()->lastModified));
+}
+}
@@ -0,0 +1,121 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KSVG_SVGPIXELSTORE_P_H
+#define KSVG_SVGPIXELSTORE_P_H
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QImage>
+#include <QString>
+
+#include <ksvg/ksvg_export.h>
+
+namespace KSvg
+{
+/*
+ * Persistent store of rendered images, shared by every process using the same theme.
+ *
+ * This replaces KImageCache, which handed out a copy of every image it found, converted
+ * into a new pixmap. The store keeps images as their raw scanlines in a memory mapped
+ * file, so that a lookup is a QImage pointing right into the mapping, and whatever
+ * draws or uploads it as a texture reads the pixels where they already are:
+ *
+ *   Header
+ *   Entry[entryCapacity]   open addressing table of the keys, with the size and format of each image
+ *   data[dataCapacity]     scanlines, appended one image after another
+ *
+ * Images in other formats are converted to Format_ARGB32_Premultiplied on the way in.
+ * Entries are claimed with an atomic compare and swap and published once their pixels
+ * are written, so that several processes can insert into the same mapping. Pixels are
+ * never written over: an image inserted again under the same key is appended and the
+ * old entry flagged as removed. Once either part is full the store moves to a new file with
+ * the most recently used entries only, up to half of it, which is how it evicts. clear()
+ * starts over with an empty one. The old header is then flagged as superseded so that every
+ * other process reopens the new file on its next access. New files are allocated in full
+ * up front: writing to a page of a sparse one the disk has no room for would crash every
+ * process mapping it, the store is rather not used when that fails.
+ *
+ * Big images are compressed with SvgImageCodec when that saves at least a quarter of
+ * their size, for frame backgrounds not to push out dozens of icons each. Those are
+ * decoded on every lookup rather than used in place, everything else stays zero copy.
+ * Compression can be turned off by setting KSVG_CACHE_COMPRESSION to 0.
+ *
+ * Images found in the store keep the mapping they point into alive, so they stay valid
+ * after the store has moved to another file or has been destroyed. They carry the device
+ * pixel ratio they were inserted with, as setting it on a shared image copies its pixels.
+ */
+class KSVG_AUTOTEST_EXPORT SvgPixelStore
+{
+public:
+    SvgPixelStore(const QString &fileName, qint64 dataCapacity);
+    ~SvgPixelStore();
+
+    bool isValid() const;
+
+    // A read-only image on the mapped pixels, a null one if key isn't in the store. As long as
+    // the entry is there, the same image is handed back for it every time
+    QImage findImage(const QString &key);
+    // Only Format_ARGB32_Premultiplied and Format_Alpha8 images are stored
+    bool insertImage(const QString &key, const QImage &image);
+
+    // Any other data, copied out
+    bool find(const QString &key, QByteArray &data);
+    bool insert(const QString &key, const QByteArray &data);
+
+    // When something was last inserted, by any process
+    QDateTime lastModifiedTime();
+
+    // Starts over with an empty file
+    void clear();
+
+    static const quint32 s_magic;
+    static const quint32 s_version;
+
+private:
+    Q_DISABLE_COPY(SvgPixelStore)
+
+    struct Header;
+    struct Entry;
+    struct Mapping;
+
+    bool open();
+    void close();
+    bool lockCurrent(std::shared_lock<std::shared_mutex> &lock);
+    // Replaces the file with a new one, with the most recently used entries of the current one
+    // if keepEntries, and leaves the store opened on it
+    bool rebuild(bool keepEntries);
+
+    Header *header() const;
+    Entry *entries() const;
+    uchar *data() const;
+
+    // With the lock held
+    const Entry *findEntry(quint64 key, quint32 &state) const;
+    // Claims an entry for size bytes, to be published by the caller once written, after which
+    // it retires previous, the entry key had until then if any
+    Entry *reserveEntry(quint64 key, quint64 size, Entry *&previous);
+    // With the format, size and device pixel ratio of layout, a null one for data
+    bool insertBytes(quint64 key, quint32 state, const QImage &layout, const void *bytes, quint64 size);
+
+    QString m_fileName;
+    qint64 m_dataCapacity;
+    bool m_compress;
+    // Shared with the images pointing into it
+    std::shared_ptr<Mapping> m_mapping;
+    std::shared_mutex m_lock;
+    // The images handed out of the current mapping
+    std::mutex m_imagesLock;
+    QHash<quint64, QImage> m_images;
+};
+}
+
+#endif
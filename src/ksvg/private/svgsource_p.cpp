@@ -0,0 +1,280 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "svgsource_p.h"
+
+#include <mutex>
+
+#include <QByteArrayView>
+#include <QCache>
+#include <QDateTime>
+#include <QFileInfo>
+
+#include <KCompressionDevice>
+
+namespace KSvg
+{
+// One per stylesheet variant being created at a time is all that is needed
+static const int s_maxCachedSources = 16;
+// Decompressed theme files are mostly a few tens of KiB
+static const qsizetype s_maxCachedContentsBytes = 8 * 1024 * 1024;
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Ids like 48-48-foo, whose geometry says at which size the foo element should be used
+static bool isSizeHinted(QByteArrayView id)
+{
+    qsizetype i = 0;
+    for (int part = 0; part < 2; ++part) {
+        const qsizetype start = i;
+        while (i < id.size() && id[i] >= '0' && id[i] <= '9') {
+            ++i;
+        }
+        if (i == start || i >= id.size() || id[i] != '-') {
+            return false;
+        }
+        ++i;
+    }
+    return true;
+}
+
+SvgSource::SvgSource(const QByteArray &contents)
+    : m_contents(contents)
+{
+    scan();
+}
+
+void SvgSource::scan()
+{
+    const QByteArrayView data(m_contents);
+    const qsizetype size = data.size();
+
+    qsizetype pos = 0;
+    while ((pos = data.indexOf('<', pos)) >= 0) {
+        const QByteArrayView markup = data.sliced(pos);
+
+        // Nothing in comments, character data or declarations counts
+        if (markup.startsWith("<!--")) {
+            const qsizetype end = data.indexOf("-->", pos + 4);
+            if (end < 0) {
+                return;
+            }
+            pos = end + 3;
+            continue;
+        } else if (markup.startsWith("<![CDATA[")) {
+            const qsizetype end = data.indexOf("]]>", pos + 9);
+            if (end < 0) {
+                return;
+            }
+            pos = end + 3;
+            continue;
+        } else if (markup.startsWith("<?")) {
+            const qsizetype end = data.indexOf("?>", pos + 2);
+            if (end < 0) {
+                return;
+            }
+            pos = end + 2;
+            continue;
+        } else if (markup.startsWith("<!")) {
+            // A doctype, which may have an internal subset with '>' in it
+            int depth = 0;
+            qsizetype i = pos + 2;
+            for (; i < size && (data[i] != '>' || depth > 0); ++i) {
+                if (data[i] == '[') {
+                    ++depth;
+                } else if (data[i] == ']') {
+                    --depth;
+                } else if (data[i] == '"' || data[i] == '\'') {
+                    const qsizetype quoteEnd = data.indexOf(data[i], i + 1);
+                    if (quoteEnd < 0) {
+                        return;
+                    }
+                    i = quoteEnd;
+                }
+            }
+            pos = i + 1;
+            continue;
+        } else if (markup.startsWith("</")) {
+            pos += 2;
+            continue;
+        }
+
+        qsizetype i = pos + 1;
+        while (i < size && !isSpace(data[i]) && data[i] != '>' && data[i] != '/') {
+            ++i;
+        }
+        const QByteArrayView name = data.sliced(pos + 1, i - pos - 1);
+
+        QByteArrayView id;
+        bool selfClosing = false;
+        while (true) {
+            while (i < size && isSpace(data[i])) {
+                ++i;
+            }
+            if (i >= size) {
+                return;
+            } else if (data[i] == '>') {
+                ++i;
+                break;
+            } else if (data[i] == '/' && i + 1 < size && data[i + 1] == '>') {
+                selfClosing = true;
+                i += 2;
+                break;
+            }
+
+            const qsizetype attributeStart = i;
+            while (i < size && !isSpace(data[i]) && data[i] != '=' && data[i] != '>' && data[i] != '/') {
+                ++i;
+            }
+            const QByteArrayView attribute = data.sliced(attributeStart, i - attributeStart);
+            while (i < size && isSpace(data[i])) {
+                ++i;
+            }
+            if (i >= size || data[i] != '=') {
+                if (i == attributeStart) {
+                    // Not well formed, leave it to the parser to complain
+                    ++i;
+                }
+                continue;
+            }
+            ++i;
+            while (i < size && isSpace(data[i])) {
+                ++i;
+            }
+            if (i >= size || (data[i] != '"' && data[i] != '\'')) {
+                return;
+            }
+            const qsizetype valueEnd = data.indexOf(data[i], i + 1);
+            if (valueEnd < 0) {
+                return;
+            }
+            if (attribute == "id") {
+                id = data.sliced(i + 1, valueEnd - i - 1);
+            }
+            i = valueEnd + 1;
+        }
+
+        if (isSizeHinted(id)) {
+            m_sizeHintedIds << QString::fromUtf8(id);
+        }
+
+        if (m_styleStart < 0 && name == "style" && id == "current-color-scheme") {
+            if (selfClosing) {
+                m_styleStart = i - 2;
+                m_styleEnd = i;
+                m_styleSelfClosing = true;
+            } else {
+                const qsizetype end = data.indexOf("</style", i);
+                if (end >= 0) {
+                    m_styleStart = i;
+                    m_styleEnd = end;
+                    i = end;
+                }
+            }
+        }
+
+        pos = i;
+    }
+}
+
+SvgSource::Ptr SvgSource::forFile(const QString &path)
+{
+    struct CachedSource {
+        Ptr source;
+        QDateTime lastModified;
+    };
+    static std::mutex s_lock;
+    static QCache<QString, CachedSource> s_sources(s_maxCachedSources);
+
+    const QDateTime lastModified = QFileInfo(path).lastModified();
+    {
+        std::lock_guard lock(s_lock);
+        const CachedSource *cached = s_sources.object(path);
+        if (cached && cached->lastModified == lastModified) {
+            return cached->source;
+        }
+    }
+
+    const QByteArray contents = fileContents(path);
+    if (contents.isNull()) {
+        return nullptr;
+    }
+    auto source = std::make_shared<const SvgSource>(contents);
+
+    std::lock_guard lock(s_lock);
+    s_sources.insert(path, new CachedSource{source, lastModified});
+    return source;
+}
+
+QByteArray SvgSource::fileContents(const QString &path)
+{
+    struct CachedContents {
+        QByteArray contents;
+        QDateTime lastModified;
+    };
+    static std::mutex s_lock;
+    static QCache<QString, CachedContents> s_contents(s_maxCachedContentsBytes);
+
+    const QDateTime lastModified = QFileInfo(path).lastModified();
+    {
+        std::lock_guard lock(s_lock);
+        const CachedContents *cached = s_contents.object(path);
+        if (cached && cached->lastModified == lastModified) {
+            return cached->contents;
+        }
+    }
+
+    // Decompress outside of the lock, other threads may want different files meanwhile
+    KCompressionDevice file(path, KCompressionDevice::GZip);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    QByteArray contents = file.readAll();
+    if (contents.isNull()) {
+        contents = QByteArray("");
+    }
+
+    std::lock_guard lock(s_lock);
+    s_contents.insert(path, new CachedContents{contents, lastModified}, contents.size());
+    return contents;
+}
+
+QByteArray SvgSource::contents() const
+{
+    return m_contents;
+}
+
+QByteArray SvgSource::withStyleSheet(const QString &styleSheet) const
+{
+    if (styleSheet.isEmpty() || m_styleStart < 0) {
+        return m_contents;
+    }
+
+    const QByteArray css = styleSheet.toHtmlEscaped().toUtf8();
+    const QByteArrayView contents(m_contents);
+
+    QByteArray result;
+    result.reserve(contents.size() - (m_styleEnd - m_styleStart) + css.size() + 9);
+    result.append(contents.first(m_styleStart));
+    if (m_styleSelfClosing) {
+        result.append('>');
+    }
+    result.append(css);
+    if (m_styleSelfClosing) {
+        result.append("</style>");
+    }
+    result.append(contents.sliced(m_styleEnd));
+    return result;
+}
+
+QStringList SvgSource::sizeHintedIds() const
+{
+    return m_sizeHintedIds;
+}
+}
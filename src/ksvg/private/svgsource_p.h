@@ -0,0 +1,64 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KSVG_SVGSOURCE_P_H
+#define KSVG_SVGSOURCE_P_H
+
+#include <memory>
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+namespace KSvg
+{
+/*
+ * The contents of an SVG file, scanned once for what SharedSvgRenderer needs to know
+ * before parsing it: where the contents of <style id="current-color-scheme"> are, and
+ * which ids carry a size hint.
+ *
+ * Every stylesheet variant of the file is then a single splice of the new CSS between
+ * the bytes before and after that style block, rather than a re-serialization of the
+ * whole document.
+ */
+class SvgSource
+{
+public:
+    typedef std::shared_ptr<const SvgSource> Ptr;
+
+    explicit SvgSource(const QByteArray &contents);
+
+    // Shared per file, scanned again when the file changes
+    static Ptr forFile(const QString &path);
+
+    /*
+     * The decompressed contents of a file. Themes ask for the same files over and over,
+     * for every color set and status, so the most recent ones are kept in memory up to a
+     * fixed budget and only read again if the file changed on disk.
+     */
+    static QByteArray fileContents(const QString &path);
+
+    QByteArray contents() const;
+
+    // The contents with the color scheme style block replaced by styleSheet
+    QByteArray withStyleSheet(const QString &styleSheet) const;
+
+    QStringList sizeHintedIds() const;
+
+private:
+    void scan();
+
+    QByteArray m_contents;
+    QStringList m_sizeHintedIds;
+    // Range of the contents of the color scheme style block, -1 if there isn't one
+    qsizetype m_styleStart = -1;
+    qsizetype m_styleEnd = -1;
+    // A self closing <style/> has to be opened and closed around the new contents
+    bool m_styleSelfClosing = false;
+};
+}
+
+#endif
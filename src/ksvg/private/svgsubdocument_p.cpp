@@ -0,0 +1,241 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "svgsubdocument_p.h"
+#include "svgsource_p.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include <QCache>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QSet>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+
+namespace KSvg
+{
+// Only the tables of the files elements are being cut out of right now are needed
+static const int s_maxCachedDocuments = 8;
+// Below that parsing the whole file costs about as much as scanning it for a subdocument
+static const qsizetype s_minLargeFileBytes = 64 * 1024;
+
+// The ids in url(#id) and #id references of an attribute value
+static void collectReferences(QStringView name, QStringView value, QStringList &references)
+{
+    if (name == u"href" || name.endsWith(u":href")) {
+        if (value.startsWith(u'#')) {
+            references << value.sliced(1).trimmed().toString();
+        }
+        return;
+    }
+
+    qsizetype pos = 0;
+    while ((pos = value.indexOf(u"url(", pos)) >= 0) {
+        pos += 4;
+        const qsizetype end = value.indexOf(u')', pos);
+        if (end < 0) {
+            return;
+        }
+        QStringView reference = value.sliced(pos, end - pos).trimmed();
+        if (reference.size() > 1 && (reference.front() == u'"' || reference.front() == u'\'')) {
+            reference = reference.sliced(1, reference.size() - 2).trimmed();
+        }
+        if (reference.startsWith(u'#')) {
+            references << reference.sliced(1).toString();
+        }
+        pos = end;
+    }
+}
+
+SvgSubDocuments::SvgSubDocuments(const QByteArray &contents)
+    : m_contents(contents)
+{
+    scan();
+}
+
+SvgSubDocuments::Ptr SvgSubDocuments::forFile(const QString &path)
+{
+    struct CachedDocuments {
+        Ptr documents;
+        QDateTime lastModified;
+    };
+    static std::mutex s_lock;
+    static QCache<QString, CachedDocuments> s_documents(s_maxCachedDocuments);
+
+    const QDateTime lastModified = QFileInfo(path).lastModified();
+    {
+        std::lock_guard lock(s_lock);
+        const CachedDocuments *cached = s_documents.object(path);
+        if (cached && cached->lastModified == lastModified) {
+            return cached->documents;
+        }
+    }
+
+    const QByteArray contents = SvgSource::fileContents(path);
+    if (contents.isNull()) {
+        return nullptr;
+    }
+    auto documents = std::make_shared<const SvgSubDocuments>(contents);
+
+    std::lock_guard lock(s_lock);
+    s_documents.insert(path, new CachedDocuments{documents, lastModified});
+    return documents;
+}
+
+void SvgSubDocuments::scan()
+{
+    QXmlStreamReader reader(m_contents);
+    // Written back as they are, prefixes included
+    reader.setNamespaceProcessing(false);
+
+    QList<int> stack;
+    while (!reader.atEnd()) {
+        const QXmlStreamReader::TokenType token = reader.readNext();
+        if (token == QXmlStreamReader::StartElement) {
+            const int index = m_nodes.size();
+            Node node{.parent = stack.isEmpty() ? -1 : stack.last(), .end = index, .references = {}};
+
+            const QXmlStreamAttributes attributes = reader.attributes();
+            for (const QXmlStreamAttribute &attribute : attributes) {
+                const QStringView name = attribute.qualifiedName();
+                if (name == u"id") {
+                    m_ids.insert(attribute.value().toString(), index);
+                } else {
+                    collectReferences(name, attribute.value(), node.references);
+                }
+            }
+            if (reader.qualifiedName() == u"style") {
+                m_styles << index;
+            }
+
+            m_nodes << node;
+            stack << index;
+        } else if (token == QXmlStreamReader::EndElement && !stack.isEmpty()) {
+            m_nodes[stack.takeLast()].end = m_nodes.size() - 1;
+        }
+    }
+
+    m_valid = !reader.hasError() && !m_nodes.isEmpty();
+}
+
+bool SvgSubDocuments::isLarge() const
+{
+    return m_valid && m_contents.size() >= s_minLargeFileBytes;
+}
+
+QByteArray SvgSubDocuments::extract(const QString &elementId) const
+{
+    return extract(QStringList{elementId});
+}
+
+QByteArray SvgSubDocuments::extract(const QStringList &elementIds) const
+{
+    if (!m_valid) {
+        return QByteArray();
+    }
+
+    QSet<int> included;
+    QSet<int> shells;
+    QList<int> pending;
+    auto include = [&](int node) {
+        if (node >= 0 && !included.contains(node)) {
+            included.insert(node);
+            pending << node;
+        }
+    };
+    for (const QString &elementId : elementIds) {
+        const int target = m_ids.value(elementId, -1);
+        // The root element is the whole document
+        if (target > 0) {
+            include(target);
+        }
+    }
+    if (included.isEmpty()) {
+        return QByteArray();
+    }
+    for (int style : m_styles) {
+        include(style);
+    }
+
+    // The elements and what they reference, transitively
+    while (!pending.isEmpty()) {
+        const int node = pending.takeLast();
+        for (int i = node; i <= m_nodes[node].end; ++i) {
+            for (const QString &reference : m_nodes[i].references) {
+                include(m_ids.value(reference, -1));
+            }
+        }
+        // Their ancestors are kept too, and with them the clip paths, masks, filters or
+        // paint servers they apply to them
+        for (int parent = m_nodes[node].parent; parent >= 0 && !shells.contains(parent); parent = m_nodes[parent].parent) {
+            shells.insert(parent);
+            for (const QString &reference : m_nodes[parent].references) {
+                include(m_ids.value(reference, -1));
+            }
+        }
+    }
+
+    enum Keep : char {
+        Skip,
+        // Only the element, for the children which are kept
+        Shell,
+        Copy,
+    };
+    QList<Keep> keep(m_nodes.size(), Skip);
+    for (int node : std::as_const(included)) {
+        std::fill(keep.begin() + node, keep.begin() + m_nodes[node].end + 1, Copy);
+    }
+    for (int node : std::as_const(shells)) {
+        if (keep[node] == Skip) {
+            keep[node] = Shell;
+        }
+    }
+
+    QByteArray subDocument;
+    QXmlStreamWriter writer(&subDocument);
+    QXmlStreamReader reader(m_contents);
+    reader.setNamespaceProcessing(false);
+
+    int index = -1;
+    QList<Keep> open;
+    while (!reader.atEnd()) {
+        const QXmlStreamReader::TokenType token = reader.readNext();
+        switch (token) {
+        case QXmlStreamReader::StartElement:
+            ++index;
+            if (keep[index] == Skip) {
+                reader.skipCurrentElement();
+                index = m_nodes[index].end;
+                continue;
+            }
+            open << keep[index];
+            writer.writeCurrentToken(reader);
+            break;
+        case QXmlStreamReader::EndElement:
+            open.removeLast();
+            writer.writeCurrentToken(reader);
+            break;
+        case QXmlStreamReader::StartDocument:
+        case QXmlStreamReader::EndDocument:
+        case QXmlStreamReader::DTD:
+            writer.writeCurrentToken(reader);
+            break;
+        case QXmlStreamReader::Invalid:
+            return QByteArray();
+        default:
+            // Text and the like only in what is copied whole
+            if (!open.isEmpty() && open.last() == Copy) {
+                writer.writeCurrentToken(reader);
+            }
+            break;
+        }
+    }
+
+    return subDocument;
+}
+}
@@ -0,0 +1,67 @@
+/*
+    SPDX-FileCopyrightText: 2026 KSvg contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KSVG_SVGSUBDOCUMENT_P_H
+#define KSVG_SVGSUBDOCUMENT_P_H
+
+#include <memory>
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+namespace KSvg
+{
+/*
+ * Cuts single elements out of an SVG file, as split-plasma-svgs does, so that drawing
+ * one arrow of a theme file with hundreds of elements only parses and keeps that arrow.
+ *
+ * A subdocument has the root element of the file, the ancestors of the element without
+ * their other children, so that its transform and coordinates are the same as in the
+ * file, the element itself, everything it references, and the style blocks.
+ */
+class SvgSubDocuments
+{
+public:
+    typedef std::shared_ptr<const SvgSubDocuments> Ptr;
+
+    explicit SvgSubDocuments(const QByteArray &contents);
+
+    // Shared per file, scanned again when the file changes
+    static Ptr forFile(const QString &path);
+
+    // Whether the file is large enough for subdocuments to be worth it over parsing it whole
+    bool isLarge() const;
+
+    // The subdocument of elementId, a null array if there is no such element
+    QByteArray extract(const QString &elementId) const;
+    // The subdocument of all of elementIds, for drawing them in a single pass, a null array if
+    // there is none of them
+    QByteArray extract(const QStringList &elementIds) const;
+
+private:
+    void scan();
+
+    // Elements in document order
+    struct Node {
+        int parent;
+        // The last of the descendants
+        int end;
+        // Ids referenced by the attributes of the element
+        QStringList references;
+    };
+
+    QByteArray m_contents;
+    QList<Node> m_nodes;
+    QHash<QString, int> m_ids;
+    QList<int> m_styles;
+    bool m_valid = false;
+};
+}
+
+#endif
@@ -9,34 +9,44 @@
 #include "framesvg.h"
 #include "private/imageset_p.h"
 #include "private/svg_p.h"
+#include "private/svgcoverage_p.h"
+#include "private/svgelementkey_p.h"
+#include "private/svgindex_p.h"
+#include "private/svgsource_p.h"
+#include "private/svgsubdocument_p.h"
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <mutex>
 
-#include <QBuffer>
 #include <QCoreApplication>
 #include <QDir>
+#include <QFile>
+#include <QMetaEnum>
 #include <QPainter>
+#include <QPromise>
 #include <QRegularExpression>
+#include <QStandardPaths>
 #include <QStringBuilder>
-#include <QXmlStreamReader>
-#include <QXmlStreamWriter>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
 
-#include <KCompressionDevice>
 #include <KConfigGroup>
 #include <QDebug>
 
 #include "debug_p.h"
 #include "imageset.h"
 
-size_t qHash(const KSvg::SvgPrivate::CacheId &id, size_t seed)
+// With the hashes of the strings passed along, for SvgPrivate::cacheIdHash() not to hash them over and over
+static std::array<size_t, 10> cacheIdParts(const KSvg::SvgPrivate::CacheId &id, size_t elementNameHash, size_t filePathHash)
 {
-    std::array<size_t, 10> parts = {
+    return {
         ::qHash(id.width),
         ::qHash(id.height),
-        ::qHash(id.elementName),
-        ::qHash(id.filePath),
+        elementNameHash,
+        filePathHash,
         ::qHash(id.status),
         ::qHash(id.scaleFactor),
         ::qHash(id.colorSet),
@@ -44,6 +54,11 @@ size_t qHash(const KSvg::SvgPrivate::CacheId &id, size_t seed)
         ::qHash(id.extraFlags),
         ::qHash(id.lastModified),
     };
+}
+
+size_t qHash(const KSvg::SvgPrivate::CacheId &id, size_t seed)
+{
+    const std::array<size_t, 10> parts = cacheIdParts(id, ::qHash(id.elementName), ::qHash(id.filePath));
     return qHashRange(parts.begin(), parts.end(), seed);
 }
 
@@ -69,8 +84,42 @@ public:
 
 Q_GLOBAL_STATIC(SvgRectsCacheSingleton, privateSvgRectsCacheSelf)
 
+class SvgRendererManagerSingleton
+{
+public:
+    SvgRendererManager self;
+};
+
+Q_GLOBAL_STATIC(SvgRendererManagerSingleton, privateSvgRendererManagerSelf)
+
 const size_t SvgRectsCache::s_seed = 0x9e3779b9;
 
+// The tree QSvgRenderer builds takes a few times the size of the document it was parsed from
+static const qint64 s_rendererCostFactor = 4;
+static const qint64 s_defaultRendererBudget = 16 * 1024 * 1024;
+static const std::chrono::milliseconds s_defaultRendererIdleTimeout = std::chrono::seconds(30);
+
+static std::atomic<quint64> s_rendererUseCount = 0;
+
+// Renderers are shared per file and stylesheet, with the checksum of the latter as the key prefix
+static QChar styleSheetChecksum(const QString &styleSheet)
+{
+    return qChecksum(QByteArrayView(styleSheet.toUtf8().constData(), styleSheet.size()));
+}
+
+// Draws elementId, or the whole document, over the size pixels of painter
+static void renderElement(QPainter *painter, QSvgRenderer *renderer, const QString &elementId, const QSize &size)
+{
+    // don't alter the pixmap size or it won't match up properly to, e.g., FrameSvg elements
+    // makeUniform should never change the size so much that it gains or loses a whole pixel
+    const QRectF finalRect = SvgPrivate::makeUniform(renderer->boundsOnElement(elementId), QRect(QPoint(0, 0), size));
+    if (elementId.isEmpty()) {
+        renderer->render(painter, finalRect);
+    } else {
+        renderer->render(painter, elementId, finalRect);
+    }
+}
+
 SharedSvgRenderer::SharedSvgRenderer(QObject *parent)
     : QSvgRenderer(parent)
 {
@@ -79,80 +128,84 @@ SharedSvgRenderer::SharedSvgRenderer(QObject *parent)
 SharedSvgRenderer::SharedSvgRenderer(const QString &filename, const QString &styleSheet, QHash<QString, QRectF> &interestingElements, QObject *parent)
     : QSvgRenderer(parent)
 {
-    KCompressionDevice file(filename, KCompressionDevice::GZip);
-    if (!file.open(QIODevice::ReadOnly)) {
+    const SvgSource::Ptr source = SvgSource::forFile(filename);
+    if (!source) {
         return;
     }
     m_filename = filename;
     m_styleSheet = styleSheet;
     m_interestingElements = interestingElements;
-    load(file.readAll(), styleSheet, interestingElements);
+    load(*source, styleSheet, interestingElements);
 }
 
 SharedSvgRenderer::SharedSvgRenderer(const QByteArray &contents, const QString &styleSheet, QHash<QString, QRectF> &interestingElements, QObject *parent)
     : QSvgRenderer(parent)
 {
-    load(contents, styleSheet, interestingElements);
+    load(SvgSource(contents), styleSheet, interestingElements);
+}
+
+SharedSvgRenderer::SharedSvgRenderer(const QString &filename,
+                                     const QString &elementId,
+                                     const QString &styleSheet,
+                                     QHash<QString, QRectF> &interestingElements,
+                                     QObject *parent)
+    : QSvgRenderer(parent)
+{
+    const SvgSubDocuments::Ptr documents = SvgSubDocuments::forFile(filename);
+    if (!documents) {
+        return;
+    }
+    m_filename = filename;
+    m_elementId = elementId;
+    m_styleSheet = styleSheet;
+    m_interestingElements = interestingElements;
+    load(SvgSource(documents->extract(elementId)), styleSheet, interestingElements);
 }
 
 void SharedSvgRenderer::reload()
 {
-    KCompressionDevice file(m_filename, KCompressionDevice::GZip);
-    if (!file.open(QIODevice::ReadOnly)) {
+    if (!m_elementId.isEmpty()) {
+        const SvgSubDocuments::Ptr documents = SvgSubDocuments::forFile(m_filename);
+        if (documents) {
+            load(SvgSource(documents->extract(m_elementId)), m_styleSheet, m_interestingElements);
+        }
         return;
     }
 
-    load(file.readAll(), m_styleSheet, m_interestingElements);
+    const SvgSource::Ptr source = SvgSource::forFile(m_filename);
+    if (!source) {
+        return;
+    }
+
+    load(*source, m_styleSheet, m_interestingElements);
+}
+
+qint64 SharedSvgRenderer::cost() const
+{
+    return m_cost;
 }
 
-bool SharedSvgRenderer::load(const QByteArray &contents, const QString &styleSheet, QHash<QString, QRectF> &interestingElements)
+void SharedSvgRenderer::touch()
+{
+    m_lastUsed.store(s_rendererUseCount.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+quint64 SharedSvgRenderer::lastUsed() const
+{
+    return m_lastUsed.load(std::memory_order_relaxed);
+}
+
+bool SharedSvgRenderer::load(const SvgSource &source, const QString &styleSheet, QHash<QString, QRectF> &interestingElements)
 {
     // Apply the style sheet.
-    if (!styleSheet.isEmpty() && contents.contains("current-color-scheme")) {
-        QByteArray processedContents;
-        processedContents.reserve(contents.size());
-        QXmlStreamReader reader(contents);
-
-        QBuffer buffer(&processedContents);
-        buffer.open(QIODevice::WriteOnly);
-        QXmlStreamWriter writer(&buffer);
-        bool foundStyleSheet = false;
-        while (!reader.atEnd()) {
-            reader.readNext();
-            if (!foundStyleSheet //
-                && reader.tokenType() == QXmlStreamReader::StartElement //
-                && reader.qualifiedName() == QLatin1String("style")
-                && reader.attributes().value(QLatin1String("id")) == QLatin1String("current-color-scheme")) {
-                writer.writeStartElement(QLatin1String("style"));
-                writer.writeAttributes(reader.attributes());
-                writer.writeCharacters(styleSheet);
-                writer.writeEndElement();
-                while (reader.tokenType() != QXmlStreamReader::EndElement) {
-                    reader.readNext();
-                }
-                foundStyleSheet = true;
-            } else if (reader.tokenType() != QXmlStreamReader::Invalid && !reader.isWhitespace() && !reader.isComment()) {
-                writer.writeCurrentToken(reader);
-            }
-        }
-        buffer.close();
-        if (!QSvgRenderer::load(processedContents)) {
-            return false;
-        }
-    } else if (!QSvgRenderer::load(contents)) {
+    if (!QSvgRenderer::load(source.withStyleSheet(styleSheet))) {
         return false;
     }
+    m_cost = source.contents().size() * s_rendererCostFactor;
 
-    // Search the SVG to find and store all ids that contain size hints.
-    const QString contentsAsString(QString::fromLatin1(contents));
-    static const QRegularExpression idExpr(QLatin1String("id\\s*?=\\s*?(['\"])(\\d+?-\\d+?-.*?)\\1"));
-    Q_ASSERT(idExpr.isValid());
-
-    auto matchIt = idExpr.globalMatch(contentsAsString);
-    while (matchIt.hasNext()) {
-        auto match = matchIt.next();
-        QString elementId = match.captured(2);
-
+    // Store the geometry of all ids that contain size hints.
+    const QStringList sizeHintedIds = source.sizeHintedIds();
+    for (const QString &elementId : sizeHintedIds) {
         QRectF elementRect = boundsOnElement(elementId);
         if (elementRect.isValid()) {
             interestingElements.insert(elementId, elementRect);
@@ -162,25 +215,152 @@ bool SharedSvgRenderer::load(const QByteArray &contents, const QString &styleShe
     return true;
 }
 
-SvgRectsCache::SvgRectsCache(QObject *parent)
+SvgRendererManager::SvgRendererManager(QObject *parent)
     : QObject(parent)
+    , m_budget(s_defaultRendererBudget)
+    , m_idleTimer(new QTimer(this))
 {
-    const QString svgElementsFile = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QLatin1Char('/') + QStringLiteral("ksvg-elements");
-    m_svgElementsCache = KSharedConfig::openConfig(svgElementsFile, KConfig::SimpleConfig);
+    bool ok = false;
+    const int budgetKiB = qEnvironmentVariableIntValue("KSVG_RENDERER_CACHE_SIZE", &ok);
+    if (ok && budgetKiB >= 0) {
+        m_budget = qint64(budgetKiB) * 1024;
+    }
 
-    m_configSyncTimer = new QTimer(this);
-    m_configSyncTimer->setSingleShot(true);
-    m_configSyncTimer->setInterval(5000);
-    connect(m_configSyncTimer, &QTimer::timeout, this, [this]() {
-        m_svgElementsCache->sync();
+    // Watched Svgs are the ones living on the GUI thread, only released from there
+    if (qGuiApp) {
+        moveToThread(qGuiApp->thread());
+    }
+    m_idleTimer->setInterval(s_defaultRendererIdleTimeout);
+    connect(m_idleTimer, &QTimer::timeout, this, &SvgRendererManager::releaseIdle);
+}
+
+SvgRendererManager *SvgRendererManager::instance()
+{
+    if (privateSvgRendererManagerSelf.isDestroyed()) {
+        return nullptr;
+    }
+    return &privateSvgRendererManagerSelf()->self;
+}
+
+qint64 SvgRendererManager::budget() const
+{
+    return m_budget;
+}
+
+void SvgRendererManager::setBudget(qint64 bytes)
+{
+    m_budget = bytes;
+    trim();
+}
+
+std::chrono::milliseconds SvgRendererManager::idleTimeout() const
+{
+    return m_idleTimer->intervalAsDuration();
+}
+
+void SvgRendererManager::setIdleTimeout(std::chrono::milliseconds timeout)
+{
+    QMetaObject::invokeMethod(m_idleTimer, [this, timeout]() {
+        m_idleTimer->setInterval(timeout);
     });
 }
 
+void SvgRendererManager::watch(SvgPrivate *svg)
+{
+    std::lock_guard lock(m_watchedLock);
+    if (m_watched.isEmpty()) {
+        // This may be the render thread, the timer belongs to the GUI one
+        QMetaObject::invokeMethod(m_idleTimer, qOverload<>(&QTimer::start));
+    }
+    m_watched.insert(svg);
+}
+
+void SvgRendererManager::unwatch(SvgPrivate *svg)
+{
+    std::lock_guard lock(m_watchedLock);
+    m_watched.remove(svg);
+}
+
+void SvgRendererManager::trim()
+{
+    // Declared before the lock so that the renderers get deleted after it is released
+    QList<SharedSvgRenderer::Ptr> evicted;
+
+    std::unique_lock lock(SvgPrivate::s_renderersLock);
+
+    qint64 cost = 0;
+    QList<std::pair<quint64, QString>> unused;
+    for (auto it = SvgPrivate::s_renderers.constBegin(); it != SvgPrivate::s_renderers.constEnd(); ++it) {
+        cost += it.value()->cost();
+        // Only the cache references it
+        if (it.value()->ref.loadRelaxed() == 1) {
+            unused.emplaceBack(it.value()->lastUsed(), it.key());
+        }
+    }
+
+    const qint64 budget = m_budget;
+    if (cost <= budget) {
+        return;
+    }
+
+    std::sort(unused.begin(), unused.end());
+    for (const auto &[lastUsed, key] : std::as_const(unused)) {
+        if (cost <= budget) {
+            break;
+        }
+        SharedSvgRenderer::Ptr renderer = SvgPrivate::s_renderers.take(key);
+        cost -= renderer->cost();
+        evicted << renderer;
+    }
+}
+
+void SvgRendererManager::releaseIdle()
+{
+    QList<SvgPrivate *> idle;
+    {
+        std::lock_guard lock(m_watchedLock);
+        for (SvgPrivate *svg : std::as_const(m_watched)) {
+            if (!svg->rendererUsed.exchange(false, std::memory_order_relaxed)) {
+                idle << svg;
+            }
+        }
+    }
+
+    // They are all on this thread, nothing can draw with them meanwhile
+    for (SvgPrivate *svg : std::as_const(idle)) {
+        svg->eraseRenderer();
+    }
+
+    std::lock_guard lock(m_watchedLock);
+    if (m_watched.isEmpty()) {
+        m_idleTimer->stop();
+    }
+}
+
+SvgRectsCache::SvgRectsCache(QObject *parent)
+    : QObject(parent)
+{
+    const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+    QDir().mkpath(cacheDir);
+
+    // The text based cache used by older versions, superseded by the binary store
+    QFile::remove(cacheDir + QLatin1String("/ksvg-elements"));
+
+    m_store = std::make_unique<SvgElementsStore>(cacheDir + QLatin1String("/ksvg-elements.bin"));
+}
+
+SvgRectsCache::~SvgRectsCache() = default;
+
 SvgRectsCache *SvgRectsCache::instance()
 {
     return &privateSvgRectsCacheSelf()->self;
 }
 
+quint64 SvgRectsCache::pathHash(QStringView path)
+{
+    return qHash(path, s_seed);
+}
+
 void SvgRectsCache::insert(KSvg::SvgPrivate::CacheId cacheId, const QRectF &rect, unsigned int lastModified)
 {
     insert(qHash(cacheId, SvgRectsCache::s_seed), cacheId.filePath, rect, lastModified);
@@ -188,28 +368,18 @@ void SvgRectsCache::insert(KSvg::SvgPrivate::CacheId cacheId, const QRectF &rect
 
 void SvgRectsCache::insert(size_t id, const QString &filePath, const QRectF &rect, unsigned int lastModified)
 {
-    const unsigned int savedTime = lastModifiedTimeFromCache(filePath);
+    const quint64 pathId = pathHash(filePath);
+    const unsigned int savedTime = m_store->lastModified(pathId);
 
-    if (savedTime == lastModified && m_localRectCache.contains(id)) {
+    QRectF existing;
+    if (savedTime == lastModified && m_store->findRect(id, existing)) {
         return;
     }
 
-    m_localRectCache.insert(id, rect);
-
-    KConfigGroup imageGroup(m_svgElementsCache, filePath);
-
-    if (rect.isValid()) {
-        imageGroup.writeEntry(QString::number(id), rect);
-    } else {
-        m_invalidElements[filePath] << id;
-        imageGroup.writeEntry("Invalidelements", m_invalidElements[filePath].values());
-    }
-
-    QMetaObject::invokeMethod(m_configSyncTimer, qOverload<>(&QTimer::start));
+    m_store->insertRect(id, pathId, rect);
 
     if (savedTime != lastModified) {
-        m_lastModifiedTimes[filePath] = lastModified;
-        imageGroup.writeEntry("LastModified", lastModified);
+        m_store->setLastModified(pathId, lastModified);
         Q_EMIT lastModifiedChanged(filePath, lastModified);
     }
 }
@@ -221,103 +391,61 @@ bool SvgRectsCache::findElementRect(KSvg::SvgPrivate::CacheId cacheId, QRectF &r
 
 bool SvgRectsCache::findElementRect(size_t id, QStringView filePath, QRectF &rect)
 {
-    auto it = m_localRectCache.find(id);
+    Q_UNUSED(filePath)
 
-    if (it == m_localRectCache.end()) {
-        auto elements = m_invalidElements.value(filePath.toString());
-        if (elements.contains(id)) {
-            rect = QRectF();
-            return true;
-        }
+    if (!m_store->findRect(id, rect)) {
         return false;
     }
 
-    rect = *it;
-
+    // Missing elements are cached too, so that they aren't looked for again
+    if (!rect.isValid()) {
+        rect = QRectF();
+    }
     return true;
 }
 
+QList<bool> SvgRectsCache::findElementRects(const QList<quint64> &ids, QList<QRectF> &rects)
+{
+    QList<bool> found = m_store->findRects(ids, rects);
+    for (QRectF &rect : rects) {
+        if (!rect.isValid()) {
+            rect = QRectF();
+        }
+    }
+    return found;
+}
+
 bool SvgRectsCache::loadImageFromCache(const QString &path, uint lastModified)
 {
     if (path.isEmpty()) {
         return false;
     }
 
-    KConfigGroup imageGroup(m_svgElementsCache, path);
-
-    unsigned int savedTime = lastModifiedTimeFromCache(path);
+    const quint64 pathId = pathHash(path);
 
     // Reload even if is older, to support downgrades
-    if (lastModified != savedTime) {
-        imageGroup.deleteGroup();
-        QMetaObject::invokeMethod(m_configSyncTimer, qOverload<>(&QTimer::start));
+    if (lastModified != m_store->lastModified(pathId)) {
+        m_store->dropFile(pathId);
         return false;
     }
 
-    auto &elements = m_invalidElements[path];
-    if (elements.isEmpty()) {
-        auto list = imageGroup.readEntry("Invalidelements", QList<unsigned int>());
-        m_invalidElements[path] = QSet<unsigned int>(list.begin(), list.end());
-
-        for (const auto &key : imageGroup.keyList()) {
-            bool ok = false;
-            uint keyUInt = key.toUInt(&ok);
-            if (ok) {
-                const QRectF rect = imageGroup.readEntry(key, QRectF());
-                m_localRectCache.insert(keyUInt, rect);
-            }
-        }
-    }
+    // Nothing to load, lookups go straight to the mapped store
     return true;
 }
 
 void SvgRectsCache::dropImageFromCache(const QString &path)
 {
-    KConfigGroup imageGroup(m_svgElementsCache, path);
-    imageGroup.deleteGroup();
-    QMetaObject::invokeMethod(m_configSyncTimer, qOverload<>(&QTimer::start));
+    m_store->dropFile(pathHash(path));
 }
 
 QList<QSizeF> SvgRectsCache::sizeHintsForId(const QString &path, const QString &id)
 {
-    const QString pathId = path % id;
-
-    auto it = m_sizeHintsForId.constFind(pathId);
-    if (it == m_sizeHintsForId.constEnd()) {
-        KConfigGroup imageGroup(m_svgElementsCache, path);
-        const QStringList &encoded = imageGroup.readEntry(id, QStringList());
-        QList<QSizeF> sizes;
-        for (const auto &token : encoded) {
-            const auto &parts = token.split(QLatin1Char('x'));
-            if (parts.size() != 2) {
-                continue;
-            }
-            QSize size = QSize(parts[0].toDouble(), parts[1].toDouble());
-            if (!size.isEmpty()) {
-                sizes << size;
-            }
-        }
-        m_sizeHintsForId[pathId] = sizes;
-        return sizes;
-    }
-
-    return *it;
+    return m_store->sizeHints(qHashMulti(s_seed, path, id));
 }
 
 void SvgRectsCache::insertSizeHintForId(const QString &path, const QString &id, const QSizeF &size)
 {
-    // TODO: need to make this more efficient
-    auto sizeListToString = [](const QList<QSizeF> &list) {
-        QString ret;
-        for (const auto &s : list) {
-            ret += QString::number(s.width()) % QLatin1Char('x') % QString::number(s.height()) % QLatin1Char(',');
-        }
-        return ret;
-    };
-    m_sizeHintsForId[path % id].append(size);
-    KConfigGroup imageGroup(m_svgElementsCache, path);
-    imageGroup.writeEntry(id, sizeListToString(m_sizeHintsForId[path % id]));
-    QMetaObject::invokeMethod(m_configSyncTimer, qOverload<>(&QTimer::start));
+    m_store->insertSizeHint(qHashMulti(s_seed, path, id), pathHash(path), size);
 }
 
 QString SvgRectsCache::iconThemePath()
@@ -326,7 +454,7 @@ QString SvgRectsCache::iconThemePath()
         return m_iconThemePath;
     }
 
-    KConfigGroup imageGroup(m_svgElementsCache, QStringLiteral("General"));
+    KConfigGroup imageGroup(settings(), QStringLiteral("General"));
     m_iconThemePath = imageGroup.readEntry(QStringLiteral("IconThemePath"), QString());
 
     return m_iconThemePath;
@@ -335,64 +463,53 @@ QString SvgRectsCache::iconThemePath()
 void SvgRectsCache::setIconThemePath(const QString &path)
 {
     m_iconThemePath = path;
-    KConfigGroup imageGroup(m_svgElementsCache, QStringLiteral("General"));
+    KConfigGroup imageGroup(settings(), QStringLiteral("General"));
     imageGroup.writeEntry(QStringLiteral("IconThemePath"), path);
-    QMetaObject::invokeMethod(m_configSyncTimer, qOverload<>(&QTimer::start));
+    imageGroup.sync();
 }
 
-void SvgRectsCache::setNaturalSize(const QString &path, const QSizeF &size)
+KSharedConfigPtr SvgRectsCache::settings()
 {
-    KConfigGroup imageGroup(m_svgElementsCache, path);
+    if (!m_settings) {
+        const QString settingsFile = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QLatin1String("/ksvg-settings");
+        m_settings = KSharedConfig::openConfig(settingsFile, KConfig::SimpleConfig);
+    }
+    return m_settings;
+}
 
-    // FIXME: needs something faster, perhaps even sprintf
-    imageGroup.writeEntry(QStringLiteral("NaturalSize"), size);
-    QMetaObject::invokeMethod(m_configSyncTimer, qOverload<>(&QTimer::start));
+void SvgRectsCache::setNaturalSize(const QString &path, const QSizeF &size)
+{
+    m_store->setNaturalSize(pathHash(path), size);
 }
 
 QSizeF SvgRectsCache::naturalSize(const QString &path)
 {
-    KConfigGroup imageGroup(m_svgElementsCache, path);
-
-    // FIXME: needs something faster, perhaps even sprintf
-    return imageGroup.readEntry(QStringLiteral("NaturalSize"), QSizeF());
+    return m_store->naturalSize(pathHash(path));
 }
 
 QStringList SvgRectsCache::cachedKeysForPath(const QString &path) const
 {
-    KConfigGroup imageGroup(m_svgElementsCache, path);
-    QStringList list = imageGroup.keyList();
-    QStringList filtered;
-
-    std::copy_if(list.begin(), list.end(), std::back_inserter(filtered), [](const QString element) {
-        bool ok;
-        element.toLong(&ok);
-        return ok;
-    });
-    return filtered;
+    const QList<quint64> keys = m_store->rectKeysForFile(pathHash(path));
+    QStringList list;
+    list.reserve(keys.size());
+    for (quint64 key : keys) {
+        list << QString::number(key);
+    }
+    return list;
 }
 
 unsigned int SvgRectsCache::lastModifiedTimeFromCache(const QString &filePath)
 {
-    const auto &i = m_lastModifiedTimes.constFind(filePath);
-    if (i != m_lastModifiedTimes.constEnd()) {
-        return i.value();
-    }
-
-    KConfigGroup imageGroup(m_svgElementsCache, filePath);
-    const unsigned int savedTime = imageGroup.readEntry("LastModified", 0);
-    m_lastModifiedTimes[filePath] = savedTime;
-    return savedTime;
+    return m_store->lastModified(pathHash(filePath));
 }
 
 void SvgRectsCache::updateLastModified(const QString &filePath, unsigned int lastModified)
 {
-    KConfigGroup imageGroup(m_svgElementsCache, filePath);
-    const unsigned int savedTime = lastModifiedTimeFromCache(filePath);
+    const quint64 pathId = pathHash(filePath);
+    const unsigned int savedTime = m_store->lastModified(pathId);
 
     if (savedTime != lastModified) {
-        m_lastModifiedTimes[filePath] = lastModified;
-        imageGroup.writeEntry("LastModified", lastModified);
-        QMetaObject::invokeMethod(m_configSyncTimer, qOverload<>(&QTimer::start));
+        m_store->setLastModified(pathId, lastModified);
         Q_EMIT lastModifiedChanged(filePath, lastModified);
     }
 }
@@ -435,6 +552,21 @@ SvgPrivate::CacheId SvgPrivate::cacheId(QStringView elementId) const
     return CacheId{idSize.width(), idSize.height(), path, elementId.toString(), status, devicePixelRatio, -1, 0, 0, lastModified};
 }
 
+size_t SvgPrivate::cacheIdHash(size_t elementNameHash) const
+{
+    // cacheId() without the strings, which are already hashed
+    const auto idSize = size.isValid() && size != naturalSize ? size : QSizeF{-1.0, -1.0};
+    const CacheId id{idSize.width(), idSize.height(), QString(), QString(), status, devicePixelRatio, -1, 0, 0, lastModified};
+    const std::array<size_t, 10> parts = cacheIdParts(id, elementNameHash, pathHash);
+    return qHashRange(parts.begin(), parts.end(), SvgRectsCache::s_seed);
+}
+
+void SvgPrivate::setPath(const QString &newPath)
+{
+    path = newPath;
+    pathHash = ::qHash(path);
+}
+
 // This function is meant for the pixmap cache
 QString SvgPrivate::cachePath(const QString &id, const QSize &size) const
 {
@@ -485,7 +617,7 @@ bool SvgPrivate::setImagePath(const QString &imagePath)
     QObject::disconnect(imageSetChangedConnection);
 
     themed = isThemed;
-    path.clear();
+    setPath(QString());
     themePath.clear();
 
     bool oldfromCurrentImageSet = fromCurrentImageSet;
@@ -497,7 +629,7 @@ bool SvgPrivate::setImagePath(const QString &imagePath)
 
     if (themed) {
         themePath = actualPath;
-        path = actualImageSet()->imagePath(themePath);
+        setPath(actualImageSet()->imagePath(themePath));
         themeFailed = path.isEmpty();
         imageSetChangedConnection = QObject::connect(actualImageSet(), &ImageSet::imageSetChanged, q, [this]() {
             imageSetChanged();
@@ -506,7 +638,7 @@ bool SvgPrivate::setImagePath(const QString &imagePath)
         imageSetChangedConnection = QObject::connect(actualImageSet(), &ImageSet::imageSetChanged, q, [this]() {
             imageSetChanged();
         });
-        path = actualPath;
+        setPath(actualPath);
     } else {
 #ifndef NDEBUG
         // qCDebug(LOG_KSVG) << "file '" << path << "' does not exist!";
@@ -531,6 +663,15 @@ bool SvgPrivate::setImagePath(const QString &imagePath)
                 }
                 i++;
             }
+
+            if (s_threadRenderers.hasLocalData()) {
+                const QHash<QString, SharedSvgRenderer::Ptr> &threadRenderers = s_threadRenderers.localData();
+                for (auto it = threadRenderers.constBegin(); it != threadRenderers.constEnd(); ++it) {
+                    if (it.key().contains(path)) {
+                        it.value()->reload();
+                    }
+                }
+            }
         }
     }
 
@@ -539,8 +680,10 @@ bool SvgPrivate::setImagePath(const QString &imagePath)
     if ((themed && !path.isEmpty() && lastModifiedDate.isValid()) || QFileInfo::exists(actualPath)) {
         naturalSize = SvgRectsCache::instance()->naturalSize(path);
         if (naturalSize.isEmpty()) {
-            createRenderer();
-            naturalSize = renderer->defaultSize();
+            if (!loadFromIndex()) {
+                createRenderer();
+                naturalSize = renderer->defaultSize();
+            }
             SvgRectsCache::instance()->setNaturalSize(path, naturalSize);
         }
     }
@@ -560,11 +703,8 @@ ImageSet *SvgPrivate::actualImageSet()
     return theme.data();
 }
 
-QPixmap SvgPrivate::findInCache(const QString &elementId, qreal ratio, const QSizeF &s)
+bool SvgPrivate::resolveElement(const QString &elementId, qreal ratio, const QSizeF &s, QString &actualElementId, QSize &size)
 {
-    QSize size;
-    QString actualElementId;
-
     // Look at the size hinted elements and try to find the smallest one with an
     // identical aspect ratio.
     if (s.isValid() && !elementId.isEmpty()) {
@@ -596,57 +736,404 @@ QPixmap SvgPrivate::findInCache(const QString &elementId, qreal ratio, const QSi
         size = elementRect(actualElementId).size().toSize() * ratio;
     }
 
-    if (size.isEmpty()) {
-        return QPixmap();
+    return !size.isEmpty();
+}
+
+QPixmap SvgPrivate::findInCache(const QString &elementId, qreal ratio, const QSizeF &s)
+{
+    return QPixmap::fromImage(findImageInCache(elementId, ratio, s));
+}
+
+QImage SvgPrivate::findImageInCache(const QString &elementId, qreal ratio, const QSizeF &s)
+{
+    QSize size;
+    QString actualElementId;
+    if (!resolveElement(elementId, ratio, s, actualElementId, size)) {
+        return QImage();
     }
 
     const QString id = cachePath(actualElementId, size);
 
-    QPixmap p;
-    if (cacheRendering && lastModified == SvgRectsCache::instance()->lastModifiedTimeFromCache(path) && actualImageSet()->d->findInCache(id, p, lastModified)) {
-        p.setDevicePixelRatio(ratio);
-        // qCDebug(LOG_PLASMA) << "found cached version of " << id << p.size();
-        return p;
+    QImage image;
+    if (cacheRendering && lastModified == SvgRectsCache::instance()->lastModifiedTimeFromCache(path) && actualImageSet()->d->findInCache(id, image, lastModified)) {
+        image.setDevicePixelRatio(ratio);
+        // qCDebug(LOG_PLASMA) << "found cached version of " << id << image.size();
+        return image;
     }
 
-    createRenderer();
+    QString colorClass;
+    QColor color;
+    if (monochromeColor(actualElementId, colorClass, color)) {
+        // No need for a renderer with this palette's stylesheet, the shape is the same for all of them
+        image = SvgCoverage::tint(coverageImage(actualElementId, colorClass, size, ratio), color);
+    } else {
+        // The renderer of the whole file if there is one already, there is nothing to save then
+        SharedSvgRenderer::Ptr elementRenderer = renderer;
+        if (!elementRenderer && rendersSubDocuments(actualElementId)) {
+            elementRenderer = cachedRenderer(currentStyleSheet(), actualElementId);
+        }
+        if (!elementRenderer) {
+            createRenderer();
+            elementRenderer = renderer;
+        }
 
-    QRectF finalRect = makeUniform(renderer->boundsOnElement(actualElementId), QRect(QPoint(0, 0), size));
+        image = QImage(size, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+        QPainter renderPainter(&image);
+        renderElement(&renderPainter, elementRenderer.data(), actualElementId, size);
+        renderPainter.end();
+    }
+    image.setDevicePixelRatio(ratio);
 
-    // don't alter the pixmap size or it won't match up properly to, e.g., FrameSvg elements
-    // makeUniform should never change the size so much that it gains or loses a whole pixel
-    p = QPixmap(size);
+    if (cacheRendering) {
+        actualImageSet()->d->insertIntoCache(id, image, QString::number((qint64)q, 16) % QLatin1Char('_') % actualElementId);
+    }
+
+    SvgRectsCache::instance()->updateLastModified(path, lastModified);
 
-    p.fill(Qt::transparent);
-    QPainter renderPainter(&p);
+    return image;
+}
 
-    if (actualElementId.isEmpty()) {
-        renderer->render(&renderPainter, finalRect);
-    } else {
-        renderer->render(&renderPainter, actualElementId, finalRect);
+// The renderers imageAsync() jobs left on a pool thread, keyed with the modification time of
+// the file, are kept for the next jobs only as long as those of all pool threads together fit
+// in the renderer budget. The least recently used ones, which those of older versions of the
+// files end up being, go first. What is left goes along with the thread once it expires
+static void trimJobRenderers(QHash<QString, SharedSvgRenderer::Ptr> &renderers)
+{
+    const SvgRendererManager *manager = SvgRendererManager::instance();
+    const qint64 budget = manager ? manager->budget() / std::max(1, QThreadPool::globalInstance()->maxThreadCount()) : 0;
+
+    qint64 cost = 0;
+    QList<std::pair<quint64, QString>> unused;
+    for (auto it = renderers.constBegin(); it != renderers.constEnd(); ++it) {
+        // Those Svgs living on this thread hold are up to them
+        if (it.value()->ref.loadRelaxed() == 1) {
+            cost += it.value()->cost();
+            unused.emplaceBack(it.value()->lastUsed(), it.key());
+        }
+    }
+
+    std::sort(unused.begin(), unused.end());
+    for (const auto &[lastUsed, key] : std::as_const(unused)) {
+        if (cost <= budget) {
+            break;
+        }
+        cost -= renderers.take(key)->cost();
+    }
+}
+
+QFuture<QImage> SvgPrivate::imageAsync(const QString &elementId, qreal ratio, const QSizeF &s)
+{
+    QSize size;
+    QString actualElementId;
+    if (path.isEmpty() || !resolveElement(elementId, ratio, s, actualElementId, size)) {
+        // Nothing to parse, so nothing worth a worker either
+        return QtFuture::makeReadyValueFuture(findImageInCache(elementId, ratio, s));
     }
 
+    const QString id = cachePath(actualElementId, size);
+
+    QImage cached;
+    if (cacheRendering && lastModified == SvgRectsCache::instance()->lastModifiedTimeFromCache(path) && actualImageSet()->d->findInCache(id, cached, lastModified)) {
+        cached.setDevicePixelRatio(ratio);
+        return QtFuture::makeReadyValueFuture(cached);
+    }
+
+    const QString pendingKey = id % QLatin1Char('_') % QString::number(ratio);
+    std::lock_guard lock(s_pendingImagesLock);
+    // A canceled one is only waiting for its worker to notice, start over
+    if (auto it = s_pendingImages.constFind(pendingKey); it != s_pendingImages.constEnd() && !it->future.isCanceled()) {
+        return it->future;
+    }
+
+    // Monochrome elements are rendered in white and tinted, as in findImageInCache()
+    QString colorClass;
+    QColor tintColor;
+    const bool monochrome = monochromeColor(actualElementId, colorClass, tintColor);
+    const QString coverageKey = monochrome ? coverageCachePath(actualElementId, size, ratio) : QString();
+    if (monochrome) {
+        if (const QImage coverage = SvgCoverage::find(coverageKey); !coverage.isNull()) {
+            // Tinting is cheap enough not to need a worker
+            QImage image = SvgCoverage::tint(coverage, tintColor);
+            image.setDevicePixelRatio(ratio);
+            if (cacheRendering) {
+                actualImageSet()->d->insertIntoCache(id, image, QString::number((qint64)q, 16) % QLatin1Char('_') % actualElementId);
+            }
+            return QtFuture::makeReadyValueFuture(image);
+        }
+    }
+
+    const QString styleSheet = monochrome ? SvgCoverage::styleSheet(colorClass) : currentStyleSheet();
+    // Renderers of the pool threads outlive the objects, don't let them outlive the file too
+    const QString rendererKey = styleSheetChecksum(styleSheet) % path % QLatin1Char('@') % QString::number(lastModified);
+    const QPointer<ImageSet> imageSet = cacheRendering ? actualImageSet() : nullptr;
+    const QString cacheOwner = QString::number((qint64)q, 16) % QLatin1Char('_') % actualElementId;
+
+    QPromise<QImage> promise;
+    QFuture<QImage> future = promise.future();
+    const quint64 serial = ++s_pendingImagesSerial;
+    s_pendingImages.insert(pendingKey, PendingImage{serial, future});
+
+    QThreadPool::globalInstance()->start([promise = std::move(promise),
+                                          path = path,
+                                          lastModified = lastModified,
+                                          styleSheet,
+                                          rendererKey,
+                                          actualElementId,
+                                          size,
+                                          ratio,
+                                          tintColor,
+                                          coverageKey,
+                                          id,
+                                          pendingKey,
+                                          serial,
+                                          imageSet,
+                                          cacheOwner]() mutable {
+        promise.start();
+
+        QImage image;
+        if (!promise.isCanceled()) {
+            // QSvgRenderer is not thread safe, every pool thread gets its own
+            QHash<QString, SharedSvgRenderer::Ptr> &threadRenderers = s_threadRenderers.localData();
+            SharedSvgRenderer::Ptr renderer = threadRenderers.value(rendererKey);
+            if (!renderer) {
+                QHash<QString, QRectF> interestingElements;
+                renderer = new SharedSvgRenderer(path, styleSheet, interestingElements);
+                threadRenderers.insert(rendererKey, renderer);
+            }
+            renderer->touch();
+
+            image = QImage(size, QImage::Format_ARGB32_Premultiplied);
+            image.fill(Qt::transparent);
+            QPainter renderPainter(&image);
+            renderElement(&renderPainter, renderer.data(), actualElementId, size);
+            renderPainter.end();
+            renderer = nullptr;
+            trimJobRenderers(threadRenderers);
+
+            if (tintColor.isValid()) {
+                QImage coverage = SvgCoverage::fromWhite(image);
+                coverage.setDevicePixelRatio(ratio);
+                SvgCoverage::insert(coverageKey, coverage);
+                image = SvgCoverage::tint(coverage, tintColor);
+            }
+            image.setDevicePixelRatio(ratio);
+            promise.addResult(image);
+        }
+        promise.finish();
+
+        // The pending inserts of the image set belong to the GUI thread. Until the image is
+        // in the cache, requests for it keep getting the finished future
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [image, path, lastModified, id, pendingKey, serial, imageSet, cacheOwner]() {
+            if (!image.isNull()) {
+                if (imageSet) {
+                    imageSet->d->insertIntoCache(id, image, cacheOwner);
+                }
+                SvgRectsCache::instance()->updateLastModified(path, lastModified);
+            }
+            std::lock_guard lock(s_pendingImagesLock);
+            if (auto it = s_pendingImages.find(pendingKey); it != s_pendingImages.end() && it->serial == serial) {
+                s_pendingImages.erase(it);
+            }
+        });
+    });
+
+    return future;
+}
+
+bool SvgPrivate::monochromeColor(const QString &elementId, QString &colorClass, QColor &color)
+{
+    if (path.isEmpty()) {
+        return false;
+    }
+
+    const SvgIndex::Ptr index = SvgIndex::forFile(path, lastModified);
+    colorClass = index ? index->monochromeClass(elementId) : QString();
+    if (colorClass.isEmpty()) {
+        return false;
+    }
+
+    // Only the classes the stylesheets give a color to
+    bool ok = false;
+    const int colorName = QMetaEnum::fromType<Svg::StyleSheetColor>().keyToValue(colorClass.toLatin1().constData(), &ok);
+    if (!ok) {
+        return false;
+    }
+    color = q->color(Svg::StyleSheetColor(colorName));
+    return color.isValid();
+}
+
+QString SvgPrivate::coverageCachePath(const QString &id, const QSize &size, qreal ratio) const
+{
+    // Nothing about colors, the coverage is the same in all of them
+    const CacheId cacheId{.width = double(size.width()),
+                          .height = double(size.height()),
+                          .filePath = path,
+                          .elementName = id,
+                          .status = Svg::Normal,
+                          .scaleFactor = ratio,
+                          .colorSet = -1,
+                          .styleSheet = 0,
+                          .extraFlags = 0,
+                          .lastModified = lastModified};
+    return QString::number(qHash(cacheId, SvgRectsCache::s_seed));
+}
+
+QImage SvgPrivate::coverageImage(const QString &elementId, const QString &colorClass, const QSize &size, qreal ratio)
+{
+    const QString key = coverageCachePath(elementId, size, ratio);
+    QImage coverage = SvgCoverage::find(key);
+    if (!coverage.isNull()) {
+        return coverage;
+    }
+
+    const SharedSvgRenderer::Ptr coverageRenderer =
+        cachedRenderer(SvgCoverage::styleSheet(colorClass), rendersSubDocuments(elementId) ? elementId : QString());
+
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter renderPainter(&image);
+    renderElement(&renderPainter, coverageRenderer.data(), elementId, size);
     renderPainter.end();
-    p.setDevicePixelRatio(ratio);
 
-    if (cacheRendering) {
-        actualImageSet()->d->insertIntoCache(id, p, QString::number((qint64)q, 16) % QLatin1Char('_') % actualElementId);
+    coverage = SvgCoverage::fromWhite(image);
+    coverage.setDevicePixelRatio(ratio);
+    SvgCoverage::insert(key, coverage);
+    return coverage;
+}
+
+bool SvgPrivate::rendersSubDocuments(const QString &elementId) const
+{
+    if (elementId.isEmpty() || path.isEmpty()) {
+        return false;
     }
+    const SvgSubDocuments::Ptr documents = SvgSubDocuments::forFile(path);
+    return documents && documents->isLarge();
+}
 
-    SvgRectsCache::instance()->updateLastModified(path, lastModified);
+QList<QImage> SvgPrivate::renderElements(const QStringList &elementIds, const QList<QRectF> &rects, qreal ratio)
+{
+    // Slices are only what rendering each element alone would give if they are whole pixels
+    auto isWhole = [](qreal value) {
+        return std::abs(value - std::round(value)) < 0.01;
+    };
+    // and if they don't overlap, or the slice of one would have some of the other in it
+    QRectF bounds;
+    QList<QRect> pixelRects;
+    pixelRects.reserve(rects.size());
+    for (const QRectF &rect : rects) {
+        const QRectF pixels(rect.topLeft() * ratio, rect.size() * ratio);
+        if (pixels.isEmpty() || !isWhole(pixels.x()) || !isWhole(pixels.y()) || !isWhole(pixels.width()) || !isWhole(pixels.height())) {
+            return {};
+        }
+        const QRect rounded = pixels.toRect();
+        for (const QRect &other : std::as_const(pixelRects)) {
+            if (rounded.intersects(other)) {
+                return {};
+            }
+        }
+        pixelRects << rounded;
+        bounds |= pixels;
+    }
+    if (bounds.isEmpty() || !resolvePath()) {
+        return {};
+    }
 
-    return p;
+    const SvgSubDocuments::Ptr documents = SvgSubDocuments::forFile(path);
+    const QByteArray contents = documents ? documents->extract(elementIds) : QByteArray();
+    if (contents.isNull()) {
+        return {};
+    }
+    QHash<QString, QRectF> interestingElements;
+    SharedSvgRenderer renderer(contents, currentStyleSheet(), interestingElements);
+    if (!renderer.isValid()) {
+        return {};
+    }
+
+    // The elements where they are in the document, which only has them
+    const QRect pixelBounds = bounds.toAlignedRect();
+    QImage image(pixelBounds.size(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter renderPainter(&image);
+    renderPainter.translate(-pixelBounds.topLeft());
+    renderPainter.scale(ratio, ratio);
+    renderer.render(&renderPainter, renderer.viewBoxF());
+    renderPainter.end();
+
+    QList<QImage> images;
+    images.reserve(rects.size());
+    for (const QRectF &rect : rects) {
+        const QRect pixels(QPointF(rect.topLeft() * ratio).toPoint() - pixelBounds.topLeft(), QSizeF(rect.size() * ratio).toSize());
+        images << image.copy(pixels);
+    }
+    return images;
+}
+
+SharedSvgRenderer::Ptr SvgPrivate::cachedRenderer(const QString &styleSheet, const QString &elementId)
+{
+    // The path is in the key of subdocument renderers too, for them to be reloaded with the file
+    const QString rendererKey = elementId.isEmpty() ? styleSheetChecksum(styleSheet) + path : styleSheetChecksum(styleSheet) % path % QLatin1Char('#') % elementId;
+    auto create = [this, &styleSheet, &elementId]() {
+        QHash<QString, QRectF> interestingElements;
+        if (elementId.isEmpty()) {
+            return new SharedSvgRenderer(path, styleSheet, interestingElements);
+        }
+        return new SharedSvgRenderer(path, elementId, styleSheet, interestingElements);
+    };
+    SharedSvgRenderer::Ptr cached;
+
+    // Same sharing rules as createRenderer()
+    if (q->thread() == qGuiApp->thread()) {
+        {
+            std::shared_lock lock(s_renderersLock);
+            cached = s_renderers.value(rendererKey);
+        }
+        if (!cached) {
+            cached = create();
+            {
+                std::unique_lock lock(s_renderersLock);
+                s_renderers.insert(rendererKey, cached);
+            }
+            if (SvgRendererManager *manager = SvgRendererManager::instance()) {
+                manager->trim();
+            }
+        }
+    } else if (QThread::currentThread() == q->thread()) {
+        SharedSvgRenderer::Ptr &threadRenderer = s_threadRenderers.localData()[rendererKey];
+        if (!threadRenderer) {
+            threadRenderer = create();
+        }
+        cached = threadRenderer;
+    } else {
+        cached = create();
+    }
+
+    cached->touch();
+    return cached;
+}
+
+QString SvgPrivate::currentStyleSheet()
+{
+    if (!colorOverrides.isEmpty()) {
+        if (stylesheetOverride.isEmpty()) {
+            stylesheetOverride = actualImageSet()->d->svgStyleSheet(q);
+        }
+        return stylesheetOverride;
+    }
+    return actualImageSet()->d->svgStyleSheet(q);
 }
 
 void SvgPrivate::createRenderer()
 {
     if (renderer) {
+        rendererUsed.store(true, std::memory_order_relaxed);
+        renderer->touch();
         return;
     }
 
     if (themed && path.isEmpty() && !themeFailed) {
         if (path.isEmpty()) {
-            path = actualImageSet()->imagePath(themePath);
+            setPath(actualImageSet()->imagePath(themePath));
             themeFailed = path.isEmpty();
             if (themeFailed) {
                 qCWarning(LOG_KSVG) << "No image path found for" << themePath;
@@ -654,26 +1141,44 @@ void SvgPrivate::createRenderer()
         }
     }
 
-    QString styleSheet;
-    if (!colorOverrides.isEmpty()) {
-        if (stylesheetOverride.isEmpty()) {
-            stylesheetOverride = actualImageSet()->d->svgStyleSheet(q);
-        }
-        styleSheet = stylesheetOverride;
-    } else {
-        styleSheet = actualImageSet()->d->svgStyleSheet(q);
-    }
-
-    styleCrc = qChecksum(QByteArrayView(styleSheet.toUtf8().constData(), styleSheet.size()));
+    const QString styleSheet = currentStyleSheet();
+    styleCrc = styleSheetChecksum(styleSheet);
 
     // If the KSVG lives on the main thread (the majority case) share a renderer
     // For other uses we should not as QSvgRenderer is not thread safe.
     // We cannot compare the current thread as this might be hit from the render thread in updatePaintNode for KSVG objects living on the main thread
+    // KSVG objects living on another thread share with the other ones of their thread, as long as they are used from it
     if (q->thread() == qGuiApp->thread()) {
+        rendererCache = RendererCache::Shared;
+    } else if (QThread::currentThread() == q->thread()) {
+        rendererCache = RendererCache::Thread;
+    } else {
+        rendererCache = RendererCache::None;
+    }
+
+    const QString rendererKey = styleCrc + path;
+    if (rendererCache == RendererCache::Shared) {
         std::shared_lock lock(s_renderersLock);
-        QHash<QString, SharedSvgRenderer::Ptr>::const_iterator it = s_renderers.constFind(styleCrc + path);
+        QHash<QString, SharedSvgRenderer::Ptr>::const_iterator it = s_renderers.constFind(rendererKey);
 
         if (it != s_renderers.constEnd()) {
+            renderer = it.value();
+            lock.unlock();
+            renderer->touch();
+            rendererUsed.store(true, std::memory_order_relaxed);
+            if (SvgRendererManager *manager = SvgRendererManager::instance()) {
+                manager->watch(this);
+            }
+            if (size == QSizeF()) {
+                size = renderer->defaultSize();
+            }
+            return;
+        }
+    } else if (rendererCache == RendererCache::Thread) {
+        const QHash<QString, SharedSvgRenderer::Ptr> &threadRenderers = s_threadRenderers.localData();
+        auto it = threadRenderers.constFind(rendererKey);
+
+        if (it != threadRenderers.constEnd()) {
             renderer = it.value();
             if (size == QSizeF()) {
                 size = renderer->defaultSize();
@@ -687,78 +1192,135 @@ void SvgPrivate::createRenderer()
     } else {
         QHash<QString, QRectF> interestingElements;
         renderer = new SharedSvgRenderer(path, styleSheet, interestingElements);
+        cacheInterestingElements(interestingElements);
+    }
 
-        // Add interesting elements to the theme's rect cache.
-        QHashIterator<QString, QRectF> i(interestingElements);
-
-        QRegularExpression sizeHintedKeyExpr(QStringLiteral("^(\\d+)-(\\d+)-(.+)$"));
-
-        while (i.hasNext()) {
-            i.next();
-            const QString &elementId = i.key();
-            QString originalId = i.key();
-            const QRectF &elementRect = i.value();
-
-            originalId.replace(sizeHintedKeyExpr, QStringLiteral("\\3"));
-            SvgRectsCache::instance()->insertSizeHintForId(path, originalId, elementRect.size().toSize());
-
-            const CacheId cacheId{.width = -1.0,
-                                  .height = -1.0,
-                                  .filePath = path,
-                                  .elementName = elementId,
-                                  .status = status,
-                                  .scaleFactor = devicePixelRatio,
-                                  .colorSet = -1,
-                                  .styleSheet = 0,
-                                  .extraFlags = 0,
-                                  .lastModified = lastModified};
-            SvgRectsCache::instance()->insert(cacheId, elementRect, lastModified);
+    renderer->touch();
+    if (rendererCache == RendererCache::Shared) {
+        {
+            std::unique_lock lock(s_renderersLock);
+            s_renderers[rendererKey] = renderer;
         }
+        rendererUsed.store(true, std::memory_order_relaxed);
+        if (SvgRendererManager *manager = SvgRendererManager::instance()) {
+            manager->watch(this);
+            manager->trim();
+        }
+    } else if (rendererCache == RendererCache::Thread) {
+        s_threadRenderers.localData()[rendererKey] = renderer;
     }
 
-    {
-        std::unique_lock lock(s_renderersLock);
-        s_renderers[styleCrc + path] = renderer;
-        if (size == QSizeF()) {
-            size = renderer->defaultSize();
-        }
+    if (size == QSizeF()) {
+        size = renderer->defaultSize();
     }
 }
 
+void SvgPrivate::cacheInterestingElements(const QHash<QString, QRectF> &interestingElements)
+{
+    // Add interesting elements to the theme's rect cache.
+    QHashIterator<QString, QRectF> i(interestingElements);
+
+    static const QRegularExpression sizeHintedKeyExpr(QStringLiteral("^(\\d+)-(\\d+)-(.+)$"));
+
+    while (i.hasNext()) {
+        i.next();
+        const QString &elementId = i.key();
+        QString originalId = i.key();
+        const QRectF &elementRect = i.value();
+
+        originalId.replace(sizeHintedKeyExpr, QStringLiteral("\\3"));
+        SvgRectsCache::instance()->insertSizeHintForId(path, originalId, elementRect.size().toSize());
+
+        const CacheId cacheId{.width = -1.0,
+                              .height = -1.0,
+                              .filePath = path,
+                              .elementName = elementId,
+                              .status = status,
+                              .scaleFactor = devicePixelRatio,
+                              .colorSet = -1,
+                              .styleSheet = 0,
+                              .extraFlags = 0,
+                              .lastModified = lastModified};
+        SvgRectsCache::instance()->insert(cacheId, elementRect, lastModified);
+    }
+}
+
+bool SvgPrivate::loadFromIndex()
+{
+    if (renderer || path.isEmpty()) {
+        return false;
+    }
+
+    // The index has to give everything createRenderer() would otherwise have cached
+    const SvgIndex::Ptr index = SvgIndex::forFile(path, lastModified);
+    if (!index || !index->defaultSize().isValid() || !index->sizeHintsKnown()) {
+        return false;
+    }
+
+    cacheInterestingElements(index->sizeHintedElements());
+    naturalSize = index->defaultSize();
+    if (size == QSizeF()) {
+        size = naturalSize;
+    }
+    return true;
+}
+
 void SvgPrivate::eraseRenderer()
 {
+    // Shared renderers nobody holds stay around as long as they fit in the budget
+    SvgRendererManager *manager = rendererCache == RendererCache::Shared ? SvgRendererManager::instance() : nullptr;
+    if (manager) {
+        manager->unwatch(this);
+    }
+
     if (renderer && renderer->ref.loadRelaxed() == 2) {
         // this and the cache reference it
-        std::unique_lock lock(s_renderersLock);
-        s_renderers.erase(s_renderers.find(styleCrc + path));
+        const QString rendererKey = styleCrc + path;
+        if (rendererCache == RendererCache::Thread && QThread::currentThread() == q->thread() && s_threadRenderers.hasLocalData()) {
+            // Those left behind by objects destroyed elsewhere go along with the thread
+            QHash<QString, SharedSvgRenderer::Ptr> &threadRenderers = s_threadRenderers.localData();
+            auto it = threadRenderers.find(rendererKey);
+            if (it != threadRenderers.end() && it.value() == renderer) {
+                threadRenderers.erase(it);
+            }
+        }
     }
 
     renderer = nullptr;
+    rendererCache = RendererCache::None;
     styleCrc = QChar(0);
+
+    if (manager) {
+        manager->trim();
+    }
 }
 
-QRectF SvgPrivate::elementRect(QStringView elementId)
+bool SvgPrivate::resolvePath()
 {
     if (themed && path.isEmpty()) {
         if (themeFailed) {
-            return QRectF();
+            return false;
         }
 
-        path = actualImageSet()->imagePath(themePath);
+        setPath(actualImageSet()->imagePath(themePath));
         themeFailed = path.isEmpty();
 
         if (themeFailed) {
-            return QRectF();
+            return false;
         }
     }
 
-    if (path.isEmpty()) {
+    return !path.isEmpty();
+}
+
+QRectF SvgPrivate::elementRect(QStringView elementId)
+{
+    if (!resolvePath()) {
         return QRectF();
     }
 
     QRectF rect;
-    const CacheId cacheId = SvgPrivate::cacheId(elementId);
-    bool found = SvgRectsCache::instance()->findElementRect(cacheId, rect);
+    bool found = SvgRectsCache::instance()->findElementRect(cacheIdHash(::qHash(elementId)), path, rect);
     // This is a corner case where we are *sure* the element is not valid
     if (!found) {
         rect = findAndCacheElementRect(elementId);
@@ -767,24 +1329,88 @@ QRectF SvgPrivate::elementRect(QStringView elementId)
     return rect;
 }
 
+QRectF SvgPrivate::elementRect(SvgElementKey key)
+{
+    if (!resolvePath()) {
+        return QRectF();
+    }
+
+    QRectF rect;
+    if (!SvgRectsCache::instance()->findElementRect(cacheIdHash(key.nameHash()), path, rect)) {
+        rect = findAndCacheElementRect(key.name());
+    }
+    return rect;
+}
+
+bool SvgPrivate::hasElement(SvgElementKey key)
+{
+    if (key.name().isEmpty() || (path.isNull() && themePath.isNull())) {
+        return false;
+    }
+    return elementRect(key).isValid();
+}
+
+QSizeF SvgPrivate::elementSize(SvgElementKey key)
+{
+    // Rounded as Svg::elementSize()
+    const QSizeF s = elementRect(key).size();
+    return {std::round(s.width()), std::round(s.height())};
+}
+
+QList<QRectF> SvgPrivate::elementRects(QStringView prefix, const QStringList &ids)
+{
+    if (!resolvePath()) {
+        return QList<QRectF>(ids.size());
+    }
+
+    QList<quint64> hashes;
+    hashes.reserve(ids.size());
+    QString elementId = prefix.toString();
+    for (const QString &id : ids) {
+        elementId.resize(prefix.size());
+        elementId += id;
+        hashes << cacheIdHash(::qHash(elementId));
+    }
+
+    QList<QRectF> rects;
+    const QList<bool> found = SvgRectsCache::instance()->findElementRects(hashes, rects);
+    for (qsizetype i = 0; i < ids.size(); ++i) {
+        if (!found[i]) {
+            rects[i] = findAndCacheElementRect(QString(prefix % ids[i]));
+        }
+    }
+    return rects;
+}
+
 QRectF SvgPrivate::findAndCacheElementRect(QStringView elementId)
 {
     // we need to check the id before createRenderer(), otherwise it may generate a different id compared to the previous cacheId)( call
     const CacheId cacheId = SvgPrivate::cacheId(elementId);
 
-    createRenderer();
-
     auto elementIdString = elementId.toString();
 
-    // This code will usually never be run because createRenderer already caches all the boundingRect in the elements in the svg
-    QRectF elementRect = renderer->elementExists(elementIdString)
-        ? renderer->transformForElement(elementIdString).map(renderer->boundsOnElement(elementIdString)).boundingRect()
-        : QRectF();
+    // Existence and geometry of most elements can be answered without parsing the whole document
+    // into a renderer, which is only needed once pixels are
+    QRectF elementRect;
+    const SvgIndex::Ptr index = renderer ? nullptr : SvgIndex::forFile(path, lastModified);
+    if (index && index->defaultSize().isValid() && index->elementRect(elementIdString, elementRect) != SvgIndex::Unknown) {
+        naturalSize = index->defaultSize();
+        if (size == QSizeF()) {
+            size = naturalSize;
+        }
+    } else {
+        createRenderer();
+
+        // This code will usually never be run because createRenderer already caches all the boundingRect in the elements in the svg
+        elementRect = renderer->elementExists(elementIdString)
+            ? renderer->transformForElement(elementIdString).map(renderer->boundsOnElement(elementIdString)).boundingRect()
+            : QRectF();
 
-    naturalSize = renderer->defaultSize();
+        naturalSize = renderer->defaultSize();
+    }
 
-    qreal dx = size.width() / renderer->defaultSize().width();
-    qreal dy = size.height() / renderer->defaultSize().height();
+    qreal dx = size.width() / naturalSize.width();
+    qreal dy = size.height() / naturalSize.height();
 
     elementRect = QRectF(elementRect.x() * dx, elementRect.y() * dy, elementRect.width() * dx, elementRect.height() * dy);
     SvgRectsCache::instance()->insert(cacheId, elementRect, lastModified);
@@ -877,6 +1503,10 @@ void SvgPrivate::colorsChanged()
 
 std::shared_mutex SvgPrivate::s_renderersLock;
 QHash<QString, SharedSvgRenderer::Ptr> SvgPrivate::s_renderers;
+QThreadStorage<QHash<QString, SharedSvgRenderer::Ptr>> SvgPrivate::s_threadRenderers;
+std::mutex SvgPrivate::s_pendingImagesLock;
+QHash<QString, SvgPrivate::PendingImage> SvgPrivate::s_pendingImages;
+quint64 SvgPrivate::s_pendingImagesSerial = 0;
 QPointer<ImageSet> SvgPrivate::s_systemColorsCache;
 
 Svg::Svg(QObject *parent)
@@ -923,21 +1553,52 @@ QPixmap Svg::pixmap(const QString &elementID)
 
 QImage Svg::image(const QSize &size, const QString &elementID)
 {
-    QPixmap pix(d->findInCache(elementID, d->devicePixelRatio, size));
-    return pix.toImage();
+    return d->findImageInCache(elementID, d->devicePixelRatio, size);
+}
+
+QFuture<QImage> Svg::imageAsync(const QSize &size, const QString &elementID)
+{
+    return d->imageAsync(elementID, d->devicePixelRatio, size);
+}
+
+QImage Svg::coverageImage(const QSize &size, const QString &elementID)
+{
+    QSize pixelSize;
+    QString actualElementId;
+    QString colorClass;
+    QColor color;
+    if (!d->resolveElement(elementID, d->devicePixelRatio, size, actualElementId, pixelSize)
+        || !d->monochromeColor(actualElementId, colorClass, color)) {
+        return QImage();
+    }
+
+    return d->coverageImage(actualElementId, colorClass, pixelSize, d->devicePixelRatio);
+}
+
+QColor Svg::monochromeColor(const QSize &size, const QString &elementID)
+{
+    QSize pixelSize;
+    QString actualElementId;
+    QString colorClass;
+    QColor color;
+    if (!d->resolveElement(elementID, d->devicePixelRatio, size, actualElementId, pixelSize)
+        || !d->monochromeColor(actualElementId, colorClass, color)) {
+        return QColor();
+    }
+    return color;
 }
 
 void Svg::paint(QPainter *painter, const QPointF &point, const QString &elementID)
 {
     Q_ASSERT(painter->device());
     const qreal ratio = painter->device()->devicePixelRatio();
-    QPixmap pix((elementID.isNull() || d->multipleImages) ? d->findInCache(elementID, ratio, size()) : d->findInCache(elementID, ratio));
+    const QImage image((elementID.isNull() || d->multipleImages) ? d->findImageInCache(elementID, ratio, size()) : d->findImageInCache(elementID, ratio));
 
-    if (pix.isNull()) {
+    if (image.isNull()) {
         return;
     }
 
-    painter->drawPixmap(QRectF(point, size()), pix, QRectF(QPointF(0, 0), pix.size()));
+    painter->drawImage(QRectF(point, size()), image, QRectF(QPointF(0, 0), image.size()));
 }
 
 void Svg::paint(QPainter *painter, int x, int y, const QString &elementID)
@@ -949,17 +1610,17 @@ void Svg::paint(QPainter *painter, const QRectF &rect, const QString &elementID)
 {
     Q_ASSERT(painter->device());
     const qreal ratio = painter->device()->devicePixelRatio();
-    QPixmap pix(d->findInCache(elementID, ratio, rect.size()));
+    const QImage image(d->findImageInCache(elementID, ratio, rect.size()));
 
-    painter->drawPixmap(rect, pix, QRect(QPoint(0, 0), pix.size()));
+    painter->drawImage(rect, image, QRect(QPoint(0, 0), image.size()));
 }
 
 void Svg::paint(QPainter *painter, int x, int y, int width, int height, const QString &elementID)
 {
     Q_ASSERT(painter->device());
     const qreal ratio = painter->device()->devicePixelRatio();
-    QPixmap pix(d->findInCache(elementID, ratio, QSizeF(width, height)));
-    painter->drawPixmap(x, y, pix, 0, 0, pix.size().width(), pix.size().height());
+    const QImage image(d->findImageInCache(elementID, ratio, QSizeF(width, height)));
+    painter->drawImage(x, y, image, 0, 0, image.size().width(), image.size().height());
 }
 
 QSizeF Svg::size() const
@@ -1032,6 +1693,22 @@ bool Svg::hasElement(QStringView elementId) const
     return d->elementRect(elementId).isValid();
 }
 
+QList<QRectF> Svg::elementRects(const QStringList &elementIds) const
+{
+    if (d->path.isNull() && d->themePath.isNull()) {
+        return QList<QRectF>(elementIds.size());
+    }
+    return d->elementRects(QStringView(), elementIds);
+}
+
+QList<QRectF> Svg::elementRects(const QString &prefix, const QStringList &suffixes) const
+{
+    if (d->path.isNull() && d->themePath.isNull()) {
+        return QList<QRectF>(suffixes.size());
+    }
+    return d->elementRects(prefix, suffixes);
+}
+
 bool Svg::isValid() const
 {
     if (d->path.isNull() && d->themePath.isNull()) {
@@ -1047,6 +1724,14 @@ bool Svg::isValid() const
     if (d->path.isEmpty() || !QFileInfo::exists(d->path)) {
         return false;
     }
+
+    if (!d->renderer) {
+        const SvgIndex::Ptr index = SvgIndex::forFile(d->path, d->lastModified);
+        if (index && index->isValid() && index->defaultSize().isValid()) {
+            return true;
+        }
+    }
+
     d->createRenderer();
     return d->renderer->isValid();
 }
@@ -7,6 +7,7 @@
 #ifndef KSVG_SVG_H
 #define KSVG_SVG_H
 
+#include <QFuture>
 #include <QObject>
 #include <QPixmap>
 
@@ -296,6 +297,64 @@ public:
      */
     Q_INVOKABLE QImage image(const QSize &size, const QString &elementID = QString());
 
+    /*!
+     * \brief This method returns an image of the SVG represented by this
+     * object, rendered on a worker thread.
+     *
+     * The image is the same as image() returns for the same arguments, but
+     * parsing the file and rendering it don't block the calling thread. Images
+     * already in the cache are returned as an already finished future, and
+     * requests for an image which is already being rendered share its future,
+     * so canceling it cancels it for all of them.
+     *
+     * \a size the size of the image, as in image()
+     *
+     * \a elementID the ID string of the element to render, or an empty
+     *                 string for the whole SVG (the default)
+     *
+     * \sa image()
+     * \since 6.30
+     */
+    QFuture<QImage> imageAsync(const QSize &size, const QString &elementID = QString());
+
+    /*!
+     * \brief This method returns the shape of an element drawn in a single
+     * color of the stylesheet, without the color.
+     *
+     * Elements painted only with the currentColor of one ColorScheme-* class
+     * look the same in every color set, status and palette but for that
+     * color. For those this returns an image whose alpha channel is what
+     * image() would return, to be drawn in monochromeColor(). The image is
+     * the same one for all colors, so that changing them needs no rendering.
+     *
+     * \a size the size of the image, as in image()
+     *
+     * \a elementID the ID string of the element, or an empty string for the
+     *                 whole SVG (the default)
+     *
+     * Returns a null image if the element isn't drawn in a single color
+     *
+     * \sa monochromeColor()
+     * \since 6.30
+     */
+    QImage coverageImage(const QSize &size, const QString &elementID = QString());
+
+    /*!
+     * \brief This method returns the color to draw the coverageImage() of an
+     * element in.
+     *
+     * \a size the size of the image, as in image()
+     *
+     * \a elementID the ID string of the element, or an empty string for the
+     *                 whole SVG (the default)
+     *
+     * Returns an invalid color if the element isn't drawn in a single color
+     *
+     * \sa coverageImage()
+     * \since 6.30
+     */
+    QColor monochromeColor(const QSize &size, const QString &elementID = QString());
+
     /*!
      * \brief This method paints all or part of the SVG represented by this
      * object.
@@ -462,6 +521,27 @@ public:
      */
     bool hasElement(QStringView elementId) const;
 
+    /*!
+     * \brief This method returns the bounding rects of several elements.
+     *
+     * The rects are the ones elementRect() returns for each of \a elementIds,
+     * in the same order, with null rects for the elements which don't exist.
+     * Looking them up together is cheaper than one by one.
+     *
+     * \sa elementRect()
+     * \since 6.30
+     */
+    QList<QRectF> elementRects(const QStringList &elementIds) const;
+
+    /*!
+     * \brief This method returns the bounding rects of the elements named
+     * \a prefix followed by each of \a suffixes.
+     *
+     * \sa elementRect()
+     * \since 6.30
+     */
+    QList<QRectF> elementRects(const QString &prefix, const QStringList &suffixes) const;
+
     /*!
      * \brief This method checks whether this object is backed by a valid SVG
      * file.